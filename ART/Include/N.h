@@ -37,6 +37,25 @@ namespace ART_unsynchronized {
 
     using Prefix = uint8_t[maxStoredPrefixLength];
 
+    /**
+     * Bytes of a prefix beyond maxStoredPrefixLength, kept out-of-line by trees which store full prefixes
+     */
+    struct PrefixTail {
+        // length of the whole prefix the tail belongs to
+        uint32_t prefixLength;
+
+        uint8_t *getBytes() {
+            return reinterpret_cast<uint8_t *>(this + 1);
+        }
+
+        const uint8_t *getBytes() const {
+            return reinterpret_cast<const uint8_t *>(this + 1);
+        }
+
+        // a tail for the bytes [maxStoredPrefixLength, prefixLength), allocated with operator new
+        static PrefixTail *create(uint32_t prefixLength);
+    };
+
     class N {
     protected:
         N(NTypes type, const uint8_t *prefix, uint32_t prefixLength) {
@@ -56,6 +75,7 @@ namespace ART_unsynchronized {
         uint8_t count = 0;
     protected:
         Prefix prefix;
+        PrefixTail *prefixTail = nullptr;
 
 
         void setType(NTypes type);
@@ -80,10 +100,31 @@ namespace ART_unsynchronized {
 
         void setPrefix(const uint8_t *prefix, uint32_t length);
 
-        void addPrefixBefore(N *node, uint8_t key);
+        /**
+         * the tail keeps growing if both nodes store their full prefixes, the replaced tail is returned to be freed
+         * by the caller
+         */
+        PrefixTail *addPrefixBefore(N *node, uint8_t key);
 
         uint32_t getPrefixLength() const;
 
+        // nullptr if the prefix is not longer than maxStoredPrefixLength or only stored up to it
+        PrefixTail *getPrefixTail() const;
+
+        // keeps the bytes of the prefix set by the constructor which do not fit into it in a tail
+        void storePrefixTail(const uint8_t *prefix);
+
+        // byte i of a prefix which is stored completely
+        uint8_t getPrefixByte(uint32_t i) const;
+
+        bool hasFullPrefix() const;
+
+        /**
+         * drops the first count bytes of a prefix which is stored completely, the replaced tail is returned to be
+         * freed by the caller
+         */
+        PrefixTail *cutPrefix(uint32_t count);
+
         static TID getLeaf(const N *n);
 
         static bool isLeaf(const N *n);
@@ -4,12 +4,32 @@
 
 #ifndef ARTVERSION1_TREE_H
 #define ARTVERSION1_TREE_H
+#include <cstddef>
+#include <type_traits>
 #include "N.h"
+#include "../../Include/Index.h"
+#include "../../Include/KeyLeaf.h"
 
 using namespace ART;
 
 namespace ART_unsynchronized {
 
+    /**
+     * how prefixes longer than maxStoredPrefixLength are stored: cut off, the remaining bytes are read from the key of
+     * any leaf below the node with loadKey, or completely with the remaining bytes in a PrefixTail
+     */
+    enum class PrefixType : uint8_t {
+        Bounded,
+        Full
+    };
+
+    using ART::LeafType;
+
+    using ART::KeyLeaf;
+
+    template<class Value>
+    class ValueTree;
+
     class Tree {
     public:
         using LoadKeyFunction = void (*)(TID tid, Key &key);
@@ -22,6 +42,48 @@ namespace ART_unsynchronized {
 
         LoadKeyFunction loadKey;
 
+        const PrefixType prefixType;
+
+        const LeafType leafType;
+
+        // size of the values of a ValueTree, 0 if the tree stores TIDs
+        const uint32_t valueSize;
+
+        // key of a leaf stored in the tree, from its KeyLeaf or loaded with loadKey
+        void loadLeafKey(TID leaf, Key &key) const {
+            ART::loadLeafKey(leafType, loadKey, leaf, key);
+        }
+
+        // copies the value of a leaf of a ValueTree
+        void loadLeafValue(TID leaf, void *value) const {
+            reinterpret_cast<const KeyLeaf *>(leaf)->loadValue(value, valueSize);
+        }
+
+        // TID of a leaf stored in the tree as handed to the user
+        TID getLeafTid(TID leaf) const {
+            return ART::getLeafTid(leafType, leaf);
+        }
+
+        // frees the KeyLeafs of node and all leaves below it, the subtree is unreachable
+        void deleteKeyLeaves(const N *node);
+
+        // the leaf of k as stored in the tree or 0
+        TID lookupLeaf(const Key &k) const;
+
+        void insertLeaf(const Key &k, N *leaf);
+
+        /**
+         * a tree for ValueTree, its leaves are KeyLeafs with values of valueSize bytes instead of TIDs
+         */
+        Tree(PrefixType prefixType, uint32_t valueSize);
+
+        bool lookupValue(const Key &k, void *value) const;
+
+        void insertValue(const Key &k, const void *value);
+
+        template<class Value>
+        friend class ValueTree;
+
         enum class CheckPrefixResult : uint8_t {
             Match,
             NoMatch,
@@ -46,22 +108,26 @@ namespace ART_unsynchronized {
         };
         static CheckPrefixResult checkPrefix(N* n, const Key &k, uint32_t &level);
 
-        static CheckPrefixPessimisticResult checkPrefixPessimistic(N *n, const Key &k, uint32_t &level,
-                                                                   uint8_t &nonMatchingKey,
-                                                                   Prefix &nonMatchingPrefix,
-                                                                   LoadKeyFunction loadKey);
+        CheckPrefixPessimisticResult checkPrefixPessimistic(N *n, const Key &k, uint32_t &level,
+                                                            uint8_t &nonMatchingKey,
+                                                            Prefix &nonMatchingPrefix) const;
 
-        static PCCompareResults checkPrefixCompare(N* n, const Key &k, uint32_t &level, LoadKeyFunction loadKey);
+        PCCompareResults checkPrefixCompare(N* n, const Key &k, uint32_t &level) const;
 
-        static PCEqualsResults checkPrefixEquals(N* n, uint32_t &level, const Key &start, const Key &end, LoadKeyFunction loadKey);
+        PCEqualsResults checkPrefixEquals(N* n, uint32_t &level, const Key &start, const Key &end) const;
 
     public:
 
-        Tree(LoadKeyFunction loadKey);
+        /**
+         * loadKey may be nullptr in LeafType::EmbeddedKey mode, the tree then never needs the keys of its TIDs
+         */
+        Tree(LoadKeyFunction loadKey, PrefixType prefixType = PrefixType::Bounded,
+             LeafType leafType = LeafType::ExternalKey);
 
         Tree(const Tree &) = delete;
 
-        Tree(Tree &&t) : root(t.root), loadKey(t.loadKey) { }
+        Tree(Tree &&t) : root(t.root), loadKey(t.loadKey), prefixType(t.prefixType), leafType(t.leafType),
+                         valueSize(t.valueSize) { }
 
         ~Tree();
 
@@ -72,7 +138,55 @@ namespace ART_unsynchronized {
 
         void insert(const Key &k, TID tid);
 
+        /**
+         * Inserts n keys sorted in ascending order, unique and prefix free as for insert. Subtrees below a free slot
+         * of the root are built bottom-up in one pass, every node with its final type and prefix, keys below an
+         * occupied slot are inserted one by one.
+         */
+        void bulkLoad(const Key keys[], const TID tids[], std::size_t n);
+
         void remove(const Key &k, TID tid);
     };
+
+    /**
+     * Tree which maps keys to values of any trivially copyable type instead of TIDs. The value is stored in the
+     * KeyLeaf next to the key the lookup compares anyway, in its TID word if it is not larger than 8 bytes, behind the
+     * key otherwise, a hit needs no access to a second table. As for Tree, a key must not be inserted twice and no key
+     * may be a prefix of another one.
+     */
+    template<class Value>
+    class ValueTree {
+        static_assert(std::is_trivially_copyable<Value>::value, "values are copied bytewise");
+        static_assert(alignof(Value) <= alignof(std::max_align_t), "values are stored with fundamental alignment");
+
+        Tree tree;
+
+    public:
+        explicit ValueTree(PrefixType prefixType = PrefixType::Bounded) : tree(prefixType, sizeof(Value)) { }
+
+        bool lookup(const Key &k, Value &value) const {
+            return tree.lookupValue(k, &value);
+        }
+
+        void insert(const Key &k, const Value &value) {
+            tree.insertValue(k, &value);
+        }
+
+        void remove(const Key &k) {
+            tree.remove(k, 0);
+        }
+    };
+}
+
+namespace ART {
+
+    template<>
+    struct IndexTraits<Unsynchronized, DRAM> {
+        using Tree = ART_unsynchronized::Tree;
+
+        using ThreadInfo = NoThreadInfo;
+
+        using Pool = NoPool;
+    };
 }
 #endif //ARTVERSION1_SYNCHRONIZEDTREE_H
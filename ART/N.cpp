@@ -74,6 +74,8 @@ namespace ART_unsynchronized {
         }
 
         auto nBig = new biggerN(n->getPrefix(), n->getPrefixLength());
+        // the tail is handed over
+        nBig->prefixTail = n->prefixTail;
         n->copyTo(nBig);
         nBig->insert(key, val);
 
@@ -169,6 +171,7 @@ namespace ART_unsynchronized {
         }
 
         auto nSmall = new smallerN(n->getPrefix(), n->getPrefixLength());
+        nSmall->prefixTail = n->prefixTail;
 
 
         n->remove(key, true);
@@ -230,7 +233,66 @@ namespace ART_unsynchronized {
         }
     }
 
-    void N::addPrefixBefore(N *node, uint8_t key) {
+    PrefixTail *PrefixTail::create(uint32_t prefixLength) {
+        auto tail = static_cast<PrefixTail *>(operator new(sizeof(PrefixTail) + prefixLength - maxStoredPrefixLength));
+        tail->prefixLength = prefixLength;
+        return tail;
+    }
+
+    PrefixTail *N::getPrefixTail() const {
+        return prefixTail;
+    }
+
+    void N::storePrefixTail(const uint8_t *prefix) {
+        if (prefixCount > maxStoredPrefixLength) {
+            prefixTail = PrefixTail::create(prefixCount);
+            memcpy(prefixTail->getBytes(), prefix + maxStoredPrefixLength, prefixCount - maxStoredPrefixLength);
+        }
+    }
+
+    uint8_t N::getPrefixByte(uint32_t i) const {
+        if (i < maxStoredPrefixLength) {
+            return prefix[i];
+        }
+        return prefixTail->getBytes()[i - maxStoredPrefixLength];
+    }
+
+    bool N::hasFullPrefix() const {
+        return prefixCount <= maxStoredPrefixLength || prefixTail != nullptr;
+    }
+
+    PrefixTail *N::cutPrefix(uint32_t count) {
+        PrefixTail *oldTail = prefixTail;
+        uint32_t length = prefixCount - count;
+        PrefixTail *tail = nullptr;
+        if (length > maxStoredPrefixLength) {
+            tail = PrefixTail::create(length);
+            for (uint32_t i = maxStoredPrefixLength; i < length; ++i) {
+                tail->getBytes()[i - maxStoredPrefixLength] = getPrefixByte(count + i);
+            }
+        }
+        // every byte is read before it is overwritten
+        for (uint32_t i = 0; i < std::min(length, maxStoredPrefixLength); ++i) {
+            prefix[i] = getPrefixByte(count + i);
+        }
+        prefixCount = length;
+        prefixTail = tail;
+        return oldTail;
+    }
+
+    PrefixTail *N::addPrefixBefore(N *node, uint8_t key) {
+        PrefixTail *oldTail = prefixTail;
+        uint32_t nodePrefixLength = node->getPrefixLength();
+        uint32_t length = nodePrefixLength + 1 + getPrefixLength();
+        PrefixTail *tail = nullptr;
+        if (length > maxStoredPrefixLength && node->hasFullPrefix() && hasFullPrefix()) {
+            tail = PrefixTail::create(length);
+            for (uint32_t i = maxStoredPrefixLength; i < length; ++i) {
+                tail->getBytes()[i - maxStoredPrefixLength] =
+                        i < nodePrefixLength ? node->getPrefixByte(i) :
+                        i == nodePrefixLength ? key : getPrefixByte(i - nodePrefixLength - 1);
+            }
+        }
         uint32_t prefixCopyCount = std::min(maxStoredPrefixLength, node->getPrefixLength() + 1);
         memmove(this->prefix + prefixCopyCount, this->prefix,
                 std::min(this->getPrefixLength(), maxStoredPrefixLength - prefixCopyCount));
@@ -239,6 +301,8 @@ namespace ART_unsynchronized {
             this->prefix[prefixCopyCount - 1] = key;
         }
         this->prefixCount += node->getPrefixLength() + 1;
+        prefixTail = tail;
+        return oldTail;
     }
 
 
@@ -271,6 +335,7 @@ namespace ART_unsynchronized {
         if (N::isLeaf(node)) {
             return;
         }
+        operator delete(node->prefixTail);
         switch (node->getType()) {
             case NTypes::N4: {
                 auto n = static_cast<N4 *>(node);
@@ -31,11 +31,12 @@ namespace ART_unsynchronized {
 
     template<>
     void N16::copyTo(N4 *n) const {
+        // only the first count entries are valid, the removed one may still be behind them
         n->count = count;
-        for (unsigned i = 0; i < N16_shrink; i++) {
+        for (unsigned i = 0; i < count; i++) {
             n->keys[i] = flipSign(keys[i]);
         }
-        memcpy(n->children, children, sizeof(uintptr_t) * N16_shrink);
+        memcpy(n->children, children, sizeof(uintptr_t) * count);
     }
 
     void N16::change(uint8_t key, N *val) {
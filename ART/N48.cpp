@@ -79,7 +79,7 @@ namespace ART_unsynchronized {
         childrenCount = 0;
         for (unsigned i = start; i <= end; i++) {
             if (this->childIndex[i] != emptyMarker) {
-                children[childrenCount] = std::make_tupFle(i, this->children[this->childIndex[i]]);
+                children[childrenCount] = std::make_tuple(i, this->children[this->childIndex[i]]);
                 childrenCount++;
             }
         }
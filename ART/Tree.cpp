@@ -1,21 +1,62 @@
 #include <assert.h>
 #include <algorithm>
 #include <iostream>
+#include <stdexcept>
 #include "Include/Tree.h"
 #include "../Include/Epoche.cpp"
+#include "../Include/BulkLoad.h"
 #include "N.cpp"
 
 namespace ART_unsynchronized {
 
-    Tree::Tree(LoadKeyFunction loadKey) : root(new N256(nullptr, 0)), loadKey(loadKey) {
+    namespace {
+        // orders keys bytewise, a key is smaller than the keys it is a prefix of
+        int compareKeys(const Key &a, const Key &b) {
+            int c = memcmp(&a[0], &b[0], std::min(a.getKeyLen(), b.getKeyLen()));
+            if (c != 0) {
+                return c;
+            }
+            return a.getKeyLen() < b.getKeyLen() ? -1 : a.getKeyLen() > b.getKeyLen() ? 1 : 0;
+        }
+    }
+
+    Tree::Tree(LoadKeyFunction loadKey, PrefixType prefixType, LeafType leafType) : root(new N256(nullptr, 0)),
+                                                                                     loadKey(loadKey),
+                                                                                     prefixType(prefixType),
+                                                                                     leafType(leafType),
+                                                                                     valueSize(0) {
+        if (leafType == LeafType::ExternalKey && loadKey == nullptr) {
+            N::deleteNode(root);
+            throw std::invalid_argument("ART_unsynchronized: loadKey is required without embedded keys");
+        }
+    }
+
+    Tree::Tree(PrefixType prefixType, uint32_t valueSize) : root(new N256(nullptr, 0)), loadKey(nullptr),
+                                                            prefixType(prefixType), leafType(LeafType::EmbeddedKey),
+                                                            valueSize(valueSize) {
     }
 
     Tree::~Tree() {
+        deleteKeyLeaves(root);
         N::deleteChildren(root);
         N::deleteNode(root);
     }
 
     TID Tree::lookup(const Key &k) const {
+        TID leaf = lookupLeaf(k);
+        return leaf == 0 ? 0 : getLeafTid(leaf);
+    }
+
+    bool Tree::lookupValue(const Key &k, void *value) const {
+        TID leaf = lookupLeaf(k);
+        if (leaf == 0) {
+            return false;
+        }
+        loadLeafValue(leaf, value);
+        return true;
+    }
+
+    TID Tree::lookupLeaf(const Key &k) const {
         N *node = nullptr;
         N *nextNode = root;
         uint32_t level = 0;
@@ -50,53 +91,44 @@ namespace ART_unsynchronized {
         }
     }
 
-    bool Tree::lookupRange(const Key &, const Key &, Key &, TID [],
-                                std::size_t , std::size_t &) const {
-        return false;
-        /*for (uint32_t i = 0; i < std::min(start.getKeyLen(), end.getKeyLen()); ++i) {
+    bool Tree::lookupRange(const Key &start, const Key &end, Key &continueKey, TID result[],
+                           std::size_t resultSize, std::size_t &resultsFound) const {
+        resultsFound = 0;
+        for (uint32_t i = 0; i < std::min(start.getKeyLen(), end.getKeyLen()); ++i) {
             if (start[i] > end[i]) {
-                resultsFound = 0;
                 return false;
             } else if (start[i] < end[i]) {
                 break;
             }
         }
         TID toContinue = 0;
-        std::function<void(const N *)> copy = [&result, &resultSize, &resultsFound, &toContinue, &copy](const N *node) {
+        std::function<void(N *)> copy = [&result, &resultSize, &resultsFound, &toContinue, &copy, this](N *node) {
             if (N::isLeaf(node)) {
                 if (resultsFound == resultSize) {
                     toContinue = N::getLeaf(node);
                     return;
                 }
-                result[resultsFound] = N::getLeaf(node);
+                result[resultsFound] = getLeafTid(N::getLeaf(node));
                 resultsFound++;
             } else {
                 std::tuple<uint8_t, N *> children[256];
                 uint32_t childrenCount = 0;
                 N::getChildren(node, 0u, 255u, children, childrenCount);
                 for (uint32_t i = 0; i < childrenCount; ++i) {
-                    const N *n = std::get<1>(children[i]);
-                    copy(n);
+                    copy(std::get<1>(children[i]));
                     if (toContinue != 0) {
                         break;
                     }
                 }
             }
         };
-        std::function<void(const N *, uint32_t)> findStart = [&copy, &start, &findStart, &toContinue, &restart, this](
-                const N *node, uint32_t level) {
+        std::function<void(N *, uint32_t)> findStart = [&copy, &start, &findStart, &toContinue, this](
+                N *node, uint32_t level) {
             if (N::isLeaf(node)) {
                 copy(node);
                 return;
             }
-
-            uint64_t v;
-            PCCompareResults prefixResult;
-            do {
-                v = node->startReading();
-                prefixResult = checkPrefixCompare(node, start, level, loadKey);
-            } while (!node->stopReading(v));
-            switch (prefixResult) {
+            switch (checkPrefixCompare(node, start, level)) {
                 case PCCompareResults::Bigger:
                     copy(node);
                     break;
@@ -107,38 +139,28 @@ namespace ART_unsynchronized {
                     N::getChildren(node, startLevel, 255, children, childrenCount);
                     for (uint32_t i = 0; i < childrenCount; ++i) {
                         const uint8_t k = std::get<0>(children[i]);
-                        const N *n = std::get<1>(children[i]);
+                        N *n = std::get<1>(children[i]);
                         if (k == startLevel) {
                             findStart(n, level + 1);
                         } else if (k > startLevel) {
                             copy(n);
                         }
-                        if (toContinue != 0 || restart) {
+                        if (toContinue != 0) {
                             break;
                         }
                     }
                     break;
                 }
-                case PCCompareResults::SkippedLevel:
-                    restart = true;
-                    break;
                 case PCCompareResults::Smaller:
                     break;
             }
         };
-        std::function<void(const N *, uint32_t)> findEnd = [&copy, &end, &toContinue, &restart, &findEnd, this](
-                const N *node, uint32_t level) {
+        std::function<void(N *, uint32_t)> findEnd = [&copy, &end, &toContinue, &findEnd, this](
+                N *node, uint32_t level) {
             if (N::isLeaf(node)) {
                 return;
             }
-            uint64_t v;
-            PCCompareResults prefixResult;
-            do {
-                v = node->startReading();
-                prefixResult = checkPrefixCompare(node, end, level, loadKey);
-            } while (!node->stopReading(v));
-
-            switch (prefixResult) {
+            switch (checkPrefixCompare(node, end, level)) {
                 case PCCompareResults::Smaller:
                     copy(node);
                     break;
@@ -149,13 +171,13 @@ namespace ART_unsynchronized {
                     N::getChildren(node, 0, endLevel, children, childrenCount);
                     for (uint32_t i = 0; i < childrenCount; ++i) {
                         const uint8_t k = std::get<0>(children[i]);
-                        const N *n = std::get<1>(children[i]);
+                        N *n = std::get<1>(children[i]);
                         if (k == endLevel) {
                             findEnd(n, level + 1);
                         } else if (k < endLevel) {
                             copy(n);
                         }
-                        if (toContinue != 0 || restart) {
+                        if (toContinue != 0) {
                             break;
                         }
                     }
@@ -163,38 +185,18 @@ namespace ART_unsynchronized {
                 }
                 case PCCompareResults::Bigger:
                     break;
-                case PCCompareResults::SkippedLevel:
-                    restart = true;
-                    break;
             }
         };
 
-        restart:
-        restart = false;
-        resultsFound = 0;
-
         uint32_t level = 0;
-        N *node = nullptr;
-        N *nextNode = root;
-
+        N *node = root;
         while (true) {
-            node = nextNode;
-            uint64_t v;
-            PCEqualsResults prefixResult;
-            do {
-                v = node->startReading();
-                prefixResult = checkPrefixEquals(node, level, start, end, loadKey);
-            } while (!node->stopReading(v));
-            switch (prefixResult) {
-                case PCEqualsResults::SkippedLevel:
-                    goto restart;
-                case PCEqualsResults::NoMatch: {
+            switch (checkPrefixEquals(node, level, start, end)) {
+                case PCEqualsResults::NoMatch:
                     return false;
-                }
-                case PCEqualsResults::Contained: {
+                case PCEqualsResults::Contained:
                     copy(node);
                     break;
-                }
                 case PCEqualsResults::StartMatch: {
                     uint8_t startLevel = (start.getKeyLen() > level) ? start[level] : 0;
                     std::tuple<uint8_t, N *> children[256];
@@ -202,16 +204,13 @@ namespace ART_unsynchronized {
                     N::getChildren(node, startLevel, 255, children, childrenCount);
                     for (uint32_t i = 0; i < childrenCount; ++i) {
                         const uint8_t k = std::get<0>(children[i]);
-                        const N *n = std::get<1>(children[i]);
+                        N *n = std::get<1>(children[i]);
                         if (k == startLevel) {
                             findStart(n, level + 1);
                         } else if (k > startLevel) {
                             copy(n);
                         }
-                        if (restart) {
-                            goto restart;
-                        }
-                        if (toContinue) {
+                        if (toContinue != 0) {
                             break;
                         }
                     }
@@ -226,7 +225,7 @@ namespace ART_unsynchronized {
                         N::getChildren(node, startLevel, endLevel, children, childrenCount);
                         for (uint32_t i = 0; i < childrenCount; ++i) {
                             const uint8_t k = std::get<0>(children[i]);
-                            const N *n = std::get<1>(children[i]);
+                            N *n = std::get<1>(children[i]);
                             if (k == startLevel) {
                                 findStart(n, level + 1);
                             } else if (k > startLevel && k < endLevel) {
@@ -234,45 +233,80 @@ namespace ART_unsynchronized {
                             } else if (k == endLevel) {
                                 findEnd(n, level + 1);
                             }
-                            if (restart) {
-                                goto restart;
-                            }
-                            if (toContinue) {
+                            if (toContinue != 0) {
                                 break;
                             }
                         }
-                    } else {
-                        nextNode = N::getChild(startLevel, node);
-                        if (!node->stopReading(v)) {
-                            goto restart;
+                        break;
+                    }
+                    N *nextNode = N::getChild(startLevel, node);
+                    if (nextNode == nullptr) {
+                        return false;
+                    }
+                    if (N::isLeaf(nextNode)) {
+                        // the only key below the common bytes of start and end, its remaining bytes were never compared
+                        Key key;
+                        loadLeafKey(N::getLeaf(nextNode), key);
+                        if (compareKeys(key, start) >= 0 && compareKeys(key, end) <= 0) {
+                            copy(nextNode);
                         }
-                        level++;
-                        continue;
+                        break;
                     }
-                    break;
+                    node = nextNode;
+                    level++;
+                    continue;
                 }
             }
             break;
         }
         if (toContinue != 0) {
-            loadKey(toContinue, continueKey);
+            loadLeafKey(toContinue, continueKey);
             return true;
-        } else {
-            return false;
-        }*/
+        }
+        return false;
     }
 
-
-    TID Tree::checkKey(const TID tid, const Key &k) const {
+    TID Tree::checkKey(const TID leaf, const Key &k) const {
+        if (leafType == LeafType::EmbeddedKey) {
+            auto l = reinterpret_cast<const KeyLeaf *>(leaf);
+            if (l->hasKey(k)) {
+                return leaf;
+            }
+            return 0;
+        }
         Key kt;
-        this->loadKey(tid, kt);
+        this->loadKey(leaf, kt);
         if (k == kt) {
-            return tid;
+            return leaf;
         }
         return 0;
     }
 
+    void Tree::deleteKeyLeaves(const N *node) {
+        if (leafType == LeafType::ExternalKey) {
+            return;
+        }
+        if (N::isLeaf(node)) {
+            operator delete(reinterpret_cast<KeyLeaf *>(N::getLeaf(node)));
+            return;
+        }
+        std::tuple<uint8_t, N *> children[256];
+        uint32_t childrenCount = 0;
+        N::getChildren(node, 0u, 255u, children, childrenCount);
+        for (uint32_t i = 0; i < childrenCount; ++i) {
+            deleteKeyLeaves(std::get<1>(children[i]));
+        }
+    }
+
     void Tree::insert(const Key &k, TID tid) {
+        insertLeaf(k, N::setLeaf(makeLeaf(leafType, k, tid)));
+    }
+
+    void Tree::insertValue(const Key &k, const void *value) {
+        insertLeaf(k, N::setLeaf(reinterpret_cast<TID>(KeyLeaf::create(k, value, valueSize))));
+    }
+
+    void Tree::insertLeaf(const Key &k, N *leaf) {
         N *node = nullptr;
         N *nextNode = root;
         N *parentNode = nullptr;
@@ -288,23 +322,29 @@ namespace ART_unsynchronized {
 
             uint8_t nonMatchingKey;
             Prefix remainingPrefix;
-            switch (checkPrefixPessimistic(node, k, nextLevel, nonMatchingKey, remainingPrefix,
-                                                           this->loadKey)) { // increases level
+            switch (checkPrefixPessimistic(node, k, nextLevel, nonMatchingKey, remainingPrefix)) { // increases level
                 case CheckPrefixPessimisticResult::NoMatch: {
                     assert(nextLevel < k.getKeyLen()); //prevent duplicate key
                     // 1) Create new node which will be parent of node, Set common prefix, level to this node
                     auto newNode = new N4(node->getPrefix(), nextLevel - level);
+                    if (prefixType == PrefixType::Full) {
+                        newNode->storePrefixTail(&k[level]);
+                    }
 
                     // 2)  add node and (tid, *k) as children
-                    newNode->insert(k[nextLevel], N::setLeaf(tid));
+                    newNode->insert(k[nextLevel], leaf);
                     newNode->insert(nonMatchingKey, node);
 
                     // 3) update parentNode to point to the new node
                     N::change(parentNode, parentKey, newNode);
 
                     // 4) update prefix of node
-                    node->setPrefix(remainingPrefix,
-                                    node->getPrefixLength() - ((nextLevel - level) + 1));
+                    if (prefixType == PrefixType::Full) {
+                        operator delete(node->cutPrefix((nextLevel - level) + 1));
+                    } else {
+                        node->setPrefix(remainingPrefix,
+                                        node->getPrefixLength() - ((nextLevel - level) + 1));
+                    }
 
                     return;
                 }
@@ -317,12 +357,12 @@ namespace ART_unsynchronized {
             nextNode = N::getChild(nodeKey, node);
 
             if (nextNode == nullptr) {
-                N::insertA(node, parentNode, parentKey, nodeKey, N::setLeaf(tid));
+                N::insertA(node, parentNode, parentKey, nodeKey, leaf);
                 return;
             }
             if (N::isLeaf(nextNode)) {
                 Key key;
-                loadKey(N::getLeaf(nextNode), key);
+                loadLeafKey(N::getLeaf(nextNode), key);
 
                 level++;
                 assert(level < key.getKeyLen()); //prevent inserting when prefix of key exists already
@@ -332,7 +372,10 @@ namespace ART_unsynchronized {
                 }
 
                 auto n4 = new N4(&k[level], prefixLength);
-                n4->insert(k[level + prefixLength], N::setLeaf(tid));
+                if (prefixType == PrefixType::Full) {
+                    n4->storePrefixTail(&k[level]);
+                }
+                n4->insert(k[level + prefixLength], leaf);
                 n4->insert(key[level + prefixLength], nextNode);
                 N::change(node, k[level - 1], n4);
                 return;
@@ -342,6 +385,69 @@ namespace ART_unsynchronized {
         }
     }
 
+    namespace {
+        using namespace ART::BulkLoad;
+
+        N *buildSubtree(const Key keys[], const TID tids[], std::size_t begin, std::size_t end, uint32_t level,
+                        PrefixType prefixType, LeafType leafType);
+
+        template<class NODE>
+        N *buildNode(const Key keys[], const TID tids[], std::size_t begin, std::size_t end, uint32_t level,
+                     uint32_t prefixLength, PrefixType prefixType, LeafType leafType) {
+            uint32_t nodeLevel = level + prefixLength;
+            auto node = new NODE(&keys[begin][level], prefixLength);
+            if (prefixType == PrefixType::Full) {
+                node->storePrefixTail(&keys[begin][level]);
+            }
+            for (std::size_t i = begin; i < end;) {
+                std::size_t j = groupEnd(keys, i, end, nodeLevel);
+                node->insert(keys[i][nodeLevel], buildSubtree(keys, tids, i, j, nodeLevel + 1, prefixType, leafType));
+                i = j;
+            }
+            return node;
+        }
+
+        /**
+         * builds the subtree of the sorted range [begin, end) whose keys share the bytes before level, every node is
+         * allocated with the type fitting its final number of children
+         */
+        N *buildSubtree(const Key keys[], const TID tids[], std::size_t begin, std::size_t end, uint32_t level,
+                        PrefixType prefixType, LeafType leafType) {
+            if (end - begin == 1) {
+                return N::setLeaf(makeLeaf(leafType, keys[begin], tids[begin]));
+            }
+            uint32_t prefixLength = commonPrefixLength(keys, begin, end, level);
+            if (level + prefixLength == keys[begin].getKeyLen()) {
+                // all keys are the same, the first one wins
+                return N::setLeaf(makeLeaf(leafType, keys[begin], tids[begin]));
+            }
+            unsigned children = groupCount(keys, begin, end, level + prefixLength);
+            if (children <= 4) {
+                return buildNode<N4>(keys, tids, begin, end, level, prefixLength, prefixType, leafType);
+            } else if (children <= 16) {
+                return buildNode<N16>(keys, tids, begin, end, level, prefixLength, prefixType, leafType);
+            } else if (children <= 48) {
+                return buildNode<N48>(keys, tids, begin, end, level, prefixLength, prefixType, leafType);
+            }
+            return buildNode<N256>(keys, tids, begin, end, level, prefixLength, prefixType, leafType);
+        }
+    }
+
+    void Tree::bulkLoad(const Key keys[], const TID tids[], std::size_t n) {
+        for (std::size_t i = 0; i < n;) {
+            std::size_t j = groupEnd(keys, i, n, 0);
+            if (N::getChild(keys[i][0], root) == nullptr) {
+                static_cast<N256 *>(root)->insert(keys[i][0], buildSubtree(keys, tids, i, j, 1, prefixType, leafType));
+            } else {
+                // the subtree exists already
+                for (; i < j; ++i) {
+                    insert(keys[i], tids[i]);
+                }
+            }
+            i = j;
+        }
+    }
+
     void Tree::remove(const Key &k, TID tid) {
         N *node = nullptr;
         N *nextNode = root;
@@ -368,7 +474,9 @@ namespace ART_unsynchronized {
                         return;
                     }
                     if (N::isLeaf(nextNode)) {
-                        if (N::getLeaf(nextNode) != tid) {
+                        // the leaves of a ValueTree are removed by key alone
+                        if (valueSize == 0 ? getLeafTid(N::getLeaf(nextNode)) != tid
+                                           : checkKey(N::getLeaf(nextNode), k) == 0) {
                             return;
                         }
                         assert(parentNode == nullptr || node->getCount() != 1);
@@ -382,17 +490,18 @@ namespace ART_unsynchronized {
                                 //N::remove(node, k[level]); not necessary
                                 N::change(parentNode, parentKey, secondNodeN);
 
-                                delete node;
+                                N::deleteNode(node);
                             } else {
                                 //N::remove(node, k[level]); not necessary
                                 N::change(parentNode, parentKey, secondNodeN);
-                                secondNodeN->addPrefixBefore(node, secondNodeK);
+                                operator delete(secondNodeN->addPrefixBefore(node, secondNodeK));
 
-                                delete node;
+                                N::deleteNode(node);
                             }
                         } else {
                             N::removeA(node, k[level], parentNode, parentKey);
                         }
+                        deleteKeyLeaves(nextNode);
                         return;
                     }
                     level++;
@@ -423,21 +532,27 @@ namespace ART_unsynchronized {
 
     typename Tree::CheckPrefixPessimisticResult Tree::checkPrefixPessimistic(N *n, const Key &k, uint32_t &level,
                                                                         uint8_t &nonMatchingKey,
-                                                                        Prefix &nonMatchingPrefix,
-                                                                        LoadKeyFunction loadKey) {
+                                                                        Prefix &nonMatchingPrefix) const {
         if (n->hasPrefix()) {
             uint32_t prevLevel = level;
+            // bytes beyond the stored prefix come from the tail, or from the key of a leaf if there is none
+            const PrefixTail *tail = n->getPrefixTail();
             Key kt;
             for (uint32_t i = 0; i < n->getPrefixLength(); ++i) {
-                if (i == maxStoredPrefixLength) {
-                    loadKey(N::getAnyChildTid(n), kt);
+                if (i == maxStoredPrefixLength && tail == nullptr) {
+                    loadLeafKey(N::getAnyChildTid(n), kt);
                 }
-                uint8_t curKey = i >= maxStoredPrefixLength ? kt[level] : n->getPrefix()[i];
+                uint8_t curKey = i < maxStoredPrefixLength ? n->getPrefix()[i] :
+                                 tail != nullptr ? tail->getBytes()[i - maxStoredPrefixLength] : kt[level];
                 if (curKey != k[level]) {
                     nonMatchingKey = curKey;
-                    if (n->getPrefixLength() > maxStoredPrefixLength) {
+                    if (tail != nullptr) {
+                        for (uint32_t j = 0; j < std::min(n->getPrefixLength() - i - 1, maxStoredPrefixLength); ++j) {
+                            nonMatchingPrefix[j] = n->getPrefixByte(i + j + 1);
+                        }
+                    } else if (n->getPrefixLength() > maxStoredPrefixLength) {
                         if (i < maxStoredPrefixLength) {
-                            loadKey(N::getAnyChildTid(n), kt);
+                            loadLeafKey(N::getAnyChildTid(n), kt);
                         }
                         for (uint32_t j = 0; j < std::min((n->getPrefixLength() - (level - prevLevel) - 1),
                                                           maxStoredPrefixLength); ++j) {
@@ -456,17 +571,18 @@ namespace ART_unsynchronized {
         return CheckPrefixPessimisticResult::Match;
     }
 
-    typename Tree::PCCompareResults Tree::checkPrefixCompare(N *n, const Key &k, uint32_t &level,
-                                                        LoadKeyFunction loadKey) {
+    typename Tree::PCCompareResults Tree::checkPrefixCompare(N *n, const Key &k, uint32_t &level) const {
         if (n->hasPrefix()) {
+            const PrefixTail *tail = n->getPrefixTail();
             Key kt;
             for (uint32_t i = 0; i < n->getPrefixLength(); ++i) {
-                if (i == maxStoredPrefixLength) {
-                    loadKey(N::getAnyChildTid(n), kt);
+                if (i == maxStoredPrefixLength && tail == nullptr) {
+                    loadLeafKey(N::getAnyChildTid(n), kt);
                 }
                 uint8_t kLevel = (k.getKeyLen() > level) ? k[level] : 0;
 
-                uint8_t curKey = i >= maxStoredPrefixLength ? kt[level] : n->getPrefix()[i];
+                uint8_t curKey = i < maxStoredPrefixLength ? n->getPrefix()[i] :
+                                 tail != nullptr ? tail->getBytes()[i - maxStoredPrefixLength] : kt[level];
                 if (curKey < kLevel) {
                     return PCCompareResults::Smaller;
                 } else if (curKey > kLevel) {
@@ -478,19 +594,21 @@ namespace ART_unsynchronized {
         return PCCompareResults::Equal;
     }
 
-    typename Tree::PCEqualsResults Tree::checkPrefixEquals(N *n, uint32_t &level, const Key &start, const Key &end,
-                                                      LoadKeyFunction loadKey) {
+    typename Tree::PCEqualsResults Tree::checkPrefixEquals(N *n, uint32_t &level, const Key &start,
+                                                           const Key &end) const {
         if (n->hasPrefix()) {
             bool endMatches = true;
+            const PrefixTail *tail = n->getPrefixTail();
             Key kt;
             for (uint32_t i = 0; i < n->getPrefixLength(); ++i) {
-                if (i == maxStoredPrefixLength) {
-                    loadKey(N::getAnyChildTid(n), kt);
+                if (i == maxStoredPrefixLength && tail == nullptr) {
+                    loadLeafKey(N::getAnyChildTid(n), kt);
                 }
                 uint8_t startLevel = (start.getKeyLen() > level) ? start[level] : 0;
                 uint8_t endLevel = (end.getKeyLen() > level) ? end[level] : 0;
 
-                uint8_t curKey = i >= maxStoredPrefixLength ? kt[level] : n->getPrefix()[i];
+                uint8_t curKey = i < maxStoredPrefixLength ? n->getPrefix()[i] :
+                                 tail != nullptr ? tail->getBytes()[i - maxStoredPrefixLength] : kt[level];
                 if (curKey > startLevel && curKey < endLevel) {
                     return PCEqualsResults::Contained;
                 } else if (curKey < startLevel || curKey > endLevel) {
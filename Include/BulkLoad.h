@@ -0,0 +1,77 @@
+//
+// Key helpers shared by the bulk loads of all tree variants, they only look at the sorted keys and build nothing
+//
+
+#ifndef ART_BULKLOAD_H
+#define ART_BULKLOAD_H
+
+#include <stdint.h>
+#include <algorithm>
+#include "Key.h"
+
+namespace ART {
+    namespace BulkLoad {
+
+        // ranges with at least this many keys build the subtrees of their children in parallel
+        constexpr std::size_t parallelBuildThreshold = 1 << 14;
+
+        /**
+         * number of key bytes from level on which all keys of the sorted range [begin, end) share, these are the
+         * ones its first and last key share
+         */
+        inline uint32_t commonPrefixLength(const Key keys[], std::size_t begin, std::size_t end, uint32_t level) {
+            const Key &first = keys[begin], &last = keys[end - 1];
+            uint32_t length = 0;
+            while (level + length < std::min(first.getKeyLen(), last.getKeyLen()) &&
+                   first[level + length] == last[level + length]) {
+                length++;
+            }
+            return length;
+        }
+
+        /**
+         * end of the keys following begin which have the same byte at level, the byte does not decrease within the
+         * sorted range, the end is therefore found by galloping ahead and bisecting
+         */
+        inline std::size_t groupEnd(const Key keys[], std::size_t begin, std::size_t end, uint32_t level) {
+            uint8_t byte = keys[begin][level];
+            std::size_t low = begin + 1, high = begin + 1, step = 1;
+            while (high < end && keys[high][level] == byte) {
+                low = high + 1;
+                high = std::min(end, high + step);
+                step *= 2;
+            }
+            while (low < high) {
+                std::size_t mid = low + (high - low) / 2;
+                if (keys[mid][level] == byte) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+            return low;
+        }
+
+        // number of groups of keys with the same byte at level in the sorted range [begin, end)
+        inline unsigned groupCount(const Key keys[], std::size_t begin, std::size_t end, uint32_t level) {
+            unsigned count = 0;
+            for (std::size_t i = begin; i < end; i = groupEnd(keys, i, end, level)) {
+                count++;
+            }
+            return count;
+        }
+
+        // splits the sorted range [begin, end) into the groups of keys with the same byte at level
+        inline unsigned groupBounds(const Key keys[], std::size_t begin, std::size_t end, uint32_t level,
+                                    std::size_t bounds[257]) {
+            unsigned count = 0;
+            for (std::size_t i = begin; i < end; i = groupEnd(keys, i, end, level)) {
+                bounds[count++] = i;
+            }
+            bounds[count] = end;
+            return count;
+        }
+    }
+}
+
+#endif //ART_BULKLOAD_H
@@ -65,12 +65,25 @@ inline LabelDelete *DeletionList::head() {
     return headDeletionList;
 }
 
+inline void Epoche::deleteNodes(LabelDelete *label) {
+    if (reclaimer != nullptr) {
+        reclaimer->free(label->nodes.data(), label->nodesCount);
+        return;
+    }
+    for (std::size_t i = 0; i < label->nodesCount; ++i) {
+        operator delete(label->nodes[i]);
+    }
+}
+
 inline void Epoche::enterEpoche(ThreadInfo &epocheInfo) {
     unsigned long curEpoche = currentEpoche.load(std::memory_order_relaxed);
     epocheInfo.getDeletionList().localEpoche.store(curEpoche, std::memory_order_release);
 }
 
 inline void Epoche::markNodeForDeletion(void *n, ThreadInfo &epocheInfo) {
+    if (reclaimer != nullptr) {
+        reclaimer->retire(n);
+    }
     epocheInfo.getDeletionList().add(n, currentEpoche.load());
     epocheInfo.getDeletionList().thresholdCounter++;
 }
@@ -100,9 +113,7 @@ inline void Epoche::exitEpocheAndCleanup(ThreadInfo &epocheInfo) {
             next = cur->next;
 
             if (cur->epoche < oldestEpoche) {
-                for (std::size_t i = 0; i < cur->nodesCount; ++i) {
-                    operator delete(cur->nodes[i]);
-                }
+                deleteNodes(cur);
                 deletionList.remove(cur, prev);
             } else {
                 prev = cur;
@@ -127,9 +138,7 @@ inline Epoche::~Epoche() {
             next = cur->next;
 
             assert(cur->epoche < oldestEpoche);
-            for (std::size_t i = 0; i < cur->nodesCount; ++i) {
-                operator delete(cur->nodes[i]);
-            }
+            deleteNodes(cur);
             d.remove(cur, prev);
             cur = next;
         }
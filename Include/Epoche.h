@@ -60,6 +60,20 @@ namespace ART {
         Epoche & getEpoche() const;
     };
 
+    /**
+     * Reclamation of nodes which are not allocated with new, e.g. persistent ones. retire is called when a node is
+     * marked for deletion and can make the pending deletion durable, free releases a batch of nodes once no thread
+     * can reach them anymore.
+     */
+    class NodeReclaimer {
+    public:
+        virtual ~NodeReclaimer() = default;
+
+        virtual void retire(void *n) = 0;
+
+        virtual void free(void *const nodes[], std::size_t count) = 0;
+    };
+
     class Epoche {
         friend class ThreadInfo;
         std::atomic<uint64_t> currentEpoche{0};
@@ -68,9 +82,13 @@ namespace ART {
 
         size_t startGCThreshhold;
 
+        NodeReclaimer *reclaimer;
+
+        void deleteNodes(LabelDelete *label);
 
     public:
-        Epoche(size_t startGCThreshhold) : startGCThreshhold(startGCThreshhold) { }
+        Epoche(size_t startGCThreshhold, NodeReclaimer *reclaimer = nullptr)
+                : startGCThreshhold(startGCThreshhold), reclaimer(reclaimer) { }
 
         ~Epoche();
 
@@ -0,0 +1,170 @@
+//
+// Common front end of the tree variants, selected by synchronization and storage policy at compile time
+//
+
+#ifndef ART_INDEX_H
+#define ART_INDEX_H
+
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+#include "Key.h"
+
+using TID = uint64_t;
+
+namespace ART {
+
+    // synchronization policies
+    struct Unsynchronized {};
+    struct OptimisticLockCoupling {};
+    struct ROWEX {};
+    struct LockCoupling {};
+
+    // storage policies
+    struct DRAM {};
+    struct PMem {};
+
+    /**
+     * ThreadInfo of the policies which need no per-thread state
+     */
+    struct NoThreadInfo {};
+
+    /**
+     * Pool of the policies whose trees are not passed one on every call
+     */
+    struct NoPool {};
+
+    /**
+     * What Index needs to know about the variant implementing a combination of policies, specialized by the Tree.h
+     * of the variant:
+     *
+     *   Tree        the tree of the variant
+     *   ThreadInfo  passed as last argument of every operation, NoThreadInfo if the variant has none
+     *   Pool        passed as first argument of every operation and of the constructor, NoPool if it is not passed
+     *
+     *   Index<Unsynchronized, DRAM>          ART_unsynchronized::Tree
+     *   Index<OptimisticLockCoupling, DRAM>  ART_OLC::Tree
+     *   Index<ROWEX, DRAM>                   ART_ROWEX::Tree
+     *   Index<LockCoupling, PMem>            ART_LC::Tree, constructed with its pool
+     */
+    template<class SyncPolicy, class StoragePolicy>
+    struct IndexTraits;
+
+    /**
+     * Tree with the same interface for every combination of policies. Index is a front end only: its members
+     * forward inline to the variant, which keep their own nodes, lock protocols and tree code, a fix to one of them
+     * still has to be made in the others.
+     */
+    template<class SyncPolicy, class StoragePolicy = DRAM>
+    class Index {
+        using Traits = IndexTraits<SyncPolicy, StoragePolicy>;
+
+    public:
+        using Tree = typename Traits::Tree;
+
+        using ThreadInfo = typename Traits::ThreadInfo;
+
+        using Pool = typename Traits::Pool;
+
+    private:
+        using PassesPool = std::integral_constant<bool, !std::is_same<Pool, NoPool>::value>;
+
+        using HasThreadInfo = std::integral_constant<bool, !std::is_same<ThreadInfo, NoThreadInfo>::value>;
+
+        // the pool given to the constructor, nullptr if the variant takes none
+        Pool *pop;
+
+        Tree tree;
+
+        template<class First, class... Rest>
+        static Pool *poolOf(std::true_type, First &first, Rest &...) {
+            return &first;
+        }
+
+        template<class... Args>
+        static Pool *poolOf(std::false_type, Args &...) {
+            return nullptr;
+        }
+
+        template<class F, class... Args>
+        decltype(auto) withPool(std::true_type, F &&f, Args &&... args) const {
+            return f(*pop, std::forward<Args>(args)...);
+        }
+
+        template<class F, class... Args>
+        decltype(auto) withPool(std::false_type, F &&f, Args &&... args) const {
+            return f(std::forward<Args>(args)...);
+        }
+
+        template<class F, class... Args>
+        decltype(auto) call(std::true_type, F &&f, ThreadInfo &threadInfo, Args &&... args) const {
+            return withPool(PassesPool(), f, std::forward<Args>(args)..., threadInfo);
+        }
+
+        template<class F, class... Args>
+        decltype(auto) call(std::false_type, F &&f, ThreadInfo &, Args &&... args) const {
+            return withPool(PassesPool(), f, std::forward<Args>(args)...);
+        }
+
+        /**
+         * calls f with the arguments of an operation of the variant: the pool if it takes one, args and the
+         * ThreadInfo if it has one
+         */
+        template<class F, class... Args>
+        decltype(auto) call(F &&f, ThreadInfo &threadInfo, Args &&... args) const {
+            return call(HasThreadInfo(), f, threadInfo, std::forward<Args>(args)...);
+        }
+
+        ThreadInfo getThreadInfo(std::true_type) {
+            return tree.getThreadInfo();
+        }
+
+        ThreadInfo getThreadInfo(std::false_type) {
+            return ThreadInfo();
+        }
+
+    public:
+        /**
+         * takes the arguments of the constructor of Tree, an Index itself is not one of them
+         */
+        template<class... Args,
+                 class = typename std::enable_if<std::is_constructible<Tree, Args...>::value>::type>
+        explicit Index(Args &&... args) : pop(poolOf(PassesPool(), args...)), tree(std::forward<Args>(args)...) { }
+
+        Index(const Index &) = delete;
+
+        Tree &getTree() {
+            return tree;
+        }
+
+        ThreadInfo getThreadInfo() {
+            return getThreadInfo(HasThreadInfo());
+        }
+
+        TID lookup(const Key &k, ThreadInfo &threadInfo) const {
+            return call([this](auto &&... args) { return tree.lookup(std::forward<decltype(args)>(args)...); },
+                        threadInfo, k);
+        }
+
+        bool lookupRange(const Key &start, const Key &end, Key &continueKey, TID result[], std::size_t resultLen,
+                         std::size_t &resultCount, ThreadInfo &threadInfo) const {
+            return call([this](auto &&... args) { return tree.lookupRange(std::forward<decltype(args)>(args)...); },
+                        threadInfo, start, end, continueKey, result, resultLen, resultCount);
+        }
+
+        void insert(const Key &k, TID tid, ThreadInfo &threadInfo) {
+            call([this](auto &&... args) { tree.insert(std::forward<decltype(args)>(args)...); }, threadInfo, k, tid);
+        }
+
+        void bulkLoad(const Key keys[], const TID tids[], std::size_t n, ThreadInfo &threadInfo) {
+            call([this](auto &&... args) { tree.bulkLoad(std::forward<decltype(args)>(args)...); }, threadInfo, keys,
+                 tids, n);
+        }
+
+        void remove(const Key &k, TID tid, ThreadInfo &threadInfo) {
+            call([this](auto &&... args) { tree.remove(std::forward<decltype(args)>(args)...); }, threadInfo, k, tid);
+        }
+    };
+}
+
+#endif //ART_INDEX_H
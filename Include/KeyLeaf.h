@@ -0,0 +1,111 @@
+//
+// Leaves with embedded keys, shared by the DRAM tree variants
+//
+
+#ifndef ART_KEYLEAF_H
+#define ART_KEYLEAF_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include "Key.h"
+
+using TID = uint64_t;
+
+namespace ART {
+
+    /**
+     * what the tree stores as leaf: the user's TID, whose key is read back with loadKey, or a pointer to a KeyLeaf
+     * holding TID and key bytes
+     */
+    enum class LeafType : uint8_t {
+        ExternalKey,
+        EmbeddedKey
+    };
+
+    /**
+     * leaf of a tree in LeafType::EmbeddedKey mode, allocated with operator new and never changed. Key checks and
+     * prefix reconstruction read the key from here instead of calling loadKey. How a removed KeyLeaf is freed is up to
+     * the tree, readers of the synchronized variants may still hold it.
+     */
+    struct KeyLeaf {
+        // the TID, or the value of a ValueTree if it is not larger than a TID
+        TID tid;
+        uint32_t keyLen;
+        uint8_t key[];
+
+        // larger values of a ValueTree are stored behind the key, aligned for any type
+        static std::size_t valueOffset(uint32_t keyLen) {
+            return (offsetof(KeyLeaf, key) + keyLen + alignof(std::max_align_t) - 1) &
+                   ~(alignof(std::max_align_t) - 1);
+        }
+
+        uint8_t *getValue() {
+            return reinterpret_cast<uint8_t *>(this) + valueOffset(keyLen);
+        }
+
+        const uint8_t *getValue() const {
+            return reinterpret_cast<const uint8_t *>(this) + valueOffset(keyLen);
+        }
+
+        // copies the value of a leaf of a ValueTree
+        void loadValue(void *value, uint32_t valueSize) const {
+            memcpy(value, valueSize <= sizeof(TID) ? static_cast<const void *>(&tid) : getValue(), valueSize);
+        }
+
+        bool hasKey(const Key &k) const {
+            return keyLen == k.getKeyLen() && memcmp(key, &k[0], keyLen) == 0;
+        }
+
+        void loadKey(Key &k) const {
+            k.set(reinterpret_cast<const char *>(key), keyLen);
+        }
+
+        static KeyLeaf *create(const Key &k, TID tid) {
+            auto leaf = static_cast<KeyLeaf *>(operator new(sizeof(KeyLeaf) + k.getKeyLen()));
+            leaf->tid = tid;
+            leaf->keyLen = k.getKeyLen();
+            memcpy(leaf->key, &k[0], k.getKeyLen());
+            return leaf;
+        }
+
+        static KeyLeaf *create(const Key &k, const void *value, uint32_t valueSize) {
+            if (valueSize <= sizeof(TID)) {
+                TID tid = 0;
+                memcpy(&tid, value, valueSize);
+                return create(k, tid);
+            }
+            auto leaf = static_cast<KeyLeaf *>(operator new(valueOffset(k.getKeyLen()) + valueSize));
+            leaf->tid = 0;
+            leaf->keyLen = k.getKeyLen();
+            memcpy(leaf->key, &k[0], k.getKeyLen());
+            memcpy(leaf->getValue(), value, valueSize);
+            return leaf;
+        }
+    };
+
+    // what a tree stores as leaf for (k, tid), a new KeyLeaf in EmbeddedKey mode
+    inline TID makeLeaf(LeafType leafType, const Key &k, TID tid) {
+        if (leafType == LeafType::ExternalKey) {
+            return tid;
+        }
+        return reinterpret_cast<TID>(KeyLeaf::create(k, tid));
+    }
+
+    // TID of a leaf stored in a tree as handed to the user
+    inline TID getLeafTid(LeafType leafType, TID leaf) {
+        return leafType == LeafType::EmbeddedKey ? reinterpret_cast<const KeyLeaf *>(leaf)->tid : leaf;
+    }
+
+    // key of a leaf stored in a tree, from its KeyLeaf or loaded with loadKey
+    inline void loadLeafKey(LeafType leafType, void (*loadKey)(TID tid, Key &key), TID leaf, Key &key) {
+        if (leafType == LeafType::EmbeddedKey) {
+            reinterpret_cast<const KeyLeaf *>(leaf)->loadKey(key);
+        } else {
+            loadKey(leaf, key);
+        }
+    }
+}
+
+#endif //ART_KEYLEAF_H
@@ -0,0 +1,114 @@
+#include "Include/Flusher.h"
+
+namespace ART_LC {
+
+    std::atomic<uint64_t> Flusher::nextId{1};
+
+    thread_local Flusher *Flusher::current = nullptr;
+
+    thread_local uint64_t Flusher::cachedId = 0;
+
+    thread_local Flusher::DirtyLines *Flusher::cachedLines = nullptr;
+
+    Flusher::Flusher(pool_base &pop, uint64_t &completedRounds, std::chrono::milliseconds interval)
+            : pop(pop), completedRounds(completedRounds), id(nextId.fetch_add(1)), interval(interval), thread(&Flusher::run, this) {
+    }
+
+    Flusher::~Flusher() {
+        {
+            std::lock_guard<std::mutex> guard(stopMutex);
+            stopped = true;
+        }
+        stopCondition.notify_one();
+        thread.join();
+        sync();
+    }
+
+    void Flusher::run() {
+        std::unique_lock<std::mutex> lock(stopMutex);
+        while (!stopped) {
+            stopCondition.wait_for(lock, interval);
+            if (stopped) {
+                break;
+            }
+            lock.unlock();
+            sync();
+            lock.lock();
+        }
+    }
+
+    Flusher::DirtyLines &Flusher::localLines() {
+        if (cachedId == id) {
+            return *cachedLines;
+        }
+        std::lock_guard<std::mutex> guard(buffersMutex);
+        std::unique_ptr<DirtyLines> &lines = buffers[std::this_thread::get_id()];
+        if (lines == nullptr) {
+            lines.reset(new DirtyLines());
+        }
+        cachedId = id;
+        cachedLines = lines.get();
+        return *lines;
+    }
+
+    void Flusher::flushLines(const std::vector<uintptr_t> &lines) {
+        for (uintptr_t line : lines) {
+            flush(pop, reinterpret_cast<const void *>(line), 64);
+        }
+    }
+
+    void Flusher::defer(const void *addr, std::size_t len) {
+        DirtyLines &dirty = localLines();
+        uintptr_t line = reinterpret_cast<uintptr_t>(addr) & ~static_cast<uintptr_t>(63);
+        uintptr_t end = reinterpret_cast<uintptr_t>(addr) + len;
+        bool full;
+        {
+            std::lock_guard<std::mutex> guard(dirty.mutex);
+            for (; line < end; line += 64) {
+                // consecutive updates of a node mostly hit the same line
+                if (dirty.lines.empty() || dirty.lines.back() != line) {
+                    dirty.lines.push_back(line);
+                }
+            }
+            full = dirty.lines.size() >= maxDeferredLines;
+        }
+        if (full) {
+            syncLocal();
+        }
+    }
+
+    void Flusher::syncLocal() {
+        // lines taken by a running round are only durable once it fenced them
+        std::lock_guard<std::mutex> round(roundMutex);
+        DirtyLines &dirty = localLines();
+        std::vector<uintptr_t> lines;
+        {
+            std::lock_guard<std::mutex> guard(dirty.mutex);
+            lines.swap(dirty.lines);
+        }
+        flushLines(lines);
+        fence(pop);
+    }
+
+    void Flusher::sync() {
+        std::lock_guard<std::mutex> round(roundMutex);
+        std::vector<uintptr_t> lines;
+        {
+            std::lock_guard<std::mutex> guard(buffersMutex);
+            for (auto &buffer : buffers) {
+                DirtyLines &dirty = *buffer.second;
+                std::lock_guard<std::mutex> linesGuard(dirty.mutex);
+                lines.insert(lines.end(), dirty.lines.begin(), dirty.lines.end());
+                dirty.lines.clear();
+            }
+        }
+        if (lines.empty()) {
+            return;
+        }
+        flushLines(lines);
+        fence(pop);
+        // the count only becomes durable after everything the round wrote back
+        completedRounds++;
+        persist(pop, &completedRounds, sizeof(uint64_t));
+    }
+}
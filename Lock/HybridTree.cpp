@@ -0,0 +1,183 @@
+#include <assert.h>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <vector>
+#include "tbb/parallel_for.h"
+#include "tbb/parallel_sort.h"
+
+#include "Include/HybridTree.h"
+
+
+namespace ART_LC {
+
+    namespace {
+        struct LeafArgs {
+            const Key &k;
+            TID tid;
+        };
+
+        // orders leaves by key, a key is smaller than the keys it is a prefix of
+        bool keyLess(const PersistentLeaf *a, const PersistentLeaf *b) {
+            int c = memcmp(a->key, b->key, std::min(a->keyLen, b->keyLen));
+            return c < 0 || (c == 0 && a->keyLen < b->keyLen);
+        }
+
+        bool keyEquals(const PersistentLeaf *a, const PersistentLeaf *b) {
+            return a->keyLen == b->keyLen && memcmp(a->key, b->key, a->keyLen) == 0;
+        }
+    }
+
+    void HybridTree::LeafReclaimer::free(void *const nodes[], std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i) {
+            PMEMoid oid = pmemobj_oid(nodes[i]);
+            pmemobj_free(&oid);
+        }
+    }
+
+    HybridTree::HybridTree(pool_base &pop) : pop(pop), tree(loadLeafKey), leafReclaimer(pop) {
+        rebuild();
+    }
+
+    PersistentLeaf *HybridTree::getLeaf(TID leaf) {
+        return reinterpret_cast<PersistentLeaf *>(leaf);
+    }
+
+    void HybridTree::loadLeafKey(TID leaf, Key &key) {
+        const PersistentLeaf *l = getLeaf(leaf);
+        key.set(reinterpret_cast<const char *>(l->key), l->keyLen);
+    }
+
+    int HybridTree::constructLeaf(PMEMobjpool *pop, void *ptr, void *arg) {
+        auto args = static_cast<LeafArgs *>(arg);
+        auto leaf = static_cast<PersistentLeaf *>(ptr);
+        leaf->tid = args->tid;
+        leaf->removed = 0;
+        leaf->keyLen = args->k.getKeyLen();
+        memcpy(leaf->key, &args->k[0], leaf->keyLen);
+        pool_base p(pop);
+        persist(p, leaf, sizeof(PersistentLeaf) + leaf->keyLen);
+        return 0;
+    }
+
+    void HybridTree::rebuild() {
+        auto starttime = std::chrono::system_clock::now();
+
+        std::vector<PersistentLeaf *> leaves;
+        std::vector<PMEMoid> removedLeaves;
+        for (PMEMoid oid = pmemobj_first(pop.handle()); !OID_IS_NULL(oid); oid = pmemobj_next(oid)) {
+            if (pmemobj_type_num(oid) != leafTypeNum) {
+                continue;
+            }
+            auto leaf = static_cast<PersistentLeaf *>(pmemobj_direct(oid));
+            if (leaf->removed) {
+                removedLeaves.push_back(oid);
+            } else {
+                leaves.push_back(leaf);
+            }
+        }
+
+        // the inner tree takes every key once, further leaves of a key were left by inserting it twice
+        tbb::parallel_sort(leaves.begin(), leaves.end(), keyLess);
+        std::size_t unique = 0;
+        for (std::size_t i = 0; i < leaves.size(); ++i) {
+            if (unique > 0 && keyEquals(leaves[unique - 1], leaves[i])) {
+                removedLeaves.push_back(pmemobj_oid(leaves[i]));
+            } else {
+                leaves[unique] = leaves[i];
+                unique++;
+            }
+        }
+        leaves.resize(unique);
+
+        // nobody can reach these leaves anymore, a crash before they were freed left them in the pool
+        for (PMEMoid &oid : removedLeaves) {
+            pmemobj_free(&oid);
+        }
+
+        std::unique_ptr<Key[]> keys(new Key[leaves.size()]);
+        std::vector<TID> tids(leaves.size());
+        tbb::parallel_for(tbb::blocked_range<std::size_t>(0, leaves.size()), [&](const tbb::blocked_range<std::size_t> &range) {
+            for (std::size_t i = range.begin(); i != range.end(); i++) {
+                loadLeafKey(reinterpret_cast<TID>(leaves[i]), keys[i]);
+                tids[i] = reinterpret_cast<TID>(leaves[i]);
+            }
+        });
+        auto t = tree.getThreadInfo();
+        tree.bulkLoad(keys.get(), tids.data(), leaves.size(), t);
+
+        rebuildLeafCount = leaves.size();
+        rebuildTime = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+    }
+
+    HybridTree::ThreadInfo HybridTree::getThreadInfo() {
+        return ThreadInfo(tree.getThreadInfo(), ART::ThreadInfo(leafEpoche));
+    }
+
+    TID HybridTree::lookup(const Key &k, ThreadInfo &threadEpocheInfo) const {
+        EpocheGuardReadonly epocheGuard(threadEpocheInfo.leafInfo);
+        TID leaf = tree.lookup(k, threadEpocheInfo.treeInfo);
+        if (leaf == 0 || getLeaf(leaf)->removed) {
+            return 0;
+        }
+        return getLeaf(leaf)->tid;
+    }
+
+    bool HybridTree::lookupRange(const Key &start, const Key &end, Key &continueKey, TID result[],
+                                 std::size_t resultSize, std::size_t &resultsFound,
+                                 ThreadInfo &threadEpocheInfo) const {
+        EpocheGuardReadonly epocheGuard(threadEpocheInfo.leafInfo);
+        bool more = tree.lookupRange(start, end, continueKey, result, resultSize, resultsFound,
+                                     threadEpocheInfo.treeInfo);
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < resultsFound; ++i) {
+            const PersistentLeaf *leaf = getLeaf(result[i]);
+            if (!leaf->removed) {
+                result[count] = leaf->tid;
+                count++;
+            }
+        }
+        resultsFound = count;
+        return more;
+    }
+
+    void HybridTree::insert(const Key &k, TID tid, ThreadInfo &epocheInfo) {
+        // the insert reads the keys of leaves in the tree, which a concurrent remove may retire
+        EpocheGuard epocheGuard(epocheInfo.leafInfo);
+        // the key is durable once the leaf is allocated, the inner nodes are only its volatile index
+        LeafArgs args{k, tid};
+        PMEMoid oid;
+        if (pmemobj_alloc(pop.handle(), &oid, sizeof(PersistentLeaf) + k.getKeyLen(), leafTypeNum,
+                          constructLeaf, &args) != 0) {
+            throw std::bad_alloc();
+        }
+        tree.insert(k, reinterpret_cast<TID>(pmemobj_direct(oid)), epocheInfo.treeInfo);
+    }
+
+    void HybridTree::remove(const Key &k, TID tid, ThreadInfo &epocheInfo) {
+        EpocheGuard epocheGuard(epocheInfo.leafInfo);
+        TID leaf = tree.lookup(k, epocheInfo.treeInfo);
+        if (leaf == 0 || getLeaf(leaf)->tid != tid) {
+            return;
+        }
+        // only the remove which sets the flag unlinks and retires the leaf
+        PersistentLeaf *l = getLeaf(leaf);
+        uint64_t removed = 0;
+        if (!__atomic_compare_exchange_n(&l->removed, &removed, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return;
+        }
+        persist(pop, &l->removed, sizeof(uint64_t));
+        tree.remove(k, leaf, epocheInfo.treeInfo);
+        // concurrent readers may still hold the leaf
+        leafEpoche.markNodeForDeletion(l, epocheInfo.leafInfo);
+    }
+
+    std::size_t HybridTree::getRebuildLeafCount() const {
+        return rebuildLeafCount;
+    }
+
+    std::chrono::microseconds HybridTree::getRebuildTime() const {
+        return rebuildTime;
+    }
+}
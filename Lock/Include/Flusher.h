@@ -0,0 +1,158 @@
+//
+// Background flusher of the relaxed durability mode of ART_LC
+//
+
+#ifndef ART_LOCK_COUPLING_FLUSHER_H
+#define ART_LOCK_COUPLING_FLUSHER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Persist.h"
+
+namespace ART_LC {
+
+    /**
+     * Makes published updates durable in the background. Inside a Scope the flush and fence which complete an
+     * update after its publishing store (flushPublished, fencePublished) only record the dirty cache lines of the
+     * calling thread, a background thread writes them back every interval with one fence per round and then
+     * persists the number of completed rounds: all updates deferred before a round started are durable once the
+     * count it writes is.
+     *
+     * Entries are still persisted before they are published, a crash therefore never leaves a pointer to memory
+     * which was not written back. It loses updates of the current round only, but not a prefix of them: a
+     * deferred line can be evicted before the round writes it back, so a later update may survive an earlier one.
+     * Nothing is recorded to roll them back to a round boundary.
+     */
+    class Flusher {
+        struct DirtyLines {
+            std::mutex mutex;
+            std::vector<uintptr_t> lines;
+        };
+
+        // a thread writes back its own lines once it deferred that many, bounds memory and the loss window
+        static constexpr std::size_t maxDeferredLines = 1 << 14;
+
+        static std::atomic<uint64_t> nextId;
+
+        static thread_local Flusher *current;
+
+        // lines of the calling thread in the flusher with id cachedId
+        static thread_local uint64_t cachedId;
+        static thread_local DirtyLines *cachedLines;
+
+        pool_base pop;
+
+        // persistent number of completed rounds
+        uint64_t &completedRounds;
+
+        const uint64_t id;
+
+        const std::chrono::milliseconds interval;
+
+        std::mutex buffersMutex;
+        std::map<std::thread::id, std::unique_ptr<DirtyLines>> buffers;
+
+        // a round holds it until its lines are fenced
+        std::mutex roundMutex;
+
+        std::mutex stopMutex;
+        std::condition_variable stopCondition;
+        bool stopped = false;
+
+        std::thread thread;
+
+        DirtyLines &localLines();
+
+        void flushLines(const std::vector<uintptr_t> &lines);
+
+        void run();
+
+    public:
+        Flusher(pool_base &pop, uint64_t &completedRounds, std::chrono::milliseconds interval);
+
+        Flusher(const Flusher &) = delete;
+
+        /**
+         * stops the background thread after a last round
+         */
+        ~Flusher();
+
+        void defer(const void *addr, std::size_t len);
+
+        /**
+         * writes back the lines deferred by the calling thread, they are durable on return
+         */
+        void syncLocal();
+
+        /**
+         * one round: every line deferred before the call is durable on return, the round count is advanced if there
+         * was anything to write back
+         */
+        void sync();
+
+        static Flusher *getCurrent() {
+            return current;
+        }
+
+        /**
+         * defers the completing flushes of the calling thread to flusher while it exists, nullptr is strict
+         * durability
+         */
+        class Scope {
+            Flusher *previous;
+
+        public:
+            explicit Scope(Flusher *flusher) : previous(current) {
+                current = flusher;
+            }
+
+            Scope(const Scope &) = delete;
+
+            ~Scope() {
+                current = previous;
+            }
+        };
+    };
+
+    /**
+     * flushes an update which is already published, only the ordering of the publishing store matters for
+     * consistency, the write back itself can be deferred
+     */
+    inline void flushPublished(pool_base &pop, const void *addr, std::size_t len) {
+        Flusher *flusher = Flusher::getCurrent();
+        if (flusher != nullptr) {
+            flusher->defer(addr, len);
+        } else {
+            flush(pop, addr, len);
+        }
+    }
+
+    inline void fencePublished(pool_base &pop) {
+        if (Flusher::getCurrent() == nullptr) {
+            fence(pop);
+        }
+    }
+
+    inline void persistPublished(pool_base &pop, const void *addr, std::size_t len) {
+        flushPublished(pop, addr, len);
+        fencePublished(pop);
+    }
+
+    /**
+     * has to be called before memory which was unlinked by a deferred update is reused
+     */
+    inline void persistDeferred() {
+        Flusher *flusher = Flusher::getCurrent();
+        if (flusher != nullptr) {
+            flusher->syncLocal();
+        }
+    }
+}
+#endif //ART_LOCK_COUPLING_FLUSHER_H
@@ -0,0 +1,116 @@
+//
+// Hybrid mode of ART_LC: volatile inner nodes over persistent leaves
+//
+
+#ifndef ART_LOCK_COUPLING_HYBRIDTREE_H
+#define ART_LOCK_COUPLING_HYBRIDTREE_H
+
+#include <stdint.h>
+#include <chrono>
+#include <libpmemobj.h>
+#include <libpmemobj++/pool.hpp>
+#include "../../OptimisticLockCoupling/Include/Tree.h"
+#include "Persist.h"
+
+using namespace ART;
+
+namespace ART_LC {
+
+    /**
+     * The only part of a HybridTree which is stored in the pool. A leaf is allocated, filled and persisted in one
+     * failure-atomic step by pmemobj_alloc. Removing its key persists the removed flag and retires the leaf, it is
+     * freed once no reader can hold it anymore. A leaf which was flagged but not freed before a crash is freed by the
+     * next rebuild.
+     */
+    struct PersistentLeaf {
+        TID tid;
+        uint64_t removed;
+        uint32_t keyLen;
+        uint8_t key[];
+    };
+
+    /**
+     * Keeps N4/N16/N48/N256 in DRAM (an ART_OLC tree) and only the leaves in persistent memory. The inner nodes are
+     * rebuilt in parallel from the leaves found in the pool when the tree is constructed, traversals therefore run
+     * at DRAM speed and only touch persistent memory to verify the key in the leaf.
+     */
+    class HybridTree {
+    public:
+        // type number of PersistentLeaf objects in the pool
+        static constexpr uint64_t leafTypeNum = 0x4c4541462d4c43;
+
+        class ThreadInfo {
+            friend class HybridTree;
+
+            ART::ThreadInfo treeInfo;
+            ART::ThreadInfo leafInfo;
+
+            ThreadInfo(ART::ThreadInfo treeInfo, ART::ThreadInfo leafInfo) : treeInfo(treeInfo), leafInfo(leafInfo) { }
+        };
+
+    private:
+        // frees retired leaves, the removed flag already made their removal durable
+        class LeafReclaimer : public NodeReclaimer {
+            pool_base pop;
+
+        public:
+            LeafReclaimer(pool_base &pop) : pop(pop) { }
+
+            void retire(void *) override { }
+
+            void free(void *const nodes[], std::size_t count) override;
+        };
+
+        pool_base pop;
+
+        // children of the inner tree are the addresses of PersistentLeaf objects
+        ART_OLC::Tree tree;
+
+        // has to outlive leafEpoche, which frees the leaves still pending when it is destroyed
+        LeafReclaimer leafReclaimer;
+
+        // readers hold a leaf after the inner tree returned it, leaves are therefore reclaimed by their own epoche
+        Epoche leafEpoche{256, &leafReclaimer};
+
+        std::size_t rebuildLeafCount = 0;
+
+        std::chrono::microseconds rebuildTime{0};
+
+        static PersistentLeaf *getLeaf(TID leaf);
+
+        static void loadLeafKey(TID leaf, Key &key);
+
+        static int constructLeaf(PMEMobjpool *pop, void *ptr, void *arg);
+
+        /**
+         * builds the inner nodes from the leaves in the pool, frees leaves which were removed and all but one leaf
+         * of a key which was inserted twice
+         */
+        void rebuild();
+
+    public:
+
+        HybridTree(pool_base &pop);
+
+        HybridTree(const HybridTree &) = delete;
+
+        ThreadInfo getThreadInfo();
+
+        TID lookup(const Key &k, ThreadInfo &threadEpocheInfo) const;
+
+        bool lookupRange(const Key &start, const Key &end, Key &continueKey, TID result[], std::size_t resultLen,
+                         std::size_t &resultCount, ThreadInfo &threadEpocheInfo) const;
+
+        void insert(const Key &k, TID tid, ThreadInfo &epocheInfo);
+
+        void remove(const Key &k, TID tid, ThreadInfo &epocheInfo);
+
+        /**
+         * number of leaves the inner nodes were rebuilt from and the time it took, reported as startup cost
+         */
+        std::size_t getRebuildLeafCount() const;
+
+        std::chrono::microseconds getRebuildTime() const;
+    };
+}
+#endif //ART_LOCK_COUPLING_HYBRIDTREE_H
@@ -0,0 +1,76 @@
+//
+// Volatile synchronization state of the persistent nodes of ART_LC
+//
+
+#ifndef ART_LOCK_COUPLING_LOCKTABLE_H
+#define ART_LOCK_COUPLING_LOCKTABLE_H
+
+#include <stdint.h>
+#include <atomic>
+
+namespace ART_LC {
+
+    /**
+     * lock and version of one node, all zero is an unlocked node which is not obsolete
+     */
+    struct NodeLock {
+        //62b version 1b lock 1b obsolete
+        std::atomic<uint64_t> versionLockObsolete;
+        std::atomic<int> readerCount;
+        // guards readerCount
+        std::atomic<uint8_t> mutex;
+        // set while a reader waits for the other readers to leave to upgrade, new readers restart meanwhile
+        std::atomic<uint8_t> upgradePending;
+
+        void reset() {
+            versionLockObsolete.store(0, std::memory_order_relaxed);
+            readerCount.store(0, std::memory_order_relaxed);
+            mutex.store(0, std::memory_order_relaxed);
+            upgradePending.store(0, std::memory_order_relaxed);
+        }
+
+        /**
+         * reset for a new node in the slot of a freed one, the version keeps growing so a version seen for the
+         * previous node (e.g. by the TopCache) never matches the new one
+         */
+        void recycle() {
+            uint64_t version = versionLockObsolete.load(std::memory_order_relaxed);
+            versionLockObsolete.store((version + 0b100) & ~static_cast<uint64_t>(0b11), std::memory_order_relaxed);
+            readerCount.store(0, std::memory_order_relaxed);
+            mutex.store(0, std::memory_order_relaxed);
+            upgradePending.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * Keeps the NodeLock of every persistent node in DRAM, so taking and releasing locks never dirties persistent
+     * memory and a crash leaves no lock state behind. Nodes are found by address: slab slots are rounded up to
+     * cache lines, two nodes are therefore at least 64 bytes apart and address / 64 is a unique index. The index
+     * space is split into chunks which are allocated on first use, a chunk is zeroed memory from calloc and only
+     * the pages holding entries of actual nodes are backed.
+     *
+     * The table is shared by all trees of a process, the entries of a pool are reset when it is attached, see
+     * NodeAllocator, and the entry of a node is recycled whenever a node is constructed in a slot.
+     */
+    class LockTable {
+        static constexpr unsigned granularityBits = 6;
+        static constexpr unsigned chunkBits = 20;
+        static constexpr unsigned addressBits = 47;
+        static constexpr std::size_t chunkCount = static_cast<std::size_t>(1) << (addressBits - granularityBits - chunkBits);
+
+        static std::atomic<NodeLock *> chunks[chunkCount];
+
+        static NodeLock *allocateChunk(std::size_t chunk);
+
+    public:
+        static NodeLock &get(const void *node) {
+            uintptr_t index = reinterpret_cast<uintptr_t>(node) >> granularityBits;
+            NodeLock *chunk = chunks[index >> chunkBits].load(std::memory_order_acquire);
+            if (chunk == nullptr) {
+                chunk = allocateChunk(index >> chunkBits);
+            }
+            return chunk[index & ((static_cast<uintptr_t>(1) << chunkBits) - 1)];
+        }
+    };
+}
+#endif //ART_LOCK_COUPLING_LOCKTABLE_H
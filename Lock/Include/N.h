@@ -12,11 +12,12 @@
 #include "../../Include/Key.h"
 #include "../../Include/Epoche.h"
 
-#include <libpmemobj++/make_persistent.hpp>
-#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/make_persistent_atomic.hpp>
 #include <libpmemobj++/persistent_ptr.hpp>
 #include <libpmemobj++/pool.hpp>
-#include <libpmemobj++/transaction.hpp>
+#include "Persist.h"
+#include "LockTable.h"
+#include "Flusher.h"
 #define LAYOUT "LOCK"
 using namespace pmem;
 using namespace pmem::obj;
@@ -43,31 +44,53 @@ namespace ART_LC {
 
     using Prefix = uint8_t[maxStoredPrefixLength];
 
+    class NodeAllocator;
+
+    class N;
+
+    // child slot of a node, holds either a node of the same pool or a tagged leaf
+    using ChildPtr = RelativePtr<N>;
+
     class N {
     protected:
-        N(pool_base &pop, NTypes type, const uint8_t *prefix, uint32_t prefixLength) {
-            setType(pop, type);
-            setPrefix(pop, prefix, prefixLength);
+        N(NTypes type, const uint8_t *prefix, uint32_t prefixLength) {
+            setType(type);
+            setPrefix(prefix, prefixLength);
+            // the slot may have held an obsolete node before
+            lock().recycle();
         }
 
         N(const N &) = delete;
 
         N(N &&) = delete;
 
-        //2b type 60b version 1b lock 1b obsolete
-        p<std::atomic<uint64_t>> typeVersionLockObsolete{0b100};
-        p<std::atomic<uint8_t>> mutex{0b00};
-        p<int> readerCount = 0;
-        // version 1, unlocked, not obsolete
-        p<uint32_t> prefixCount = 0;
+        /*
+         * Nodes live in persistent memory but are not modified in transactions. Every mutation first writes and
+         * persists the new entry and then publishes it with one failure-atomic store (compactCount, childIndex or
+         * the child pointer itself), see Persist.h. count is only a hint after a crash. Locks and versions are not
+         * part of the node, they are kept in the LockTable.
+         */
+
+        NTypes type;
+        uint32_t prefixCount = 0;
 
-        p<uint8_t> count = 0;
-        p<Prefix> prefix;
+        uint8_t count = 0;
+        // number of used slots in N4, N16 and N48, removed entries leave a null child behind
+        uint8_t compactCount = 0;
+        Prefix prefix;
 
 
-        void setType(pool_base &pop, NTypes type);
+        void setType(NTypes type);
+
+        NodeLock &lock() const {
+            return LockTable::get(this);
+        }
+
+        void lockMutex();
+
+        void unlockMutex();
 
-        static uint64_t convertTypeToVersion(NTypes type);
+        void persistCount(pool_base &pop) const;
 
     public:
 
@@ -79,55 +102,90 @@ namespace ART_LC {
 
         bool mutexLocked(uint8_t mutexVal) const;
 
+        /**
+         * exclusive lock on a node which is not read locked by the calling thread
+         */
         void writeLockOrRestart(bool &needRestart);
 
-        void upgradeToWriteLockOrRestart(pool_base &pop, uint64_t &version, bool &needRestart);
+        /**
+         * turns the read lock of the calling thread into the exclusive lock, waits for the other readers to leave unless
+         * another reader is already upgrading or the node changed since version was read, then it fails
+         */
+        void upgradeToWriteLockOrRestart(uint64_t &version, bool &needRestart);
 
-        void writeUnlock(pool_base &pop);
+        void writeUnlock();
 
-/*        void increment();
+        /**
+         * shared lock used by insert and remove for lock coupling, excludes writers but not optimistic readers
+         */
+        uint64_t readLockOrRestart(bool &needRestart);
 
-        void decrement();
+        void readUnlock();
 
-        void lockMutex();
+        /**
+         * optimistic read as in ART_OLC: only loads the version, never writes to the node, so readers
+         * (lookup, lookupRange) do not store to or flush persistent memory
+         */
+        uint64_t readOptimisticOrRestart(bool &needRestart) const;
 
-        void unlockMutex();
-*/
-        uint64_t readLockOrRestart(pool_base &pop, bool &needRestart); 
+        /**
+         * readOptimisticOrRestart for readers which may not read the node itself, the read is not accounted
+         */
+        uint64_t readVersionOrRestart(bool &needRestart) const;
 
         /**
-         * returns true if node hasn't been changed in between
+         * validates an optimistic read, restarts if the node was locked, changed or became obsolete in between
          */
-        void checkOrRestart(uint64_t startRead, bool &needRestart);
-        void readUnlockOrRestart(pool_base &pop, uint64_t startRead, bool &needRestart);
+        void readOptimisticUnlockOrRestart(uint64_t startRead, bool &needRestart) const;
 
         static bool isObsolete(uint64_t version);
 
         /**
          * can only be called when node is locked
          */
-        void writeUnlockObsolete(pool_base &pop) {
-		transaction::run(pop, [&]{
-	            typeVersionLockObsolete.fetch_add(0b11);
-		});
+        void writeUnlockObsolete() {
+            lock().versionLockObsolete.fetch_add(0b11);
         }
 
         static N *getChild(const uint8_t k, const N *node);
 
-        static void insertAndUnlock(pool_base &pop, N *node, uint64_t v, N *parentNode, uint64_t parentVersion, uint8_t keyParent, uint8_t key, N *val, bool &needRestart,
+        /**
+         * node and, if given, parentNode have to be read locked by the caller, all locks are released on return
+         */
+        static void insertAndUnlock(pool_base &pop, NodeAllocator &allocator, N *node, uint64_t v, N *parentNode, uint64_t parentVersion, uint8_t keyParent, uint8_t key, N *val, bool &needRestart,
                                     ThreadInfo &threadInfo);
 
-        static bool change(N *node, uint8_t key, N *val);
+        static bool change(pool_base &pop, N *node, uint8_t key, N *val);
+
+        /**
+         * number of entries which can be added with insertMany without growing the node
+         */
+        static uint32_t getFreeSlots(const N *node);
+
+        /**
+         * adds n entries with distinct keys which are not in the node yet, all of them are published with the same
+         * two fences, node has to be write locked
+         */
+        static void insertMany(pool_base &pop, N *node, const uint8_t keys[], N *const vals[], unsigned n);
 
-        static void removeAndUnlock(N *node, uint64_t v, uint8_t key, N *parentNode, uint64_t parentVersion, uint8_t keyParent, bool &needRestart, ThreadInfo &threadInfo);
+        /**
+         * node and, if given, parentNode have to be read locked by the caller, all locks are released on return
+         */
+        static void removeAndUnlock(pool_base &pop, NodeAllocator &allocator, N *node, uint64_t v, uint8_t key, N *parentNode, uint64_t parentVersion, uint8_t keyParent, bool &needRestart, ThreadInfo &threadInfo);
 
         bool hasPrefix() const;
 
         const uint8_t *getPrefix() const;
 
-        void setPrefix(pool_base &pop, const uint8_t *prefix, uint32_t length);
+        /**
+         * only for nodes which are not yet published
+         */
+        void setPrefix(const uint8_t *prefix, uint32_t length);
 
-        void addPrefixBefore(pool_base &pop, N *node, uint8_t key);
+        /**
+         * only for nodes which are not yet published
+         */
+        void addPrefixBefore(N *node, uint8_t key);
 
         uint32_t getPrefixLength() const;
 
@@ -137,39 +195,67 @@ namespace ART_LC {
 
         static N *setLeaf(TID tid);
 
-        static N *getAnyChild(N *n);
+        static N *getAnyChild(const N *n);
+
+        static TID getAnyChildTid(const N *n, bool &needRestart);
 
-        static TID getAnyChildTid(N *n, bool &needRestart);
+        static void deleteChildren(NodeAllocator &allocator, N *node);
 
-        static void deleteChildren(N *node);
+        static void deleteNode(NodeAllocator &allocator, N *node);
 
-        static void deleteNode(pool_base &pop, N *node);
+        static std::size_t getSize(const N *node);
+
+        /**
+         * creates a persisted but unpublished copy of node with a different prefix
+         */
+        static N *copyWithPrefix(pool_base &pop, NodeAllocator &allocator, const N *node, const uint8_t *prefix, uint32_t prefixLength);
 
         static std::tuple<N *, uint8_t> getSecondChild(N *node, const uint8_t k);
 
         template<typename curN, typename biggerN>
-        static void insertGrow(pool_base &pop, curN *n, uint64_t v, N *parentNode, uint64_t parentVersion, uint8_t keyParent, uint8_t key, N *val, bool &needRestart, ThreadInfo &threadInfo);
+        static void insertGrow(pool_base &pop, NodeAllocator &allocator, curN *n, uint64_t v, N *parentNode, uint64_t parentVersion, uint8_t keyParent, uint8_t key, N *val, bool &needRestart, ThreadInfo &threadInfo);
 
         template<typename curN, typename smallerN>
-        static void removeAndShrink(curN *n, uint64_t v, N *parentNode, uint64_t parentVersion, uint8_t keyParent, uint8_t key, bool &needRestart, ThreadInfo &threadInfo);
+        static void removeAndShrink(pool_base &pop, NodeAllocator &allocator, curN *n, uint64_t v, N *parentNode, uint64_t parentVersion, uint8_t keyParent, uint8_t key, bool &needRestart, ThreadInfo &threadInfo);
 
-        static uint64_t getChildren(N *node, uint8_t start, uint8_t end, std::tuple<uint8_t, N *> children[],
+        static uint64_t getChildren(const N *node, uint8_t start, uint8_t end, std::tuple<uint8_t, N *> children[],
                                 uint32_t &childrenCount);
+
+        /**
+         * repairs a node after the pool was reopened: recomputes count and drops entries which were not completely
+         * published before the crash, must run before any other thread accesses the node
+         */
+        static void recover(pool_base &pop, N *node);
     };
 
     class N4 : public N {
     public:
-        p<uint8_t> keys[4];
-        persistent_ptr<N> children[4] = {nullptr, nullptr, nullptr, nullptr};
+        uint8_t keys[4];
+        ChildPtr children[4];
 
     public:
-        N4(pool_base &pop, const uint8_t *prefix, uint32_t prefixLength) : N(NTypes::N4, prefix,
-                                                                             prefixLength) { }
+        static constexpr NTypes nodeType = NTypes::N4;
+
+        N4(const uint8_t *prefix, uint32_t prefixLength) : N(NTypes::N4, prefix,
+                                                             prefixLength) {
+            memset(keys, 0, sizeof(keys));
+            memset(children, 0, sizeof(children));
+        }
 
         void insert(pool_base &pop, uint8_t key, N *n);
 
+        void insertMany(pool_base &pop, const uint8_t newKeys[], N *const vals[], unsigned n);
+
+        /**
+         * plain stores without flushes, only for nodes which are not yet published
+         */
+        void insertUnpublished(uint8_t key, N *n);
+
+        /**
+         * inserts all children except the one at exceptKey (-1: none) into the unpublished node n
+         */
         template<class NODE>
-        void copyTo(pool_base &pop, NODE n) const;
+        void copyTo(NODE *n, int exceptKey = -1) const;
 
         bool change(pool_base &pop, uint8_t key, N *val);
 
@@ -177,7 +263,7 @@ namespace ART_LC {
 
         void remove(pool_base &pop, uint8_t k);
 
-        N *getAnyChild() ;
+        N *getAnyChild() const;
 
         bool isFull() const;
 
@@ -185,16 +271,18 @@ namespace ART_LC {
 
         std::tuple<N *, uint8_t> getSecondChild(const uint8_t key) const;
 
-        void deleteChildren();
+        void deleteChildren(NodeAllocator &allocator);
+
+        void recover(pool_base &pop);
 
         uint64_t getChildren(uint8_t start, uint8_t end, std::tuple<uint8_t, N *> *&children,
-                         uint32_t &childrenCount) ;
+                         uint32_t &childrenCount) const;
     };
 
     class N16 : public N {
     public:
-        p<uint8_t> keys[16];
-        persistent_ptr<N> children[16];
+        uint8_t keys[16];
+        ChildPtr children[16];
 
         static uint8_t flipSign(uint8_t keyByte) {
             // Flip the sign bit, enables signed SSE comparison of unsigned values, used by Node16
@@ -215,54 +303,80 @@ namespace ART_LC {
 #endif
         }
 
-        N *const *getChildPos(const uint8_t k) const;
+        ChildPtr *getChildPos(const uint8_t k);
 
     public:
-        N16(pool_base &pop, const uint8_t *prefix, uint32_t prefixLength) : N(NTypes::N16, prefix,
-                                                                              prefixLength) {
+        static constexpr NTypes nodeType = NTypes::N16;
+
+        N16(const uint8_t *prefix, uint32_t prefixLength) : N(NTypes::N16, prefix,
+                                                              prefixLength) {
             memset(keys, 0, sizeof(keys));
             memset(children, 0, sizeof(children));
         }
 
         void insert(pool_base &pop, uint8_t key, N *n);
 
+        void insertMany(pool_base &pop, const uint8_t newKeys[], N *const vals[], unsigned n);
+
+        /**
+         * plain stores without flushes, only for nodes which are not yet published
+         */
+        void insertUnpublished(uint8_t key, N *n);
+
+        /**
+         * inserts all children except the one at exceptKey (-1: none) into the unpublished node n
+         */
         template<class NODE>
-        void copyTo(NODE n) const;
+        void copyTo(NODE *n, int exceptKey = -1) const;
 
-        bool change(uint8_t key, N *val);
+        bool change(pool_base &pop, uint8_t key, N *val);
 
         N *getChild(const uint8_t k) const;
 
         void remove(pool_base &pop, uint8_t k);
 
-        N *getAnyChild() ;
+        N *getAnyChild() const;
 
         bool isFull() const;
 
         bool isUnderfull() const;
 
-        void deleteChildren();
+        void deleteChildren(NodeAllocator &allocator);
+
+        void recover(pool_base &pop);
 
         uint64_t getChildren(uint8_t start, uint8_t end, std::tuple<uint8_t, N *> *&children,
-                         uint32_t &childrenCount) ;
+                         uint32_t &childrenCount) const;
     };
 
     class N48 : public N {
-        p<uint8_t> childIndex[256];
-        persistent_ptr<N> children[48];
+        uint8_t childIndex[256];
+        ChildPtr children[48];
     public:
         static const uint8_t emptyMarker = 48;
 
-        N48(pool_base &pop, const uint8_t *prefix, uint32_t prefixLength) : N(NTypes::N48, prefix,
-                                                                              prefixLength) {
+        static constexpr NTypes nodeType = NTypes::N48;
+
+        N48(const uint8_t *prefix, uint32_t prefixLength) : N(NTypes::N48, prefix,
+                                                              prefixLength) {
             memset(childIndex, emptyMarker, sizeof(childIndex));
             memset(children, 0, sizeof(children));
         }
 
         void insert(pool_base &pop, uint8_t key, N *n);
 
+        void insertMany(pool_base &pop, const uint8_t newKeys[], N *const vals[], unsigned n);
+
+        /**
+         * plain stores without flushes, only for nodes which are not yet published
+         */
+        void insertUnpublished(uint8_t key, N *n);
+
+        /**
+         * inserts all children except the one at exceptKey (-1: none) into the unpublished node n
+         */
         template<class NODE>
-        void copyTo(NODE n) const;
+        void copyTo(NODE *n, int exceptKey = -1) const;
 
         bool change(pool_base &pop, uint8_t key, N *val);
 
@@ -270,31 +384,45 @@ namespace ART_LC {
 
         void remove(pool_base &pop, uint8_t k);
 
-        N *getAnyChild() ;
+        N *getAnyChild() const;
 
         bool isFull() const;
 
         bool isUnderfull() const;
 
-        void deleteChildren();
+        void deleteChildren(NodeAllocator &allocator);
+
+        void recover(pool_base &pop);
 
         uint64_t getChildren(uint8_t start, uint8_t end, std::tuple<uint8_t, N *> *&children,
-                         uint32_t &childrenCount) ;
+                         uint32_t &childrenCount) const;
     };
 
     class N256 : public N {
-        persistent_ptr<N> children[256];
+        ChildPtr children[256];
 
     public:
-        N256(pool_base &pop, const uint8_t *prefix, uint32_t prefixLength) : N(NTypes::N256, prefix,
-                                                                               prefixLength) {
+        static constexpr NTypes nodeType = NTypes::N256;
+
+        N256(const uint8_t *prefix, uint32_t prefixLength) : N(NTypes::N256, prefix,
+                                                               prefixLength) {
             memset(children, '\0', sizeof(children));
         }
 
         void insert(pool_base &pop, uint8_t key, N *val);
 
+        void insertMany(pool_base &pop, const uint8_t newKeys[], N *const vals[], unsigned n);
+
+        /**
+         * plain stores without flushes, only for nodes which are not yet published
+         */
+        void insertUnpublished(uint8_t key, N *n);
+
+        /**
+         * inserts all children except the one at exceptKey (-1: none) into the unpublished node n
+         */
         template<class NODE>
-        void copyTo(NODE n) const;
+        void copyTo(NODE *n, int exceptKey = -1) const;
 
         bool change(pool_base &pop, uint8_t key, N *n);
 
@@ -302,16 +430,18 @@ namespace ART_LC {
 
         void remove(pool_base &pop, uint8_t k);
 
-        N *getAnyChild() ;
+        N *getAnyChild() const;
 
         bool isFull() const;
 
         bool isUnderfull() const;
 
-        void deleteChildren();
+        void deleteChildren(NodeAllocator &allocator);
+
+        void recover(pool_base &pop);
 
         uint64_t getChildren(uint8_t start, uint8_t end, std::tuple<uint8_t, N *> *&children,
-                         uint32_t &childrenCount) ;
+                         uint32_t &childrenCount) const;
     };
 }
 #endif //ART_OPTIMISTIC_LOCK_COUPLING_N_H
@@ -0,0 +1,131 @@
+//
+// Per-thread slab allocator for the persistent nodes of ART_LC
+//
+
+#ifndef ART_LOCK_COUPLING_NODEALLOCATOR_H
+#define ART_LOCK_COUPLING_NODEALLOCATOR_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "tbb/enumerable_thread_specific.h"
+#include "N.h"
+
+namespace ART_LC {
+
+    /**
+     * 64 nodes of one type with a persistent allocation bitmap. A set bit means the slot might be reachable, it is
+     * set and flushed before the node is published and only cleared when the node is unreachable for sure, a
+     * crash can therefore leak slots but never hand out a slot which is still in use. Leaked slots are found again
+     * by the recovery pass.
+     *
+     * The retired bitmap is the durable limbo list: a node gets its bit once it was unlinked from the tree and keeps
+     * it until the epoche frees it. Whatever is still retired when the pool is opened again was unreachable at the
+     * crash and is freed right away.
+     */
+    struct NodeSlab {
+        static constexpr unsigned slotCount = 64;
+
+        // type number of NodeSlab objects in the pool
+        static constexpr uint64_t typeNum = 0x534c41422d4c43;
+
+        uint64_t bitmap;
+        uint64_t retired;
+        uint64_t type;
+        persistent_ptr<NodeSlab> next;
+
+        static std::size_t getSlotSize(NTypes type);
+
+        static std::size_t getSize(NTypes type);
+
+        void *getSlot(unsigned pos);
+
+        bool contains(const void *node) const;
+
+        unsigned getPos(const void *node) const;
+    };
+
+    class NodeAllocator : public NodeReclaimer {
+        struct ThreadCache {
+            NodeSlab *current[4] = {};
+        };
+
+        pool_base pop;
+
+        // head of the persistent list of all slabs, new slabs are allocated directly into the next pointer of tail
+        persistent_ptr<NodeSlab> &slabs;
+
+        std::mutex slabsMutex;
+        NodeSlab *tail = nullptr;
+        std::vector<NodeSlab *> allSlabs;
+        // slabs with free slots, a slab may end up here while a thread still allocates from it, bits are therefore
+        // always taken with a CAS
+        std::vector<NodeSlab *> partialSlabs[4];
+
+        tbb::enumerable_thread_specific<ThreadCache> caches;
+
+        // bitmaps built by the recovery pass, indexed like allSlabs
+        std::unique_ptr<std::atomic<uint64_t>[]> reachable;
+
+        static int constructSlab(PMEMobjpool *pop, void *ptr, void *arg);
+
+        NodeSlab *takeSlab(NTypes type);
+
+        NodeSlab *findSlab(const void *node) const;
+
+        void collectSlabs();
+
+        void reclaimRetired();
+
+        // frees the KeyLeaf at offset in the pool
+        void freeLeaf(uint64_t offset);
+
+    public:
+        /**
+         * frees all nodes which were retired but not yet freed when the pool was closed or crashed
+         */
+        NodeAllocator(pool_base &pop, persistent_ptr<NodeSlab> &slabs);
+
+        NodeAllocator(const NodeAllocator &) = delete;
+
+        /**
+         * returns an uninitialized slot for a node of the given type, its bit is set and flushed but not fenced,
+         * the caller persists the node before publishing it, which also orders the bitmap flush
+         */
+        void *allocate(NTypes type);
+
+        template<typename NODE>
+        NODE *allocate(const uint8_t *prefix, uint32_t prefixLength) {
+            return new(allocate(NODE::nodeType)) NODE(prefix, prefixLength);
+        }
+
+        /**
+         * frees an unreachable node immediately
+         */
+        void free(N *node);
+
+        /**
+         * adds an unlinked node to the durable limbo list, the unlink has to be persisted already. Tagged leaves
+         * (KeyLeaf offsets) are accepted as well and freed with pmemobj_free.
+         */
+        void retire(void *node) override;
+
+        /**
+         * frees a batch of retired nodes with a single fence, called by the epoche once no thread can reach them
+         */
+        void free(void *const nodes[], std::size_t count) override;
+
+        /**
+         * the recovery pass reports every reachable node between beginRecovery and endRecovery, all other slots are
+         * freed afterwards
+         */
+        void beginRecovery();
+
+        void markReachable(const N *node);
+
+        void endRecovery();
+    };
+}
+#endif //ART_LOCK_COUPLING_NODEALLOCATOR_H
@@ -0,0 +1,92 @@
+//
+// ART_LC partitioned by key range across the NUMA nodes of a machine
+//
+
+#ifndef ART_LOCK_COUPLING_PARTITIONEDTREE_H
+#define ART_LOCK_COUPLING_PARTITIONEDTREE_H
+
+#include <sched.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Tree.h"
+
+namespace ART_LC {
+
+    /**
+     * One Tree per NUMA node, each in a growing pool on the persistent memory of its node. Keys are routed by their
+     * first byte, every partition holds a contiguous range of first bytes, a range scan therefore visits the
+     * partitions one after the other and returns keys in order without merging.
+     *
+     * Every operation runs on the calling thread. To keep the accesses to persistent memory local, threads are bound
+     * to the node of a partition with bindThread and work on the keys getPartition routes there.
+     *
+     * The routing follows from the number of partitions only, a partitioned tree has to be opened again with the same
+     * number and order of partitions, the constructor throws if a pool holds keys of another partition.
+     */
+    class PartitionedTree {
+    public:
+        struct PartitionConfig {
+            // directory of the growing pool, see openGrowingPool
+            std::string poolDir;
+            // node the pool is on, -1 if threads are not bound
+            int numaNode;
+        };
+
+        class ThreadInfo {
+            friend class PartitionedTree;
+
+            // one per partition, indexed like partitions
+            std::vector<ART::ThreadInfo> infos;
+        };
+
+    private:
+        struct Partition {
+            pool<TreeAnchor> pop;
+            std::unique_ptr<Tree> tree;
+            cpu_set_t cpus;
+            bool bound;
+        };
+
+        std::vector<std::unique_ptr<Partition>> partitions;
+
+        // partition of every first key byte
+        uint8_t route[256];
+
+        static void readNodeCpus(int numaNode, cpu_set_t &cpus);
+
+    public:
+        PartitionedTree(const std::vector<PartitionConfig> &configs, Tree::LoadKeyFunction loadKey,
+                        LeafType leafType = LeafType::ExternalKey);
+
+        PartitionedTree(const PartitionedTree &) = delete;
+
+        ~PartitionedTree();
+
+        std::size_t getPartitionCount() const {
+            return partitions.size();
+        }
+
+        unsigned getPartition(const Key &k) const {
+            return k.getKeyLen() == 0 ? 0 : route[k[0]];
+        }
+
+        /**
+         * binds the calling thread to the CPUs of the NUMA node of partition
+         */
+        void bindThread(unsigned partition) const;
+
+        ThreadInfo getThreadInfo();
+
+        TID lookup(const Key &k, ThreadInfo &threadInfo) const;
+
+        bool lookupRange(const Key &start, const Key &end, Key &continueKey, TID result[], std::size_t resultLen,
+                         std::size_t &resultCount, ThreadInfo &threadInfo) const;
+
+        void insert(const Key &k, TID tid, ThreadInfo &threadInfo);
+
+        void remove(const Key &k, TID tid, ThreadInfo &threadInfo);
+    };
+}
+#endif //ART_LOCK_COUPLING_PARTITIONEDTREE_H
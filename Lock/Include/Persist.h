@@ -0,0 +1,114 @@
+//
+// Flush and fence primitives of the log-free durability scheme used by ART_LC
+//
+
+#ifndef ART_LOCK_COUPLING_PERSIST_H
+#define ART_LOCK_COUPLING_PERSIST_H
+
+#include <stdint.h>
+#include <type_traits>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include "PersistStats.h"
+
+namespace ART_LC {
+    using namespace pmem::obj;
+
+    /**
+     * writes back the cache lines covering [addr, addr + len), does not wait for completion
+     */
+    inline void flush(pool_base &pop, const void *addr, std::size_t len) {
+        PersistStats::onFlush(addr, len);
+        pop.flush(addr, len);
+    }
+
+    /**
+     * waits until all preceding flushes reached the persistence domain
+     */
+    inline void fence(pool_base &pop) {
+        PersistStats::onFence();
+        pop.drain();
+    }
+
+    inline void persist(pool_base &pop, const void *addr, std::size_t len) {
+        flush(pop, addr, len);
+        fence(pop);
+    }
+
+    /**
+     * Stores val into slot such that the pointer only becomes visible with a single failure-atomic 8-byte store.
+     * The pool id is written first, a pointer reads as null as long as its offset is 0, so neither a concurrent
+     * reader nor a crash can observe a half written pointer. The slot still has to be persisted by the caller.
+     */
+    template<typename T>
+    inline void publish(persistent_ptr<T> &slot, const persistent_ptr<T> &val) {
+        PMEMoid *oid = slot.raw_ptr();
+        const PMEMoid &newOid = val.raw();
+        if (newOid.off != 0) {
+            oid->pool_uuid_lo = newOid.pool_uuid_lo;
+        }
+        __atomic_store_n(&oid->off, newOid.off, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * 8-byte pointer between two objects of the same pool: the distance from the slot to the target is stored, so
+     * the slot stays valid wherever the pool is mapped and needs no pool id. Values with bit 63 set are tagged
+     * values (leaves of ART_LC) and are stored unchanged, 0 is null. Distances keep bit 63 clear, they are
+     * sign-extended from bit 62 when read.
+     */
+    template<typename T>
+    class RelativePtr {
+        static constexpr uint64_t tagBit = static_cast<uint64_t>(1) << 63;
+
+        uint64_t raw;
+
+        uint64_t encode(const T *val) const {
+            uint64_t v = reinterpret_cast<uint64_t>(val);
+            if (v == 0 || (v & tagBit) != 0) {
+                return v;
+            }
+            return static_cast<uint64_t>(reinterpret_cast<const uint8_t *>(val) -
+                                         reinterpret_cast<const uint8_t *>(this)) & ~tagBit;
+        }
+
+    public:
+        RelativePtr() = default;
+
+        RelativePtr(const RelativePtr &) = delete;
+
+        /**
+         * plain store, only for slots which are not published yet
+         */
+        RelativePtr &operator=(T *val) {
+            raw = encode(val);
+            return *this;
+        }
+
+        /**
+         * single 8-byte store, readers see either the old or the new pointer
+         */
+        void store(T *val) {
+            __atomic_store_n(&raw, encode(val), __ATOMIC_RELEASE);
+        }
+
+        T *get() const {
+            uint64_t r = __atomic_load_n(&raw, __ATOMIC_ACQUIRE);
+            if (r == 0 || (r & tagBit) != 0) {
+                return reinterpret_cast<T *>(r);
+            }
+            int64_t distance = static_cast<int64_t>(r << 1) >> 1;
+            return reinterpret_cast<T *>(const_cast<uint8_t *>(reinterpret_cast<const uint8_t *>(this)) + distance);
+        }
+
+        operator T *() const {
+            return get();
+        }
+    };
+
+    template<typename T>
+    inline void publish(RelativePtr<T> &slot, typename std::common_type<T>::type *val) {
+        slot.store(val);
+    }
+}
+
+#endif //ART_LOCK_COUPLING_PERSIST_H
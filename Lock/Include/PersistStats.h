@@ -0,0 +1,264 @@
+//
+// Flush and fence accounting and latency injection for emulated persistent memory
+//
+
+#ifndef ART_LOCK_COUPLING_PERSISTSTATS_H
+#define ART_LOCK_COUPLING_PERSISTSTATS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace ART_LC {
+
+    // tree operation a flush is accounted to
+    enum class PersistOp : uint8_t {
+        Other,
+        Insert,
+        Remove,
+        Lookup,
+        Count
+    };
+
+    // structural change a flush is accounted to
+    enum class PersistEvent : uint8_t {
+        None,
+        Grow,
+        Shrink,
+        PrefixSplit,
+        LeafSplit,
+        Merge,
+        Count
+    };
+
+    struct PersistCounters {
+        uint64_t flushedLines = 0;
+        uint64_t fences = 0;
+    };
+
+    /**
+     * Snapshot of the counters of all threads. Flushes and fences are broken down by operation, structural event
+     * and the type of the node written (NTypes, nodeTypeCount - 1 for allocator and anchor metadata). Nodes are
+     * never modified in transactions, the atomic allocations of pmemobj (slabs, leaves, batch logs) are the only
+     * logged updates and are counted instead. Flushes deferred by Durability::Relaxed are accounted to
+     * PersistOp::Other of the thread writing them back.
+     */
+    struct PersistBreakdown {
+        static constexpr unsigned opCount = static_cast<unsigned>(PersistOp::Count);
+        static constexpr unsigned eventCount = static_cast<unsigned>(PersistEvent::Count);
+        static constexpr unsigned nodeTypeCount = 5;
+
+        uint64_t operations[opCount] = {};
+        uint64_t nodeReads[opCount] = {};
+        uint64_t allocations[opCount][eventCount] = {};
+        uint64_t allocatedBytes[opCount][eventCount] = {};
+        PersistCounters counters[opCount][eventCount][nodeTypeCount];
+
+        PersistCounters total(PersistOp op) const;
+
+        PersistCounters total() const;
+    };
+
+    /**
+     * sees every flush and fence of the calling threads, e.g. to record the persist order of a workload
+     */
+    class PersistObserver {
+    public:
+        virtual ~PersistObserver() = default;
+
+        // called before the lines are flushed
+        virtual void onFlush(const void *addr, std::size_t len) = 0;
+
+        virtual void onFence() = 0;
+    };
+
+    /**
+     * Instrumentation of flush and fence. Every thread counts the cache lines it flushes and the fences it issues,
+     * accounted to the operation, event and node type set by the scopes below.
+     *
+     * Counting, latencies and the observer are only active while the instrumentation is enabled with setEnabled,
+     * otherwise the persist path of the tree checks a single flag and the scopes only set thread local context.
+     *
+     * For benchmarks on emulated persistent memory, i.e. a pool on /dev/shm or on a file system without DAX, the
+     * latencies of the modelled media are added by spinning: writeNs per flushed line, fenceNs per fence and readNs
+     * per node visited by a traversal. The latencies have to be set before the worker threads start.
+     */
+    class PersistStats {
+    public:
+        struct Latency {
+            uint32_t readNs = 0;
+            uint32_t writeNs = 0;
+            uint32_t fenceNs = 0;
+        };
+
+        static constexpr uint8_t noNodeType = PersistBreakdown::nodeTypeCount - 1;
+
+    private:
+        struct Context {
+            uint8_t op;
+            uint8_t event;
+            uint8_t nodeType;
+        };
+
+        struct ThreadCounters {
+            // only written by the owning thread, read by getBreakdown
+            std::atomic<uint64_t> operations[PersistBreakdown::opCount];
+            std::atomic<uint64_t> nodeReads[PersistBreakdown::opCount];
+            std::atomic<uint64_t> allocations[PersistBreakdown::opCount][PersistBreakdown::eventCount];
+            std::atomic<uint64_t> allocatedBytes[PersistBreakdown::opCount][PersistBreakdown::eventCount];
+            std::atomic<uint64_t> flushedLines[PersistBreakdown::opCount][PersistBreakdown::eventCount][PersistBreakdown::nodeTypeCount];
+            std::atomic<uint64_t> fences[PersistBreakdown::opCount][PersistBreakdown::eventCount][PersistBreakdown::nodeTypeCount];
+
+            ThreadCounters();
+
+            ~ThreadCounters();
+
+            void addTo(PersistBreakdown &b) const;
+        };
+
+        static std::atomic<bool> enabled;
+
+        static Latency latency;
+
+        static PersistObserver *observer;
+
+        static thread_local Context context;
+
+        static thread_local ThreadCounters counters;
+
+        static std::mutex registryMutex;
+        static std::vector<ThreadCounters *> registry;
+        // counters of threads which exited
+        static PersistBreakdown exited;
+
+        static void add(std::atomic<uint64_t> &counter, uint64_t n) {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        static void spin(uint64_t ns);
+
+        // the instrumentation itself, only called while enabled
+        static void recordFlush(const void *addr, std::size_t len);
+
+        static void recordFence();
+
+        static void recordRead();
+
+        static void recordAllocation(std::size_t size);
+
+        static void recordOperation(uint64_t keys);
+
+    public:
+        /**
+         * has to be set while no other thread flushes, as latency and observer
+         */
+        static void setEnabled(bool e);
+
+        static bool isEnabled() {
+            return enabled.load(std::memory_order_relaxed);
+        }
+
+        static void setLatency(const Latency &l);
+
+        static const Latency &getLatency() {
+            return latency;
+        }
+
+        /**
+         * observer may be nullptr, has to be set while no other thread flushes
+         */
+        static void setObserver(PersistObserver *o);
+
+        /**
+         * counters summed over all threads which ever flushed
+         */
+        static PersistBreakdown getBreakdown();
+
+        static PersistCounters getTotals() {
+            return getBreakdown().total();
+        }
+
+        static void onFlush(const void *addr, std::size_t len) {
+            if (isEnabled()) {
+                recordFlush(addr, len);
+            }
+        }
+
+        static void onFence() {
+            if (isEnabled()) {
+                recordFence();
+            }
+        }
+
+        static void onRead() {
+            if (isEnabled()) {
+                recordRead();
+            }
+        }
+
+        static void onAllocation(std::size_t size) {
+            if (isEnabled()) {
+                recordAllocation(size);
+            }
+        }
+
+        /**
+         * accounts everything the calling thread does while it exists to keys operations of type op, nested
+         * scopes (an insertBatch replaying inserts) keep the outer operation
+         */
+        class OpScope {
+            Context previous;
+
+        public:
+            OpScope(PersistOp op, uint64_t keys = 1) : previous(context) {
+                if (previous.op == static_cast<uint8_t>(PersistOp::Other)) {
+                    context.op = static_cast<uint8_t>(op);
+                    if (isEnabled()) {
+                        recordOperation(keys);
+                    }
+                }
+            }
+
+            OpScope(const OpScope &) = delete;
+
+            ~OpScope() {
+                context = previous;
+            }
+        };
+
+        class EventScope {
+            uint8_t previous;
+
+        public:
+            explicit EventScope(PersistEvent event) : previous(context.event) {
+                context.event = static_cast<uint8_t>(event);
+            }
+
+            EventScope(const EventScope &) = delete;
+
+            ~EventScope() {
+                context.event = previous;
+            }
+        };
+
+        /**
+         * nodeType is the NTypes of the node written inside the scope
+         */
+        class NodeScope {
+            uint8_t previous;
+
+        public:
+            explicit NodeScope(uint8_t nodeType) : previous(context.nodeType) {
+                context.nodeType = nodeType;
+            }
+
+            NodeScope(const NodeScope &) = delete;
+
+            ~NodeScope() {
+                context.nodeType = previous;
+            }
+        };
+    };
+}
+#endif //ART_LOCK_COUPLING_PERSISTSTATS_H
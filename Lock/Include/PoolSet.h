@@ -0,0 +1,29 @@
+//
+// Pools of the persistent tree which grow on demand
+//
+
+#ifndef ART_LOCK_COUPLING_POOLSET_H
+#define ART_LOCK_COUPLING_POOLSET_H
+
+#include <stdint.h>
+#include <string>
+#include "Tree.h"
+
+namespace ART_LC {
+
+    // address space reserved for a growing pool when it is mapped
+    static constexpr std::size_t defaultPoolReservation = static_cast<std::size_t>(1) << 40;
+
+    // size of the part files the pool grows by
+    static constexpr std::size_t defaultPoolGrowth = static_cast<std::size_t>(1) << 30;
+
+    /**
+     * Opens the pool in directory dir, creating it first if dir holds none. The pool is a pool set with a single
+     * directory part, libpmemobj adds a file of growth bytes to it whenever an allocation does not fit anymore,
+     * until reservation is used up. The capacity is therefore not fixed when the pool is created and all parts stay
+     * in one mapping, child pointers and KeyLeaf offsets are valid across them.
+     */
+    pool<TreeAnchor> openGrowingPool(const std::string &dir, std::size_t reservation = defaultPoolReservation,
+                                     std::size_t growth = defaultPoolGrowth);
+}
+#endif //ART_LOCK_COUPLING_POOLSET_H
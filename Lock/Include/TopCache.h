@@ -0,0 +1,78 @@
+//
+// DRAM replica of the upper levels of an ART_LC tree
+//
+
+#ifndef ART_LOCK_COUPLING_TOPCACHE_H
+#define ART_LOCK_COUPLING_TOPCACHE_H
+
+#include <stdint.h>
+#include <atomic>
+#include "N.h"
+
+namespace ART_LC {
+
+    /**
+     * Copies of the root and of the nodes directly below it, the nodes every lookup visits first. An entry holds
+     * the prefix and all 256 children of a node as seen at one version, lookups use it instead of the node in
+     * persistent memory while the version in the LockTable (which is in DRAM as well) still matches. The copies are
+     * never written back, durability is not affected.
+     *
+     * Entries are refilled by lookups, only when the same node was missed twice at the same version, so nodes which
+     * change with every insert do not pay for a full copy after every change. A reader may see an entry while it is
+     * refilled, the torn copy either belongs to a newer version of the node or to a node which replaced it, in both
+     * cases the version check of the lookup after reading the child fails and it restarts.
+     */
+    class TopCache {
+    public:
+        // the root and its children
+        static constexpr unsigned levels = 2;
+
+        static constexpr unsigned slotCount = 1 + 256;
+
+        struct Entry {
+            std::atomic<const N *> node{nullptr};
+            // read by lookups while it is refilled, ordered by node
+            std::atomic<uint64_t> version{0};
+            uint32_t prefixCount = 0;
+            Prefix prefix;
+            N *children[256];
+
+            // last miss which did not refill the entry
+            std::atomic<const N *> missNode{nullptr};
+            std::atomic<uint64_t> missVersion{0};
+            std::atomic<bool> refilling{false};
+        };
+
+    private:
+        Entry entries[slotCount];
+
+    public:
+        TopCache() = default;
+
+        TopCache(const TopCache &) = delete;
+
+        /**
+         * slot of a node reached from the node in slot parentSlot with key byte, -1 below the cached levels
+         */
+        static int getChildSlot(int parentSlot, uint8_t key) {
+            return parentSlot == 0 ? 1 + key : -1;
+        }
+
+        /**
+         * the entry of slot if it holds node at version, nullptr otherwise
+         */
+        const Entry *get(int slot, const N *node, uint64_t version) const {
+            const Entry &e = entries[slot];
+            if (e.node.load(std::memory_order_acquire) != node || e.version.load(std::memory_order_relaxed) != version) {
+                return nullptr;
+            }
+            return &e;
+        }
+
+        /**
+         * called after a miss on node in slot at version, which the caller validated
+         */
+        void onMiss(int slot, const N *node, uint64_t version);
+    };
+}
+#endif //ART_LOCK_COUPLING_TOPCACHE_H
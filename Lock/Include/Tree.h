@@ -6,23 +6,140 @@
 #define ART_LOCK_COUPLING_TREE_H
 
 #include "N.h"
+#include "../../Include/Index.h"
+#include "NodeAllocator.h"
+#include "TopCache.h"
+#include <libpmemobj++/pool.hpp>
+#include <chrono>
+#include <memory>
 
 using namespace ART;
 
 namespace ART_LC {
 
+    /**
+     * what the tree stores as leaf: the user's TID, whose key is read back with loadKey, or the offset of a KeyLeaf
+     * holding TID and key bytes in the pool
+     */
+    enum class LeafType : uint64_t {
+        ExternalKey,
+        EmbeddedKey
+    };
+
+    /**
+     * leaf of a tree in LeafType::EmbeddedKey mode, allocated, filled and persisted in one failure-atomic step by
+     * pmemobj_alloc. Key checks and prefix reconstruction read the key from here instead of calling loadKey.
+     */
+    struct KeyLeaf {
+        TID tid;
+        uint32_t keyLen;
+        uint8_t key[];
+    };
+
+    enum class Durability : uint8_t {
+        // every operation is durable when it returns
+        Strict,
+        // operations become durable with the next round of a background Flusher
+        Relaxed
+    };
+
+    /**
+     * root object of a pool holding a tree, the tree is reachable from here across restarts
+     */
+    struct TreeAnchor {
+        persistent_ptr<N256> root;
+        persistent_ptr<NodeSlab> slabs;
+        uint64_t layoutVersion;
+        // cleared while a tree is attached, recovery is only needed if it is found cleared on open
+        uint64_t cleanShutdown;
+        // a LeafType, fixed when the tree is created
+        uint64_t leafType;
+        // number of completed flush rounds of the relaxed durability mode, see Flusher
+        uint64_t completedFlushRounds;
+    };
+
     class Tree {
     public:
         using LoadKeyFunction = void (*)(TID tid, Key &key);
 
     private:
+        pool_base pop;
+
+        // start of the mapped pool, KeyLeaf offsets are relative to it
+        uint8_t *poolBase;
+
+        persistent_ptr<TreeAnchor> anchor;
+
         persistent_ptr<N> root;
 
-        TID checkKey(pool_base &pop, const TID tid, const Key &k) const;
+        /**
+         * returns the TID of leaf if its key is k, 0 otherwise
+         */
+        TID checkKey(const TID leaf, const Key &k) const;
+
+        LoadKeyFunction loadKey;
+
+        LeafType leafType;
+
+        NodeAllocator allocator;
+
+        // retired nodes go back to the allocator, which has to outlive the epoche
+        Epoche epoche{256, &allocator};
+
+        // only set in relaxed durability mode
+        std::unique_ptr<Flusher> flusher;
+
+        // DRAM copies of the upper levels used by lookup
+        std::unique_ptr<TopCache> topCache;
+
+        // subtrees up to this depth are recovered in parallel, deeper ones by the thread which reached them
+        static constexpr uint32_t parallelRecoveryDepth = 4;
+
+        void recoverSubtree(N *node, uint32_t depth, tbb::enumerable_thread_specific<std::vector<TID>> &leaves);
+
+        /**
+         * frees KeyLeaf objects which are not in the sorted reachable leaves, they were allocated or removed but not
+         * linked or freed before the crash
+         */
+        void freeUnreachableLeaves(const std::vector<TID> &reachable);
+
+        const KeyLeaf *getKeyLeaf(TID leaf) const;
+
+        // key of a leaf stored in the tree, from its KeyLeaf or loaded with loadKey
+        void loadLeafKey(TID leaf, Key &key) const;
 
-        p<LoadKeyFunction> loadKey;
+        // TID of a leaf stored in the tree as handed to the user
+        TID getLeafTid(TID leaf) const;
 
-        Epoche epoche{256};
+        /**
+         * returns what is stored in the tree as leaf for (k, tid), allocates the KeyLeaf in EmbeddedKey mode
+         */
+        TID makeLeaf(const Key &k, TID tid);
+
+        /**
+         * inserts keys[order[0]] and, as long as they go to free slots of the same node, the following keys of the
+         * sorted batch, returns the number of inserted keys
+         */
+        std::size_t insertGroup(pool_base &pop, const Key keys[], const TID tids[], const std::size_t order[],
+                                std::size_t n, ThreadInfo &epocheInfo);
+
+        /**
+         * finishes batches which were committed but not completely inserted before a crash
+         */
+        void replayBatches();
+
+        /**
+         * builds the subtree of the sorted range [begin, end) of a bulk load whose keys share the bytes before level,
+         * its nodes are flushed but not fenced
+         */
+        N *buildSubtree(const Key keys[], const TID tids[], std::size_t begin, std::size_t end, uint32_t level);
+
+        template<class NODE>
+        N *buildNode(const Key keys[], const TID tids[], std::size_t begin, std::size_t end, uint32_t level,
+                     uint32_t prefixLength);
+
+        // frees a subtree of buildSubtree which was never linked
+        void discardSubtree(N *node);
 
     public:
         enum class CheckPrefixResult : uint8_t {
@@ -48,35 +165,116 @@ namespace ART_LC {
         };
         static CheckPrefixResult checkPrefix(N* n, const Key &k, uint32_t &level);
 
-        static CheckPrefixPessimisticResult checkPrefixPessimistic(N *n, const Key &k, uint32_t &level,
-                                                                   uint8_t &nonMatchingKey,
-                                                                   Prefix &nonMatchingPrefix,
-                                                                   LoadKeyFunction loadKey, bool &needRestart);
+        static CheckPrefixResult checkPrefix(uint32_t prefixCount, const uint8_t *prefix, const Key &k, uint32_t &level);
+
+        CheckPrefixPessimisticResult checkPrefixPessimistic(N *n, const Key &k, uint32_t &level,
+                                                            uint8_t &nonMatchingKey,
+                                                            Prefix &nonMatchingPrefix,
+                                                            bool &needRestart) const;
 
-        static PCCompareResults checkPrefixCompare(N* n, const Key &k, uint8_t fillKey, uint32_t &level, LoadKeyFunction loadKey, bool &needRestart);
+        PCCompareResults checkPrefixCompare(const N* n, const Key &k, uint8_t fillKey, uint32_t &level, bool &needRestart) const;
 
-        static PCEqualsResults checkPrefixEquals(N* n, uint32_t &level, const Key &start, const Key &end, LoadKeyFunction loadKey, bool &needRestart);
+        PCEqualsResults checkPrefixEquals(const N* n, uint32_t &level, const Key &start, const Key &end, bool &needRestart) const;
 
     public:
+        // bumped whenever the persistent node or anchor layout changes
+        static constexpr uint64_t layoutVersion = 7;
 
-        Tree(LoadKeyFunction loadKey);
+        // type number of the commit records of insertBatch in the pool
+        static constexpr uint64_t batchLogTypeNum = 0x42415443482d4c43;
 
+        // type number of KeyLeaf objects in the pool
+        static constexpr uint64_t keyLeafTypeNum = 0x4b45592d4c43;
+
+        /**
+         * attaches to the tree in the root object of pop, a new tree is created with leafType if the pool does not hold
+         * one yet, an existing tree keeps the leaf type it was created with. loadKey may be nullptr for EmbeddedKey.
+         */
+        Tree(pool<TreeAnchor> &pop, LoadKeyFunction loadKey, LeafType leafType = LeafType::ExternalKey);
+
+        /**
+         * attaches to an existing tree in O(1), throws if pop does not hold a tree, recovers it if the pool was
+         * not closed cleanly
+         */
+        static std::unique_ptr<Tree> open(pool<TreeAnchor> &pop, LoadKeyFunction loadKey);
+
+        // the allocator, the epoche and the lock table state belong to one attached tree, it cannot be moved
         Tree(const Tree &) = delete;
 
-        Tree(Tree &&t) : root(t.root), loadKey(t.loadKey) { }
+        Tree(Tree &&) = delete;
 
         ~Tree();
 
         ThreadInfo getThreadInfo();
 
+        /**
+         * In relaxed mode insert, insertBatch and remove return once their updates are visible, they become durable
+         * within flushInterval. Operations which finished before the last completed flush round are durable, of the
+         * later ones a crash keeps any subset, not necessarily a prefix in the order they finished: their publishing
+         * stores can reach persistent memory early and in any order. The tree itself is never corrupted, every
+         * store publishes memory which was persisted before, and an insertBatch is still atomic. Must not be called
+         * concurrently with other operations on the tree.
+         */
+        void setDurability(Durability durability,
+                           std::chrono::milliseconds flushInterval = std::chrono::milliseconds(10));
+
+        /**
+         * makes every finished operation durable, nothing to do in strict mode
+         */
+        void sync();
+
+        /**
+         * number of flush rounds which completed in relaxed mode on this pool, it only grows and is durable once
+         * everything deferred before the round is. It tells which operations are durable for sure, recovery does not
+         * roll a crashed tree back to it.
+         */
+        uint64_t getCompletedFlushRounds() const;
+
+        /**
+         * repairs the nodes of a tree found in a reopened pool, see N::recover, has to finish before the tree is used
+         */
+        void recover();
+
         TID lookup(pool_base &pop, const Key &k, ThreadInfo &threadEpocheInfo) const;
 
         bool lookupRange(pool_base &pop, const Key &start, const Key &end, Key &continueKey, TID result[], std::size_t resultLen,
                          std::size_t &resultCount, ThreadInfo &threadEpocheInfo) const;
 
+        /**
+         * k must not be in the tree yet and tid must not be 0, lookup returns 0 for a key which is not found
+         */
         void insert(pool_base &pop, const Key &k, TID tid, ThreadInfo &epocheInfo);
 
+        /**
+         * Inserts n keys as one durable unit: the sorted batch is logged with a single persist, which is the commit
+         * point, and then inserted while sharing the descent, the locks and the fences for keys which land in the
+         * same node. A batch interrupted by a crash is completed when the pool is opened again. A key given more than
+         * once is inserted with its last TID. As for insert, the keys must not be in the tree yet and no TID may be
+         * 0, the completion after a crash skips the keys lookup finds.
+         */
+        void insertBatch(pool_base &pop, const Key keys[], const TID tids[], std::size_t n, ThreadInfo &epocheInfo);
+
+        /**
+         * Inserts n keys sorted in ascending order, unique and prefix free as for insert. Subtrees below a free slot
+         * of the root are built bottom-up in one pass, every node with its final type and prefix, and persisted with
+         * a single fence before they are published in the root. Keys below an occupied slot are inserted one by one.
+         * A crash loses the subtree which was not published yet, its nodes and leaves are freed by the recovery pass.
+         */
+        void bulkLoad(pool_base &pop, const Key keys[], const TID tids[], std::size_t n, ThreadInfo &epocheInfo);
+
         void remove(pool_base &pop, const Key &k, TID tid, ThreadInfo &epocheInfo);
     };
 }
+
+namespace ART {
+
+    template<>
+    struct IndexTraits<LockCoupling, PMem> {
+        using Tree = ART_LC::Tree;
+
+        using ThreadInfo = ART::ThreadInfo;
+
+        using Pool = pool<ART_LC::TreeAnchor>;
+    };
+}
 #endif //ART_LOCK_COUPLING_N_H
@@ -0,0 +1,23 @@
+#include <stdlib.h>
+#include <new>
+
+#include "Include/LockTable.h"
+
+namespace ART_LC {
+
+    std::atomic<NodeLock *> LockTable::chunks[LockTable::chunkCount];
+
+    NodeLock *LockTable::allocateChunk(std::size_t chunk) {
+        auto locks = static_cast<NodeLock *>(calloc(static_cast<std::size_t>(1) << chunkBits, sizeof(NodeLock)));
+        if (locks == nullptr) {
+            throw std::bad_alloc();
+        }
+        NodeLock *expected = nullptr;
+        if (!chunks[chunk].compare_exchange_strong(expected, locks)) {
+            // another thread installed the chunk first
+            free(locks);
+            return expected;
+        }
+        return locks;
+    }
+}
@@ -1,7 +1,13 @@
 #include <assert.h>
 #include <algorithm>
 
+#include <emmintrin.h> // x86 SSE intrinsics
+
 #include "Include/N.h"
+#include "Include/NodeAllocator.h"
+#include "LockTable.cpp"
+#include "Flusher.cpp"
+#include "PersistStats.cpp"
 #include "N4.cpp"
 #include "N16.cpp"
 #include "N48.cpp"
@@ -9,65 +15,93 @@
 
 namespace ART_LC {
 
-    void N::setType(pool_base &pop, NTypes type) {
-	transaction::run(pop, [&]{
-	        typeVersionLockObsolete.fetch_add(convertTypeToVersion(type));
-	});
+    void N::setType(NTypes type) {
+        this->type = type;
     }
 
-    uint64_t N::convertTypeToVersion(NTypes type) {
-        return (static_cast<uint64_t>(type) << 62);
+    NTypes N::getType() const {
+        return type;
     }
 
-    NTypes N::getType() const {
-        return static_cast<NTypes>(typeVersionLockObsolete.load(std::memory_order_relaxed) >> 62);
+    void N::lockMutex() {
+        std::atomic<uint8_t> &mutex = lock().mutex;
+        uint8_t mutexVal = 0b00;
+        while (!mutex.compare_exchange_weak(mutexVal, 0b10)) {
+            mutexVal = 0b00;
+            _mm_pause();
+        }
     }
 
-    void N::writeLockOrRestart(bool &needRestart) {
+    void N::unlockMutex() {
+        lock().mutex.store(0b00, std::memory_order_release);
+    }
 
-        uint64_t version;
-        version = typeVersionLockObsolete.load();
-        if (isLocked(version) || isObsolete(version)) {
+    void N::persistCount(pool_base &pop) const {
+        flushPublished(pop, &compactCount, sizeof(uint8_t));
+        flushPublished(pop, &count, sizeof(uint8_t));
+        fencePublished(pop);
+    }
+
+    void N::writeLockOrRestart(bool &needRestart) {
+        NodeLock &l = lock();
+        lockMutex();
+        uint64_t version = l.versionLockObsolete.load();
+        if (l.readerCount.load() != 0 || isLocked(version) || isObsolete(version) ||
+            !l.versionLockObsolete.compare_exchange_strong(version, version + 0b10)) {
             needRestart = true;
         }
-        if (needRestart) return;
-
-        upgradeToWriteLockOrRestart(version, needRestart);
-        if (needRestart) return;
+        unlockMutex();
     }
 
-    void N::upgradeToWriteLockOrRestart(pool_base &pop, uint64_t &version, bool &needRestart) {
-	transaction::run(pop, [&]{
-        if (typeVersionLockObsolete.compare_exchange_strong(version, version + 0b10)) {
-            version = version + 0b10;
-        } else {
+    void N::upgradeToWriteLockOrRestart(uint64_t &version, bool &needRestart) {
+        NodeLock &l = lock();
+        lockMutex();
+        // of two readers upgrading at the same time only the second one restarts, it releases its read lock and the
+        // first one waits for the remaining readers to leave, which no new reader joins
+        if (l.upgradePending.load() || l.versionLockObsolete.load() != version) {
             needRestart = true;
+            unlockMutex();
+            return;
+        }
+        l.upgradePending.store(1);
+        unlockMutex();
+
+        // besides this node a waiting upgrader holds at most the read lock of its child, so a reader waited for
+        // only waits itself when it upgrades the parent of this node and the waits never close a cycle
+        while (l.readerCount.load() != 1) {
+            _mm_pause();
         }
-	});
+
+        // no writer got in while the calling thread held its read lock, the read lock is handed over to the
+        // exclusive lock
+        lockMutex();
+        l.versionLockObsolete.store(version + 0b10);
+        l.readerCount.store(0);
+        l.upgradePending.store(0);
+        version = version + 0b10;
+        unlockMutex();
     }
 
-    void N::writeUnlock(pool_base &pop) {
-	transaction::run(pop, [&]{
-	        typeVersionLockObsolete.fetch_sub(0b10);
-	});
+    void N::writeUnlock() {
+        lock().versionLockObsolete.fetch_add(0b10);
     }
 
-    N *N::getAnyChild(N *node) {
+    N *N::getAnyChild(const N *node) {
         switch (node->getType()) {
             case NTypes::N4: {
-                auto n = static_cast<N4 *>(node);
+                auto n = static_cast<const N4 *>(node);
                 return n->getAnyChild();
             }
             case NTypes::N16: {
-                auto n = static_cast<N16 *>(node);
+                auto n = static_cast<const N16 *>(node);
                 return n->getAnyChild();
             }
             case NTypes::N48: {
-                auto n = static_cast<N48 *>(node);
+                auto n = static_cast<const N48 *>(node);
                 return n->getAnyChild();
             }
             case NTypes::N256: {
-                auto n = static_cast<N256 *>(node);
+                auto n = static_cast<const N256 *>(node);
                 return n->getAnyChild();
             }
         }
@@ -75,87 +109,151 @@ namespace ART_LC {
         __builtin_unreachable();
     }
 
-    bool N::change(N *node, uint8_t key, N *val) {
+    bool N::change(pool_base &pop, N *node, uint8_t key, N *val) {
+        PersistStats::NodeScope nodeScope(static_cast<uint8_t>(node->getType()));
         switch (node->getType()) {
             case NTypes::N4: {
                 auto n = static_cast<N4 *>(node);
-                return n->change(key, val);
+                return n->change(pop, key, val);
             }
             case NTypes::N16: {
                 auto n = static_cast<N16 *>(node);
-                return n->change(key, val);
+                return n->change(pop, key, val);
             }
             case NTypes::N48: {
                 auto n = static_cast<N48 *>(node);
-                return n->change(key, val);
+                return n->change(pop, key, val);
             }
             case NTypes::N256: {
                 auto n = static_cast<N256 *>(node);
-                return n->change(key, val);
+                return n->change(pop, key, val);
             }
         }
         assert(false);
         __builtin_unreachable();
     }
 
+    uint32_t N::getFreeSlots(const N *node) {
+        switch (node->getType()) {
+            case NTypes::N4:
+                return 4 - node->compactCount;
+            case NTypes::N16:
+                return 16 - node->compactCount;
+            case NTypes::N48:
+                return 48 - node->compactCount;
+            case NTypes::N256:
+                // every null child is a free slot
+                return 256;
+        }
+        assert(false);
+        __builtin_unreachable();
+    }
+
+    void N::insertMany(pool_base &pop, N *node, const uint8_t keys[], N *const vals[], unsigned n) {
+        PersistStats::NodeScope nodeScope(static_cast<uint8_t>(node->getType()));
+        switch (node->getType()) {
+            case NTypes::N4: {
+                static_cast<N4 *>(node)->insertMany(pop, keys, vals, n);
+                return;
+            }
+            case NTypes::N16: {
+                static_cast<N16 *>(node)->insertMany(pop, keys, vals, n);
+                return;
+            }
+            case NTypes::N48: {
+                static_cast<N48 *>(node)->insertMany(pop, keys, vals, n);
+                return;
+            }
+            case NTypes::N256: {
+                static_cast<N256 *>(node)->insertMany(pop, keys, vals, n);
+                return;
+            }
+        }
+    }
+
     template<typename curN, typename biggerN>
-    void N::insertGrow(pool_base &pop, curN *n, uint64_t v, N *parentNode, uint64_t parentVersion, uint8_t keyParent, uint8_t key, N *val, bool &needRestart, ThreadInfo &threadInfo) {
+    void N::insertGrow(pool_base &pop, NodeAllocator &allocator, curN *n, uint64_t v, N *parentNode, uint64_t parentVersion, uint8_t keyParent, uint8_t key, N *val, bool &needRestart, ThreadInfo &threadInfo) {
         if (!n->isFull()) {
-/*            if (parentNode != nullptr) {
-                parentNode->readUnlockOrRestart(parentVersion, needRestart);
-                if (needRestart) return;
-            }*/
+            if (parentNode != nullptr) {
+                parentNode->readUnlock();
+            }
             n->upgradeToWriteLockOrRestart(v, needRestart);
-            if (needRestare) return;
-            n->insert(key, val);
+            if (needRestart) {
+                n->readUnlock();
+                return;
+            }
+            n->insert(pop, key, val);
             n->writeUnlock();
             return;
         }
 
         parentNode->upgradeToWriteLockOrRestart(parentVersion, needRestart);
-        if (needRestart) return;
+        if (needRestart) {
+            parentNode->readUnlock();
+            n->readUnlock();
+            return;
+        }
 
         n->upgradeToWriteLockOrRestart(v, needRestart);
         if (needRestart) {
             parentNode->writeUnlock();
+            n->readUnlock();
             return;
         }
 
-	persistent_ptr<biggerN> nBig = nullptr;
-	transaction::run(pop, [&]{
-        	nBig = make_persistent<biggerN>(n->getPrefix(), n->getPrefixLength());
-	});
+        // compactions into a node of the same type are accounted as grow as well
+        PersistStats::EventScope eventScope(PersistEvent::Grow);
+
+        // the new node is filled and persisted before it is published with a single pointer store in the parent
+        biggerN *nBig = allocator.allocate<biggerN>(n->getPrefix(), n->getPrefixLength());
 
         n->copyTo(nBig);
-        nBig->insert(key, val);
+        nBig->insertUnpublished(key, val);
+        {
+            PersistStats::NodeScope nodeScope(static_cast<uint8_t>(biggerN::nodeType));
+            persist(pop, nBig, sizeof(biggerN));
+        }
 
-        N::change(parentNode, keyParent, nBig);
+        N::change(pop, parentNode, keyParent, nBig);
 
         n->writeUnlockObsolete();
         threadInfo.getEpoche().markNodeForDeletion(n, threadInfo);
         parentNode->writeUnlock();
     }
 
-    void N::insertAndUnlock(N *node, uint64_t v, N *parentNode, uint64_t parentVersion, uint8_t keyParent, uint8_t key, N *val, bool &needRestart, ThreadInfo &threadInfo) {
+    void N::insertAndUnlock(pool_base &pop, NodeAllocator &allocator, N *node, uint64_t v, N *parentNode, uint64_t parentVersion, uint8_t keyParent, uint8_t key, N *val, bool &needRestart, ThreadInfo &threadInfo) {
+        PersistStats::NodeScope nodeScope(static_cast<uint8_t>(node->getType()));
         switch (node->getType()) {
             case NTypes::N4: {
                 auto n = static_cast<N4 *>(node);
-                insertGrow<N4, N16>(pop, n, v, parentNode, parentVersion, keyParent, key, val, needRestart, threadInfo);
+                if (n->compactCount == 4 && n->count <= 3) {
+                    insertGrow<N4, N4>(pop, allocator, n, v, parentNode, parentVersion, keyParent, key, val, needRestart, threadInfo);
+                    break;
+                }
+                insertGrow<N4, N16>(pop, allocator, n, v, parentNode, parentVersion, keyParent, key, val, needRestart, threadInfo);
                 break;
             }
             case NTypes::N16: {
                 auto n = static_cast<N16 *>(node);
-                insertGrow<N16, N48>(pop, n, v, parentNode, parentVersion, keyParent, key, val, needRestart, threadInfo);
+                if (n->compactCount == 16 && n->count <= 14) {
+                    insertGrow<N16, N16>(pop, allocator, n, v, parentNode, parentVersion, keyParent, key, val, needRestart, threadInfo);
+                    break;
+                }
+                insertGrow<N16, N48>(pop, allocator, n, v, parentNode, parentVersion, keyParent, key, val, needRestart, threadInfo);
                 break;
             }
             case NTypes::N48: {
                 auto n = static_cast<N48 *>(node);
-                insertGrow<N48, N256>(pop, n, v, parentNode, parentVersion, keyParent, key, val, needRestart, threadInfo);
+                if (n->compactCount == 48 && n->count != 48) {
+                    insertGrow<N48, N48>(pop, allocator, n, v, parentNode, parentVersion, keyParent, key, val, needRestart, threadInfo);
+                    break;
+                }
+                insertGrow<N48, N256>(pop, allocator, n, v, parentNode, parentVersion, keyParent, key, val, needRestart, threadInfo);
                 break;
             }
             case NTypes::N256: {
                 auto n = static_cast<N256 *>(node);
-                insertGrow<N256, N256>(pop, n, v, parentNode, parentVersion, keyParent, key, val, needRestart, threadInfo);
+                insertGrow<N256, N256>(pop, allocator, n, v, parentNode, parentVersion, keyParent, key, val, needRestart, threadInfo);
                 break;
             }
         }
@@ -184,29 +282,29 @@ namespace ART_LC {
         __builtin_unreachable();
     }
 
-    void N::deleteChildren(N *node) {
+    void N::deleteChildren(NodeAllocator &allocator, N *node) {
         if (N::isLeaf(node)) {
             return;
         }
         switch (node->getType()) {
             case NTypes::N4: {
                 auto n = static_cast<N4 *>(node);
-                n->deleteChildren();
+                n->deleteChildren(allocator);
                 return;
             }
             case NTypes::N16: {
                 auto n = static_cast<N16 *>(node);
-                n->deleteChildren();
+                n->deleteChildren(allocator);
                 return;
             }
             case NTypes::N48: {
                 auto n = static_cast<N48 *>(node);
-                n->deleteChildren();
+                n->deleteChildren(allocator);
                 return;
             }
             case NTypes::N256: {
                 auto n = static_cast<N256 *>(node);
-                n->deleteChildren();
+                n->deleteChildren(allocator);
                 return;
             }
         }
@@ -215,62 +313,74 @@ namespace ART_LC {
     }
 
     template<typename curN, typename smallerN>
-    void N::removeAndShrink(pool_base &pop, curN *n, uint64_t v, N *parentNode, uint64_t parentVersion, uint8_t keyParent, uint8_t key, bool &needRestart, ThreadInfo &threadInfo) {
+    void N::removeAndShrink(pool_base &pop, NodeAllocator &allocator, curN *n, uint64_t v, N *parentNode, uint64_t parentVersion, uint8_t keyParent, uint8_t key, bool &needRestart, ThreadInfo &threadInfo) {
         if (!n->isUnderfull() || parentNode == nullptr) {
-/*            if (parentNode != nullptr) {
-                parentNode->readUnlockOrRestart(parentVersion, needRestart);
-                if (needRestart) return;
-            }*/
-            n->upgradeToWriteLockOrRestart(pop, v, needRestart);
-            if (needRestart) return;
-
-            n->remove(key);
+            if (parentNode != nullptr) {
+                parentNode->readUnlock();
+            }
+            n->upgradeToWriteLockOrRestart(v, needRestart);
+            if (needRestart) {
+                n->readUnlock();
+                return;
+            }
+
+            n->remove(pop, key);
             n->writeUnlock();
             return;
         }
-        parentNode->upgradeToWriteLockOrRestart(pop, parentVersion, needRestart);
-        if (needRestart) return;
+        parentNode->upgradeToWriteLockOrRestart(parentVersion, needRestart);
+        if (needRestart) {
+            parentNode->readUnlock();
+            n->readUnlock();
+            return;
+        }
 
-        n->upgradeToWriteLockOrRestart(pop, v, needRestart);
+        n->upgradeToWriteLockOrRestart(v, needRestart);
         if (needRestart) {
             parentNode->writeUnlock();
+            n->readUnlock();
             return;
         }
 
-	persistent_ptr<smallerN> nSmall = nullptr;
-	transaction::run(pop, [&]{
-	        nSmall = make_persistent<smallerN>(n->getPrefix(), n->getPrefixLength());
-	});
+        PersistStats::EventScope eventScope(PersistEvent::Shrink);
+
+        smallerN *nSmall = allocator.allocate<smallerN>(n->getPrefix(), n->getPrefixLength());
+
+        // filled and persisted in one go, the removed entry is left out of the copy
+        n->copyTo(nSmall, key);
+        {
+            PersistStats::NodeScope nodeScope(static_cast<uint8_t>(smallerN::nodeType));
+            persist(pop, nSmall, sizeof(smallerN));
+        }
 
-        n->copyTo(nSmall);
-        nSmall->remove(key);
-        N::change(parentNode, keyParent, nSmall);
+        N::change(pop, parentNode, keyParent, nSmall);
 
         n->writeUnlockObsolete();
         threadInfo.getEpoche().markNodeForDeletion(n, threadInfo);
         parentNode->writeUnlock();
     }
 
-    void N::removeAndUnlock(N *node, uint64_t v, uint8_t key, N *parentNode, uint64_t parentVersion, uint8_t keyParent, bool &needRestart, ThreadInfo &threadInfo) {
+    void N::removeAndUnlock(pool_base &pop, NodeAllocator &allocator, N *node, uint64_t v, uint8_t key, N *parentNode, uint64_t parentVersion, uint8_t keyParent, bool &needRestart, ThreadInfo &threadInfo) {
+        PersistStats::NodeScope nodeScope(static_cast<uint8_t>(node->getType()));
         switch (node->getType()) {
             case NTypes::N4: {
                 auto n = static_cast<N4 *>(node);
-                removeAndShrink<N4, N4>(n, v, parentNode, parentVersion, keyParent, key, needRestart, threadInfo);
+                removeAndShrink<N4, N4>(pop, allocator, n, v, parentNode, parentVersion, keyParent, key, needRestart, threadInfo);
                 break;
             }
             case NTypes::N16: {
                 auto n = static_cast<N16 *>(node);
-                removeAndShrink<N16, N4>(n, v, parentNode, parentVersion, keyParent, key, needRestart, threadInfo);
+                removeAndShrink<N16, N4>(pop, allocator, n, v, parentNode, parentVersion, keyParent, key, needRestart, threadInfo);
                 break;
             }
             case NTypes::N48: {
                 auto n = static_cast<N48 *>(node);
-                removeAndShrink<N48, N16>(n, v, parentNode, parentVersion, keyParent, key, needRestart, threadInfo);
+                removeAndShrink<N48, N16>(pop, allocator, n, v, parentNode, parentVersion, keyParent, key, needRestart, threadInfo);
                 break;
             }
             case NTypes::N256: {
                 auto n = static_cast<N256 *>(node);
-                removeAndShrink<N256, N48>(n, v, parentNode, parentVersion, keyParent, key, needRestart, threadInfo);
+                removeAndShrink<N256, N48>(pop, allocator, n, v, parentNode, parentVersion, keyParent, key, needRestart, threadInfo);
                 break;
             }
         }
@@ -284,70 +394,45 @@ namespace ART_LC {
             return ((mutexVal & 0b10) == 0b10);
     }
 
-    uint64_t N::readLockOrRestart(pool_base &pop, bool &needRestart) {
+    uint64_t N::readLockOrRestart(bool &needRestart) {
+        PersistStats::onRead();
+        NodeLock &l = lock();
         uint64_t version;
-        uint8_t mutexVal;
-        version = typeVersionLockObsolete.load();
-        
-        do {
-            mutexVal = mutex.load();
-        } while (mutexLocked(mutexVal));
-        
-	transaction::run(pop, [&]{
-	        mutex.fetch_add(0b10);
-        	++readerCount;
-	});
-        
-        if (readerCount == 1) writeLockOrRestart(needRestart); //upgradeToWriteLockOrRestart(version, needRestart);
-	
-	transaction::run(pop, [&]{
-	        if (needRestart) {
-        	        --readerCount;
-                	mutex.fetch_sub(0b10);
-	        } else {
-        	        mutex.fetch_sub(0b10);
-	        }
-	});
-
-/*        do {
-            version = typeVersionLockObsolete.load();
-        } while (isLocked(version));
-        if (isLocked(version) || isObsolete(version)) {
+        lockMutex();
+        version = l.versionLockObsolete.load();
+        if (isLocked(version) || isObsolete(version) || l.upgradePending.load()) {
             needRestart = true;
-        }*/
+        } else {
+            l.readerCount.fetch_add(1);
+        }
+        unlockMutex();
         return version;
-        //uint64_t version;
-        //while (isLocked(version)) _mm_pause();
-        //return version;
     }
 
     bool N::isObsolete(uint64_t version) {
         return (version & 1) == 1;
     }
 
-    void N::checkOrRestart(uint64_t startRead, bool &needRestart) {
-        readUnlockOrRestart(startRead, needRestart);
+    void N::readUnlock() {
+        lock().readerCount.fetch_sub(1);
     }
 
-    void N::readUnlockOrRestart(pool_base &pop, uint64_t startRead, bool &needRestart) {
-        uint8_t mutexVal;
-        do {
-            mutexVal = mutex.load();
-        } while (mutexLocked(mutexVal));
-     
-	transaction::run(pop, [&]{
-	   	mutex.fetch_add(0b10);
-        	--readerCount;
-	});
+    uint64_t N::readOptimisticOrRestart(bool &needRestart) const {
+        PersistStats::onRead();
+        return readVersionOrRestart(needRestart);
+    }
 
-        if (readerCount == 0) writeUnlock();
-        
-	transaction::run(pop, [&]{
-		mutex.fetch_sub(0b10);
-	});
+    uint64_t N::readVersionOrRestart(bool &needRestart) const {
+        uint64_t version;
+        version = lock().versionLockObsolete.load();
+        if (isLocked(version) || isObsolete(version)) {
+            needRestart = true;
+        }
+        return version;
+    }
 
-        needRestart = (startRead != typeVersionLockObsolete.load());
-        if (needRestart) return;
+    void N::readOptimisticUnlockOrRestart(uint64_t startRead, bool &needRestart) const {
+        needRestart = (startRead != lock().versionLockObsolete.load());
     }
 
     uint32_t N::getPrefixLength() const {
@@ -366,19 +451,16 @@ namespace ART_LC {
         return prefix;
     }
 
-    void N::setPrefix(pool_base &pop, const uint8_t *prefix, uint32_t length) {
-	transaction::run(pop, [&]{
-	        if (length > 0) {
-        	    memcpy(this->prefix, prefix, std::min(length, maxStoredPrefixLength));
-		    prefixCount = length;
-	        } else {
-        	    prefixCount = 0;
-        	}
-	});
+    void N::setPrefix(const uint8_t *prefix, uint32_t length) {
+        if (length > 0) {
+            memcpy(this->prefix, prefix, std::min(length, maxStoredPrefixLength));
+            prefixCount = length;
+        } else {
+            prefixCount = 0;
+        }
     }
 
-    void N::addPrefixBefore(pool_base &pop, N *node, uint8_t key) {
-	transaction::run(pop, [&]{
+    void N::addPrefixBefore(N *node, uint8_t key) {
         uint32_t prefixCopyCount = std::min(maxStoredPrefixLength, node->getPrefixLength() + 1);
         memmove(this->prefix + prefixCopyCount, this->prefix,
                 std::min(this->getPrefixLength(), maxStoredPrefixLength - prefixCopyCount));
@@ -387,7 +469,6 @@ namespace ART_LC {
             this->prefix[prefixCopyCount - 1] = key;
         }
         this->prefixCount += node->getPrefixLength() + 1;
-	});
     }
 
 
@@ -416,57 +497,69 @@ namespace ART_LC {
         }
     }
 
-    void N::deleteNode(pool_base &pop, N *node) {
-        if (N::isLeaf(node)) {
-            return;
+    void N::deleteNode(NodeAllocator &allocator, N *node) {
+        allocator.free(node);
+    }
+
+    std::size_t N::getSize(const N *node) {
+        switch (node->getType()) {
+            case NTypes::N4:
+                return sizeof(N4);
+            case NTypes::N16:
+                return sizeof(N16);
+            case NTypes::N48:
+                return sizeof(N48);
+            case NTypes::N256:
+                return sizeof(N256);
         }
+        assert(false);
+        __builtin_unreachable();
+    }
+
+    N *N::copyWithPrefix(pool_base &pop, NodeAllocator &allocator, const N *node, const uint8_t *prefix, uint32_t prefixLength) {
+        N *copy = nullptr;
         switch (node->getType()) {
             case NTypes::N4: {
-                auto n = static_cast<N4 *>(node);
-		transaction::run(pop, [&]{
-	                delete_persistent<N4>(n);
-		});
-                return;
+                auto n = allocator.allocate<N4>(prefix, prefixLength);
+                static_cast<const N4 *>(node)->copyTo(n);
+                copy = n;
+                break;
             }
             case NTypes::N16: {
-                auto n = static_cast<N16 *>(node);
-             	transaction::run(pop, [&]{
-			delete_persistent<N16>(n);
-		});
-                return;
+                auto n = allocator.allocate<N16>(prefix, prefixLength);
+                static_cast<const N16 *>(node)->copyTo(n);
+                copy = n;
+                break;
             }
             case NTypes::N48: {
-                auto n = static_cast<N48 *>(node);
-                transaction::run(pop, [&]{
-			delete_persistent<N48>(n);
-		});
-                return;
+                auto n = allocator.allocate<N48>(prefix, prefixLength);
+                static_cast<const N48 *>(node)->copyTo(n);
+                copy = n;
+                break;
             }
             case NTypes::N256: {
-                auto n = static_cast<N256 *>(node);
-                transaction::run(pop, [&]{
-			delete_persistent<N256>(n);
-		});
-                return;
+                auto n = allocator.allocate<N256>(prefix, prefixLength);
+                static_cast<const N256 *>(node)->copyTo(n);
+                copy = n;
+                break;
             }
         }
-	transaction::run(pop, [&]{
-	        delete_persistent<N>(node);
-	});
+        PersistStats::NodeScope nodeScope(static_cast<uint8_t>(copy->getType()));
+        persist(pop, copy, getSize(copy));
+        return copy;
     }
 
 
-    TID N::getAnyChildTid(N *n, bool &needRestart) {
-        N *nextNode = n;
+    TID N::getAnyChildTid(const N *n, bool &needRestart) {
+        const N *nextNode = n;
 
         while (true) {
-            N *node = nextNode;
-            auto v = node->typeVersionLockObsolete.load();
-//            auto v = node->readLockOrRestart(needRestart);
-//            if (needRestart) return 0;
+            const N *node = nextNode;
+            auto v = node->readOptimisticOrRestart(needRestart);
+            if (needRestart) return 0;
 
             nextNode = getAnyChild(node);
-            node->readUnlockOrRestart(v, needRestart);
+            node->readOptimisticUnlockOrRestart(v, needRestart);
             if (needRestart) return 0;
 
             assert(nextNode != nullptr);
@@ -476,27 +569,49 @@ namespace ART_LC {
         }
     }
 
-    uint64_t N::getChildren(N *node, uint8_t start, uint8_t end, std::tuple<uint8_t, N *> children[],
+    uint64_t N::getChildren(const N *node, uint8_t start, uint8_t end, std::tuple<uint8_t, N *> children[],
                         uint32_t &childrenCount) {
         switch (node->getType()) {
             case NTypes::N4: {
-                auto n = static_cast<N4 *>(node);
+                auto n = static_cast<const N4 *>(node);
                 return n->getChildren(start, end, children, childrenCount);
             }
             case NTypes::N16: {
-                auto n = static_cast<N16 *>(node);
+                auto n = static_cast<const N16 *>(node);
                 return n->getChildren(start, end, children, childrenCount);
             }
             case NTypes::N48: {
-                auto n = static_cast<N48 *>(node);
+                auto n = static_cast<const N48 *>(node);
                 return n->getChildren(start, end, children, childrenCount);
             }
             case NTypes::N256: {
-                auto n = static_cast<N256 *>(node);
+                auto n = static_cast<const N256 *>(node);
                 return n->getChildren(start, end, children, childrenCount);
             }
         }
         assert(false);
         __builtin_unreachable();
     }
+
+    void N::recover(pool_base &pop, N *node) {
+        switch (node->getType()) {
+            case NTypes::N4: {
+                static_cast<N4 *>(node)->recover(pop);
+                break;
+            }
+            case NTypes::N16: {
+                static_cast<N16 *>(node)->recover(pop);
+                break;
+            }
+            case NTypes::N48: {
+                static_cast<N48 *>(node)->recover(pop);
+                break;
+            }
+            case NTypes::N256: {
+                static_cast<N256 *>(node)->recover(pop);
+                break;
+            }
+        }
+        persist(pop, node, sizeof(N));
+    }
 }
@@ -6,7 +6,7 @@
 namespace ART_LC {
 
     bool N16::isFull() const {
-        return count == 16;
+        return compactCount == 16;
     }
 
     bool N16::isUnderfull() const {
@@ -14,105 +14,154 @@ namespace ART_LC {
     }
 
     void N16::insert(pool_base &pop, uint8_t key, N *n) {
-        uint8_t keyByteFlipped = flipSign(key);
-        __m128i cmp = _mm_cmplt_epi8(_mm_set1_epi8(keyByteFlipped), _mm_loadu_si128(reinterpret_cast<__m128i *>(keys)));
-        uint16_t bitfield = _mm_movemask_epi8(cmp) & (0xFFFF >> (16 - count));
-        unsigned pos = bitfield ? ctz(bitfield) : count;
-	transaction::run(pop, [&]{
-        memmove(keys + pos + 1, keys + pos, count - pos);
-        memmove(children + pos + 1, children + pos, (count - pos) * sizeof(uintptr_t));
-        keys[pos] = keyByteFlipped;
+        unsigned pos = compactCount;
+        keys[pos] = flipSign(key);
         children[pos] = n;
+        flush(pop, &keys[pos], sizeof(uint8_t));
+        flush(pop, &children[pos], sizeof(children[pos]));
+        fence(pop);
+        // the entry becomes visible with compactCount
+        compactCount++;
+        count++;
+        persistCount(pop);
+    }
+
+    void N16::insertMany(pool_base &pop, const uint8_t newKeys[], N *const vals[], unsigned n) {
+        unsigned pos = compactCount;
+        for (unsigned i = 0; i < n; ++i) {
+            keys[pos + i] = flipSign(newKeys[i]);
+            children[pos + i] = vals[i];
+        }
+        flush(pop, &keys[pos], n * sizeof(uint8_t));
+        flush(pop, &children[pos], n * sizeof(children[0]));
+        fence(pop);
+        compactCount += n;
+        count += n;
+        persistCount(pop);
+    }
+
+    void N16::insertUnpublished(uint8_t key, N *n) {
+        keys[compactCount] = flipSign(key);
+        children[compactCount] = n;
+        compactCount++;
         count++;
-	});
     }
 
     template<class NODE>
-    void N16::copyTo(NODE n) const {
-        for (unsigned i = 0; i < count; i++) {
-            n->insert(flipSign(keys[i]), children[i]);
+    void N16::copyTo(NODE *n, int exceptKey) const {
+        for (unsigned i = 0; i < compactCount; i++) {
+            N *child = children[i];
+            if (child != nullptr && flipSign(keys[i]) != exceptKey) {
+                n->insertUnpublished(flipSign(keys[i]), child);
+            }
         }
     }
 
     bool N16::change(pool_base &pop, uint8_t key, N *val) {
-        N **childPos = const_cast<N **>(getChildPos(key));
+        ChildPtr *childPos = getChildPos(key);
         assert(childPos != nullptr);
-	transaction::run(pop, [&]{
-	        *childPos = val;
-	});
+        publish(*childPos, val);
+        persistPublished(pop, childPos, sizeof(*childPos));
         return true;
     }
 
-    N *const *N16::getChildPos(const uint8_t k) const {
+    ChildPtr *N16::getChildPos(const uint8_t k) {
         __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(flipSign(k)),
                                      _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys)));
-        unsigned bitfield = _mm_movemask_epi8(cmp) & ((1 << count) - 1);
-        if (bitfield) {
-            return &children[ctz(bitfield)];
-        } else {
-            return nullptr;
+        unsigned bitfield = _mm_movemask_epi8(cmp) & ((1 << compactCount) - 1);
+        while (bitfield) {
+            uint8_t pos = ctz(bitfield);
+
+            if (children[pos] != nullptr) {
+                return &children[pos];
+            }
+            bitfield = bitfield ^ (1 << pos);
         }
+        return nullptr;
     }
 
     N *N16::getChild(const uint8_t k) const {
-        N *const *childPos = getChildPos(k);
-        if (childPos == nullptr) {
-            return nullptr;
-        } else {
-            return *childPos;
+        __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(flipSign(k)),
+                                     _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys)));
+        unsigned bitfield = _mm_movemask_epi8(cmp) & ((1 << compactCount) - 1);
+        while (bitfield) {
+            uint8_t pos = ctz(bitfield);
+
+            N *child = children[pos];
+            if (child != nullptr) {
+                return child;
+            }
+            bitfield = bitfield ^ (1 << pos);
         }
+        return nullptr;
     }
 
     void N16::remove(pool_base &pop, uint8_t k) {
-        N *const *leafPlace = getChildPos(k);
+        ChildPtr *leafPlace = getChildPos(k);
         assert(leafPlace != nullptr);
-        std::size_t pos = leafPlace - children;
-	transaction::run(pop, [&]{
-        memmove(keys + pos, keys + pos + 1, count - pos - 1);
-        memmove(children + pos, children + pos + 1, (count - pos - 1) * sizeof(N *));
+        publish(*leafPlace, nullptr);
         count--;
-	});
+        flushPublished(pop, leafPlace, sizeof(*leafPlace));
+        persistCount(pop);
         assert(getChild(k) == nullptr);
     }
 
-    N *N16::getAnyChild() {
-        for (int i = 0; i < count; ++i) {
-            if (N::isLeaf(children[i])) {
-                return children[i];
+    N *N16::getAnyChild() const {
+        N *anyChild = nullptr;
+        for (int i = 0; i < compactCount; ++i) {
+            N *child = children[i];
+            if (child != nullptr) {
+                if (N::isLeaf(child)) {
+                    return child;
+                }
+                anyChild = child;
             }
         }
-        return children[0];
+        return anyChild;
     }
 
-    void N16::deleteChildren() {
-        for (std::size_t i = 0; i < count; ++i) {
-            N::deleteChildren(children[i]);
-            N::deleteNode(children[i]);
+    void N16::deleteChildren(NodeAllocator &allocator) {
+        for (std::size_t i = 0; i < compactCount; ++i) {
+            N *child = children[i];
+            if (child != nullptr) {
+                N::deleteChildren(allocator, child);
+                N::deleteNode(allocator, child);
+            }
         }
     }
 
     uint64_t N16::getChildren(uint8_t start, uint8_t end, std::tuple<uint8_t, N *> *&children,
-                          uint32_t &childrenCount) {
+                          uint32_t &childrenCount) const {
         restart:
         bool needRestart = false;
         uint64_t v;
-        v = readLockOrRestart(needRestart);
+        v = readOptimisticOrRestart(needRestart);
         if (needRestart) goto restart;
         childrenCount = 0;
-        auto startPos = getChildPos(start);
-        auto endPos = getChildPos(end);
-        if (startPos == nullptr) {
-            startPos = this->children;
-        }
-        if (endPos == nullptr) {
-            endPos = this->children + (count - 1);
-        }
-        for (auto p = startPos; p <= endPos; ++p) {
-            children[childrenCount] = std::make_tuple(flipSign(keys[p - this->children]), *p);
-            childrenCount++;
+        for (int i = 0; i < compactCount; ++i) {
+            uint8_t key = flipSign(this->keys[i]);
+            if (key >= start && key <= end) {
+                N *child = this->children[i];
+                if (child != nullptr) {
+                    children[childrenCount] = std::make_tuple(key, child);
+                    childrenCount++;
+                }
+            }
         }
-        readUnlockOrRestart(v, needRestart);
+        readOptimisticUnlockOrRestart(v, needRestart);
         if (needRestart) goto restart;
+        std::sort(children, children + childrenCount, [](auto &first, auto &second) {
+            return std::get<0>(first) < std::get<0>(second);
+        });
         return v;
     }
+
+    void N16::recover(pool_base &) {
+        count = 0;
+        for (unsigned i = 0; i < compactCount; ++i) {
+            if (children[i] != nullptr) {
+                count++;
+            }
+        }
+    }
 }
@@ -12,35 +12,51 @@ namespace ART_LC {
         return count == 37;
     }
 
-    void N256::deleteChildren() {
+    void N256::deleteChildren(NodeAllocator &allocator) {
         for (uint64_t i = 0; i < 256; ++i) {
-            if (children[i] != nullptr) {
-                N::deleteChildren(children[i]);
-                N::deleteNode(children[i]);
+            N *child = children[i];
+            if (child != nullptr) {
+                N::deleteChildren(allocator, child);
+                N::deleteNode(allocator, child);
             }
         }
     }
 
     void N256::insert(pool_base &pop, uint8_t key, N *val) {
-	transaction::run(pop, [&]{
-	        children[key] = val;
-        	count++;
-	});
+        // the entry becomes visible with the pointer itself
+        publish(children[key], val);
+        count++;
+        flushPublished(pop, &children[key], sizeof(children[key]));
+        persistCount(pop);
+    }
+
+    void N256::insertMany(pool_base &pop, const uint8_t newKeys[], N *const vals[], unsigned n) {
+        for (unsigned i = 0; i < n; ++i) {
+            publish(children[newKeys[i]], vals[i]);
+            flushPublished(pop, &children[newKeys[i]], sizeof(children[0]));
+        }
+        count += n;
+        persistCount(pop);
+    }
+
+    void N256::insertUnpublished(uint8_t key, N *val) {
+        children[key] = val;
+        count++;
     }
 
     template<class NODE>
-    void N256::copyTo(NODE n) const {
+    void N256::copyTo(NODE *n, int exceptKey) const {
         for (int i = 0; i < 256; ++i) {
-            if (children[i] != nullptr) {
-                n->insert(i, children[i]);
+            N *child = children[i];
+            if (child != nullptr && i != exceptKey) {
+                n->insertUnpublished(i, child);
             }
         }
     }
 
     bool N256::change(pool_base &pop, uint8_t key, N *n) {
-	transaction::run(pop, [&]{
-	        children[key] = n;
-	});
+        publish(children[key], n);
+        persistPublished(pop, &children[key], sizeof(children[key]));
         return true;
     }
 
@@ -49,20 +65,21 @@ namespace ART_LC {
     }
 
     void N256::remove(pool_base &pop, uint8_t k) {
-	transaction::run(pop, [&]{
-	        children[k] = nullptr;
-        	count--;
-	});
+        publish(children[k], nullptr);
+        count--;
+        flushPublished(pop, &children[k], sizeof(children[k]));
+        persistCount(pop);
     }
 
-    N *N256::getAnyChild() {
+    N *N256::getAnyChild() const {
         N *anyChild = nullptr;
         for (uint64_t i = 0; i < 256; ++i) {
-            if (children[i] != nullptr) {
-                if (N::isLeaf(children[i])) {
-                    return children[i];
+            N *child = children[i];
+            if (child != nullptr) {
+                if (N::isLeaf(child)) {
+                    return child;
                 } else {
-                    anyChild = children[i];
+                    anyChild = child;
                 }
             }
         }
@@ -70,21 +87,31 @@ namespace ART_LC {
     }
 
     uint64_t N256::getChildren(uint8_t start, uint8_t end, std::tuple<uint8_t, N *> *&children,
-                           uint32_t &childrenCount) {
+                           uint32_t &childrenCount) const {
         restart:
         bool needRestart = false;
         uint64_t v;
-        v = readLockOrRestart(needRestart);
+        v = readOptimisticOrRestart(needRestart);
         if (needRestart) goto restart;
         childrenCount = 0;
         for (unsigned i = start; i <= end; i++) {
-            if (this->children[i] != nullptr) {
-                children[childrenCount] = std::make_tuple(i, this->children[i]);
+            N *child = this->children[i];
+            if (child != nullptr) {
+                children[childrenCount] = std::make_tuple(i, child);
                 childrenCount++;
             }
         }
-        readUnlockOrRestart(v, needRestart);
+        readOptimisticUnlockOrRestart(v, needRestart);
         if (needRestart) goto restart;
         return v;
     }
+
+    void N256::recover(pool_base &) {
+        count = 0;
+        for (unsigned i = 0; i < 256; ++i) {
+            if (children[i] != nullptr) {
+                count++;
+            }
+        }
+    }
 }
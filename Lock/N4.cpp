@@ -4,15 +4,18 @@
 
 namespace ART_LC {
 
-    void N4::deleteChildren() {
-        for (uint32_t i = 0; i < count; ++i) {
-            N::deleteChildren(children[i]);
-            N::deleteNode(children[i]);
+    void N4::deleteChildren(NodeAllocator &allocator) {
+        for (uint32_t i = 0; i < compactCount; ++i) {
+            N *child = children[i];
+            if (child != nullptr) {
+                N::deleteChildren(allocator, child);
+                N::deleteNode(allocator, child);
+            }
         }
     }
 
     bool N4::isFull() const {
-        return count == 4;
+        return compactCount == 4;
     }
 
     bool N4::isUnderfull() const {
@@ -20,30 +23,55 @@ namespace ART_LC {
     }
 
     void N4::insert(pool_base &pop, uint8_t key, N *n) {
-        unsigned pos;
-        for (pos = 0; (pos < count) && (keys[pos] < key); pos++);
-	transaction::run(pop, [&]{
-        memmove(keys + pos + 1, keys + pos, count - pos);
-        memmove(children + pos + 1, children + pos, (count - pos) * sizeof(N*));
+        unsigned pos = compactCount;
         keys[pos] = key;
         children[pos] = n;
+        flush(pop, &keys[pos], sizeof(uint8_t));
+        flush(pop, &children[pos], sizeof(children[pos]));
+        fence(pop);
+        // the entry becomes visible with compactCount
+        compactCount++;
+        count++;
+        persistCount(pop);
+    }
+
+    void N4::insertMany(pool_base &pop, const uint8_t newKeys[], N *const vals[], unsigned n) {
+        unsigned pos = compactCount;
+        for (unsigned i = 0; i < n; ++i) {
+            keys[pos + i] = newKeys[i];
+            children[pos + i] = vals[i];
+        }
+        flush(pop, &keys[pos], n * sizeof(uint8_t));
+        flush(pop, &children[pos], n * sizeof(children[0]));
+        fence(pop);
+        compactCount += n;
+        count += n;
+        persistCount(pop);
+    }
+
+    void N4::insertUnpublished(uint8_t key, N *n) {
+        keys[compactCount] = key;
+        children[compactCount] = n;
+        compactCount++;
         count++;
-	});
     }
 
     template<class NODE>
-    void N4::copyTo(pool_base &pop, NODE n) const {
-        for (uint32_t i = 0; i < count; ++i) {
-            n->insert(pop, keys[i], children[i]);
+    void N4::copyTo(NODE *n, int exceptKey) const {
+        for (uint32_t i = 0; i < compactCount; ++i) {
+            N *child = children[i];
+            if (child != nullptr && keys[i] != exceptKey) {
+                n->insertUnpublished(keys[i], child);
+            }
         }
     }
 
     bool N4::change(pool_base &pop, uint8_t key, N *val) {
-        for (uint32_t i = 0; i < count; ++i) {
-            if (keys[i] == key) {
-		transaction::run(pop, [&]{
-	                children[i] = val;
-		});
+        for (uint32_t i = 0; i < compactCount; ++i) {
+            N *child = children[i];
+            if (child != nullptr && keys[i] == key) {
+                publish(children[i], val);
+                persistPublished(pop, &children[i], sizeof(children[i]));
                 return true;
             }
         }
@@ -52,64 +80,83 @@ namespace ART_LC {
     }
 
     N *N4::getChild(const uint8_t k) const {
-        for (uint32_t i = 0; i < count; ++i) {
-            if (keys[i] == k) {
-                return children[i];
+        for (uint32_t i = 0; i < compactCount; ++i) {
+            N *child = children[i];
+            if (child != nullptr && keys[i] == k) {
+                return child;
             }
         }
         return nullptr;
     }
 
     void N4::remove(pool_base &pop, uint8_t k) {
-        for (uint32_t i = 0; i < count; ++i) {
-            if (keys[i] == k) {
-		transaction::run(pop, [&]{
-                memmove(keys + i, keys + i + 1, count - i - 1);
-                memmove(children + i, children + i + 1, (count - i - 1) * sizeof(N *));
+        for (uint32_t i = 0; i < compactCount; ++i) {
+            N *child = children[i];
+            if (child != nullptr && keys[i] == k) {
+                publish(children[i], nullptr);
                 count--;
-		});
+                flushPublished(pop, &children[i], sizeof(children[i]));
+                persistCount(pop);
                 return;
             }
         }
     }
 
-    N *N4::getAnyChild() {
+    N *N4::getAnyChild() const {
         N *anyChild = nullptr;
-        for (uint32_t i = 0; i < count; ++i) {
-            if (N::isLeaf(children[i])) {
-                return children[i];
-            } else {
-                anyChild = children[i];
+        for (uint32_t i = 0; i < compactCount; ++i) {
+            N *child = children[i];
+            if (child != nullptr) {
+                if (N::isLeaf(child)) {
+                    return child;
+                }
+                anyChild = child;
             }
         }
         return anyChild;
     }
 
     std::tuple<N *, uint8_t> N4::getSecondChild(const uint8_t key) const {
-        for (uint32_t i = 0; i < count; ++i) {
-            if (keys[i] != key) {
-                return std::make_tuple(children[i], keys[i]);
+        for (uint32_t i = 0; i < compactCount; ++i) {
+            N *child = children[i];
+            if (child != nullptr && keys[i] != key) {
+                return std::make_tuple(child, keys[i]);
             }
         }
         return std::make_tuple(nullptr, 0);
     }
 
     uint64_t N4::getChildren(uint8_t start, uint8_t end, std::tuple<uint8_t, N *> *&children,
-                         uint32_t &childrenCount) {
+                         uint32_t &childrenCount) const {
         restart:
         bool needRestart = false;
         uint64_t v;
-        v = readLockOrRestart(needRestart);
+        v = readOptimisticOrRestart(needRestart);
         if (needRestart) goto restart;
         childrenCount = 0;
-        for (uint32_t i = 0; i < count; ++i) {
+        for (uint32_t i = 0; i < compactCount; ++i) {
             if (this->keys[i] >= start && this->keys[i] <= end) {
-                children[childrenCount] = std::make_tuple(this->keys[i], this->children[i]);
-                childrenCount++;
+                N *child = this->children[i];
+                if (child != nullptr) {
+                    children[childrenCount] = std::make_tuple(this->keys[i], child);
+                    childrenCount++;
+                }
             }
         }
-        readUnlockOrRestart(v, needRestart);
+        readOptimisticUnlockOrRestart(v, needRestart);
         if (needRestart) goto restart;
+        std::sort(children, children + childrenCount, [](auto &first, auto &second) {
+            return std::get<0>(first) < std::get<0>(second);
+        });
         return v;
     }
+
+    void N4::recover(pool_base &) {
+        count = 0;
+        for (uint32_t i = 0; i < compactCount; ++i) {
+            if (children[i] != nullptr) {
+                count++;
+            }
+        }
+    }
 }
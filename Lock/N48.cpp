@@ -5,7 +5,7 @@
 namespace ART_LC {
 
     bool N48::isFull() const {
-        return count == 48;
+        return compactCount == 48;
     }
 
     bool N48::isUnderfull() const {
@@ -13,30 +13,60 @@ namespace ART_LC {
     }
 
     void N48::insert(pool_base &pop, uint8_t key, N *n) {
-        unsigned pos = count;
-        if (children[pos]) {
-            for (pos = 0; children[pos] != nullptr; pos++);
-        }
-	transaction::run(pop, [&]{
+        unsigned pos = compactCount;
         children[pos] = n;
+        flush(pop, &children[pos], sizeof(children[pos]));
+        // reserve the slot before it is referenced, a crash in between only leaves an unused slot
+        compactCount++;
+        flush(pop, &compactCount, sizeof(uint8_t));
+        fence(pop);
+        // the entry becomes visible with childIndex
         childIndex[key] = (uint8_t) pos;
         count++;
-	});
+        flushPublished(pop, &childIndex[key], sizeof(uint8_t));
+        persistCount(pop);
+    }
+
+    void N48::insertMany(pool_base &pop, const uint8_t newKeys[], N *const vals[], unsigned n) {
+        unsigned pos = compactCount;
+        for (unsigned i = 0; i < n; ++i) {
+            children[pos + i] = vals[i];
+        }
+        flush(pop, &children[pos], n * sizeof(children[0]));
+        compactCount += n;
+        flush(pop, &compactCount, sizeof(uint8_t));
+        fence(pop);
+        for (unsigned i = 0; i < n; ++i) {
+            childIndex[newKeys[i]] = (uint8_t) (pos + i);
+            flushPublished(pop, &childIndex[newKeys[i]], sizeof(uint8_t));
+        }
+        count += n;
+        persistCount(pop);
+    }
+
+    void N48::insertUnpublished(uint8_t key, N *n) {
+        children[compactCount] = n;
+        childIndex[key] = compactCount;
+        compactCount++;
+        count++;
     }
 
     template<class NODE>
-    void N48::copyTo(NODE n) const {
-        for (unsigned i = 0; i < 256; i++) {
-            if (childIndex[i] != emptyMarker) {
-                n->insert(i, children[childIndex[i]]);
+    void N48::copyTo(NODE *n, int exceptKey) const {
+        for (int i = 0; i < 256; i++) {
+            if (childIndex[i] != emptyMarker && i != exceptKey) {
+                N *child = children[childIndex[i]];
+                if (child != nullptr) {
+                    n->insertUnpublished(i, child);
+                }
             }
         }
     }
 
     bool N48::change(pool_base &pop, uint8_t key, N *val) {
-	transaction::run(pop, [&]{
-        	children[childIndex[key]] = val;
-	});
+        ChildPtr &childPos = children[childIndex[key]];
+        publish(childPos, val);
+        persistPublished(pop, &childPos, sizeof(childPos));
         return true;
     }
 
@@ -50,53 +80,90 @@ namespace ART_LC {
 
     void N48::remove(pool_base &pop, uint8_t k) {
         assert(childIndex[k] != emptyMarker);
-	transaction::run(pop, [&]{
-	        children[childIndex[k]] = nullptr;
-        	childIndex[k] = emptyMarker;
-        	count--;
-	});
+        uint8_t pos = childIndex[k];
+        childIndex[k] = emptyMarker;
+        publish(children[pos], nullptr);
+        count--;
+        flushPublished(pop, &childIndex[k], sizeof(uint8_t));
+        flushPublished(pop, &children[pos], sizeof(children[pos]));
+        persistCount(pop);
         assert(getChild(k) == nullptr);
     }
 
-    N *N48::getAnyChild() {
+    N *N48::getAnyChild() const {
         N *anyChild = nullptr;
         for (unsigned i = 0; i < 256; i++) {
             if (childIndex[i] != emptyMarker) {
-                if (N::isLeaf(children[childIndex[i]])) {
-                    return children[childIndex[i]];
+                N *child = children[childIndex[i]];
+                if (child == nullptr) {
+                    continue;
+                }
+                if (N::isLeaf(child)) {
+                    return child;
                 } else {
-                    anyChild = children[childIndex[i]];
+                    anyChild = child;
                 };
             }
         }
         return anyChild;
     }
 
-    void N48::deleteChildren() {
+    void N48::deleteChildren(NodeAllocator &allocator) {
         for (unsigned i = 0; i < 256; i++) {
             if (childIndex[i] != emptyMarker) {
-                N::deleteChildren(children[childIndex[i]]);
-                N::deleteNode(children[childIndex[i]]);
+                N *child = children[childIndex[i]];
+                if (child != nullptr) {
+                    N::deleteChildren(allocator, child);
+                    N::deleteNode(allocator, child);
+                }
             }
         }
     }
 
     uint64_t N48::getChildren(uint8_t start, uint8_t end, std::tuple<uint8_t, N *> *&children,
-                          uint32_t &childrenCount) {
+                          uint32_t &childrenCount) const {
         restart:
         bool needRestart = false;
         uint64_t v;
-        v = readLockOrRestart(needRestart);
+        v = readOptimisticOrRestart(needRestart);
         if (needRestart) goto restart;
         childrenCount = 0;
         for (unsigned i = start; i <= end; i++) {
             if (this->childIndex[i] != emptyMarker) {
-                children[childrenCount] = std::make_tuple(i, this->children[this->childIndex[i]]);
-                childrenCount++;
+                N *child = this->children[this->childIndex[i]];
+                if (child != nullptr) {
+                    children[childrenCount] = std::make_tuple(i, child);
+                    childrenCount++;
+                }
             }
         }
-        readUnlockOrRestart(v, needRestart);
+        readOptimisticUnlockOrRestart(v, needRestart);
         if (needRestart) goto restart;
         return v;
     }
+
+    void N48::recover(pool_base &pop) {
+        bool referenced[48] = {};
+        count = 0;
+        for (unsigned i = 0; i < 256; i++) {
+            if (childIndex[i] == emptyMarker) {
+                continue;
+            }
+            // remove persisted the null child but not the index entry
+            if (childIndex[i] >= compactCount || children[childIndex[i]] == nullptr) {
+                childIndex[i] = emptyMarker;
+                continue;
+            }
+            referenced[childIndex[i]] = true;
+            count++;
+        }
+        // insert reserved the slot but crashed before the entry became visible in childIndex
+        for (unsigned i = 0; i < compactCount; i++) {
+            if (!referenced[i] && children[i] != nullptr) {
+                publish(children[i], nullptr);
+            }
+        }
+        flush(pop, childIndex, sizeof(childIndex));
+        flush(pop, children, sizeof(children));
+    }
 }
@@ -0,0 +1,229 @@
+#include <assert.h>
+#include <algorithm>
+#include <new>
+
+#include "Include/NodeAllocator.h"
+
+namespace ART_LC {
+
+    // the slots start on their own cache line behind the slab header
+    static constexpr std::size_t slabHeaderSize = 64;
+
+    std::size_t NodeSlab::getSlotSize(NTypes type) {
+        std::size_t size = 0;
+        switch (type) {
+            case NTypes::N4:
+                size = sizeof(N4);
+                break;
+            case NTypes::N16:
+                size = sizeof(N16);
+                break;
+            case NTypes::N48:
+                size = sizeof(N48);
+                break;
+            case NTypes::N256:
+                size = sizeof(N256);
+                break;
+        }
+        return (size + 63) & ~static_cast<std::size_t>(63);
+    }
+
+    std::size_t NodeSlab::getSize(NTypes type) {
+        return slabHeaderSize + slotCount * getSlotSize(type);
+    }
+
+    void *NodeSlab::getSlot(unsigned pos) {
+        return reinterpret_cast<uint8_t *>(this) + slabHeaderSize + pos * getSlotSize(static_cast<NTypes>(type));
+    }
+
+    bool NodeSlab::contains(const void *node) const {
+        auto begin = reinterpret_cast<const uint8_t *>(this) + slabHeaderSize;
+        auto n = static_cast<const uint8_t *>(node);
+        return n >= begin && n < begin + slotCount * getSlotSize(static_cast<NTypes>(type));
+    }
+
+    unsigned NodeSlab::getPos(const void *node) const {
+        auto begin = reinterpret_cast<const uint8_t *>(this) + slabHeaderSize;
+        return (static_cast<const uint8_t *>(node) - begin) / getSlotSize(static_cast<NTypes>(type));
+    }
+
+    NodeAllocator::NodeAllocator(pool_base &pop, persistent_ptr<NodeSlab> &slabs) : pop(pop), slabs(slabs) {
+        reclaimRetired();
+        collectSlabs();
+    }
+
+    void NodeAllocator::reclaimRetired() {
+        for (NodeSlab *slab = slabs.get(); slab != nullptr; slab = slab->next.get()) {
+            if (slab->retired != 0) {
+                slab->bitmap &= ~slab->retired;
+                slab->retired = 0;
+                flush(pop, slab, sizeof(NodeSlab));
+            }
+        }
+        fence(pop);
+    }
+
+    void NodeAllocator::collectSlabs() {
+        allSlabs.clear();
+        for (auto &partial : partialSlabs) {
+            partial.clear();
+        }
+        tail = nullptr;
+        for (NodeSlab *slab = slabs.get(); slab != nullptr; slab = slab->next.get()) {
+            // the lock table may still hold state of a pool which was mapped at the same address before
+            for (unsigned pos = 0; pos < NodeSlab::slotCount; ++pos) {
+                LockTable::get(slab->getSlot(pos)).reset();
+            }
+            allSlabs.push_back(slab);
+            if (slab->bitmap != ~static_cast<uint64_t>(0)) {
+                partialSlabs[slab->type].push_back(slab);
+            }
+            tail = slab;
+        }
+        std::sort(allSlabs.begin(), allSlabs.end());
+    }
+
+    int NodeAllocator::constructSlab(PMEMobjpool *pop, void *ptr, void *arg) {
+        auto slab = static_cast<NodeSlab *>(ptr);
+        slab->bitmap = 0;
+        slab->retired = 0;
+        slab->type = static_cast<uint64_t>(*static_cast<NTypes *>(arg));
+        memset(slab->next.raw_ptr(), 0, sizeof(PMEMoid));
+        pool_base p(pop);
+        persist(p, slab, sizeof(NodeSlab));
+        return 0;
+    }
+
+    NodeSlab *NodeAllocator::takeSlab(NTypes type) {
+        std::lock_guard<std::mutex> guard(slabsMutex);
+        auto &partial = partialSlabs[static_cast<unsigned>(type)];
+        if (!partial.empty()) {
+            NodeSlab *slab = partial.back();
+            partial.pop_back();
+            return slab;
+        }
+        // allocated directly into the list, a crash cannot lose the slab
+        persistent_ptr<NodeSlab> &next = tail == nullptr ? slabs : tail->next;
+        if (pmemobj_alloc(pop.handle(), next.raw_ptr(), NodeSlab::getSize(type), NodeSlab::typeNum,
+                          constructSlab, &type) != 0) {
+            throw std::bad_alloc();
+        }
+        PersistStats::onAllocation(NodeSlab::getSize(type));
+        tail = next.get();
+        allSlabs.insert(std::upper_bound(allSlabs.begin(), allSlabs.end(), tail), tail);
+        return tail;
+    }
+
+    NodeSlab *NodeAllocator::findSlab(const void *node) const {
+        auto it = std::upper_bound(allSlabs.begin(), allSlabs.end(), node, [](const void *n, const NodeSlab *slab) {
+            return n < static_cast<const void *>(slab);
+        });
+        if (it == allSlabs.begin() || !(*(it - 1))->contains(node)) {
+            return nullptr;
+        }
+        return *(it - 1);
+    }
+
+    void *NodeAllocator::allocate(NTypes type) {
+        PersistStats::NodeScope nodeScope(PersistStats::noNodeType);
+        NodeSlab *&slab = caches.local().current[static_cast<unsigned>(type)];
+        while (true) {
+            if (slab == nullptr) {
+                slab = takeSlab(type);
+            }
+            uint64_t bits = __atomic_load_n(&slab->bitmap, __ATOMIC_ACQUIRE);
+            while (bits != ~static_cast<uint64_t>(0)) {
+                unsigned pos = __builtin_ctzll(~bits);
+                if (__atomic_compare_exchange_n(&slab->bitmap, &bits, bits | (static_cast<uint64_t>(1) << pos), false,
+                                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                    flush(pop, &slab->bitmap, sizeof(uint64_t));
+                    return slab->getSlot(pos);
+                }
+            }
+            slab = nullptr;
+        }
+    }
+
+    void NodeAllocator::free(N *node) {
+        void *nodes[] = {node};
+        free(nodes, 1);
+    }
+
+    void NodeAllocator::retire(void *node) {
+        if (N::isLeaf(static_cast<N *>(node))) {
+            // KeyLeaf objects have no limbo list, one lost by a crash is found by the recovery pass of the tree
+            return;
+        }
+        PersistStats::NodeScope nodeScope(PersistStats::noNodeType);
+        NodeSlab *slab;
+        {
+            std::lock_guard<std::mutex> guard(slabsMutex);
+            slab = findSlab(node);
+        }
+        assert(slab != nullptr);
+        __atomic_fetch_or(&slab->retired, static_cast<uint64_t>(1) << slab->getPos(node), __ATOMIC_RELEASE);
+        // becomes durable with the next fence, until then a crash only leaks the slot
+        flush(pop, &slab->retired, sizeof(uint64_t));
+    }
+
+    void NodeAllocator::free(void *const nodes[], std::size_t count) {
+        PersistStats::NodeScope nodeScope(PersistStats::noNodeType);
+        // the unlinks of these nodes have to be durable before their memory can be handed out again
+        persistDeferred();
+        {
+            // allSlabs grows concurrently in takeSlab
+            std::lock_guard<std::mutex> guard(slabsMutex);
+            for (std::size_t i = 0; i < count; ++i) {
+                if (N::isLeaf(static_cast<N *>(nodes[i]))) {
+                    freeLeaf(N::getLeaf(static_cast<N *>(nodes[i])));
+                    continue;
+                }
+                NodeSlab *slab = findSlab(nodes[i]);
+                assert(slab != nullptr);
+                uint64_t bit = static_cast<uint64_t>(1) << slab->getPos(nodes[i]);
+                // the slot is free before it leaves the limbo list, a crash in between is resolved by reclaimRetired
+                uint64_t bits = __atomic_fetch_and(&slab->bitmap, ~bit, __ATOMIC_ACQ_REL);
+                __atomic_fetch_and(&slab->retired, ~bit, __ATOMIC_RELEASE);
+                flush(pop, slab, sizeof(NodeSlab));
+                if (bits == ~static_cast<uint64_t>(0)) {
+                    partialSlabs[slab->type].push_back(slab);
+                }
+            }
+        }
+        fence(pop);
+    }
+
+    void NodeAllocator::freeLeaf(uint64_t offset) {
+        PMEMoid oid = pmemobj_oid(reinterpret_cast<uint8_t *>(pop.handle()) + offset);
+        pmemobj_free(&oid);
+    }
+
+    void NodeAllocator::beginRecovery() {
+        reachable.reset(new std::atomic<uint64_t>[allSlabs.size()]);
+        for (std::size_t i = 0; i < allSlabs.size(); ++i) {
+            reachable[i].store(0);
+        }
+    }
+
+    void NodeAllocator::markReachable(const N *node) {
+        // no slabs are added during recovery, allSlabs can be searched without the lock
+        NodeSlab *slab = findSlab(node);
+        if (slab == nullptr) {
+            // the root is not allocated from a slab
+            return;
+        }
+        auto i = std::lower_bound(allSlabs.begin(), allSlabs.end(), slab) - allSlabs.begin();
+        reachable[i].fetch_or(static_cast<uint64_t>(1) << slab->getPos(node));
+    }
+
+    void NodeAllocator::endRecovery() {
+        for (std::size_t i = 0; i < allSlabs.size(); ++i) {
+            allSlabs[i]->bitmap = reachable[i].load();
+            allSlabs[i]->retired = 0;
+            flush(pop, allSlabs[i], sizeof(NodeSlab));
+        }
+        fence(pop);
+        reachable.reset();
+        collectSlabs();
+    }
+}
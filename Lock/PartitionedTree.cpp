@@ -0,0 +1,139 @@
+#include <assert.h>
+#include <pthread.h>
+#include <fstream>
+#include <stdexcept>
+
+#include "Include/PartitionedTree.h"
+#include "Include/PoolSet.h"
+
+namespace ART_LC {
+
+    void PartitionedTree::readNodeCpus(int numaNode, cpu_set_t &cpus) {
+        CPU_ZERO(&cpus);
+        // e.g. "0-13,28-41"
+        std::ifstream list("/sys/devices/system/node/node" + std::to_string(numaNode) + "/cpulist");
+        std::string range;
+        while (std::getline(list, range, ',')) {
+            std::size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        if (CPU_COUNT(&cpus) == 0) {
+            throw std::runtime_error("ART_LC: no CPUs found for NUMA node " + std::to_string(numaNode));
+        }
+    }
+
+    PartitionedTree::PartitionedTree(const std::vector<PartitionConfig> &configs, Tree::LoadKeyFunction loadKey,
+                                     LeafType leafType) {
+        if (configs.empty() || configs.size() > 256) {
+            throw std::runtime_error("ART_LC: a partitioned tree needs between 1 and 256 partitions");
+        }
+        for (unsigned byte = 0; byte < 256; ++byte) {
+            route[byte] = static_cast<uint8_t>(byte * configs.size() / 256);
+        }
+        for (const PartitionConfig &config : configs) {
+            std::unique_ptr<Partition> p(new Partition());
+            p->bound = config.numaNode >= 0;
+            if (p->bound) {
+                readNodeCpus(config.numaNode, p->cpus);
+            }
+            p->pop = openGrowingPool(config.poolDir);
+            p->tree.reset(new Tree(p->pop, loadKey, leafType));
+            partitions.push_back(std::move(p));
+        }
+
+        // keys outside the first bytes of a partition mean the pools were opened in another configuration
+        auto t = getThreadInfo();
+        for (unsigned i = 0; i < partitions.size(); ++i) {
+            unsigned first = 0;
+            while (route[first] != i) {
+                first++;
+            }
+            unsigned last = first;
+            while (last < 255 && route[last + 1] == i) {
+                last++;
+            }
+            std::vector<std::pair<uint8_t, uint8_t>> foreign;
+            if (first > 0) {
+                foreign.emplace_back(0, first - 1);
+            }
+            if (last < 255) {
+                foreign.emplace_back(last + 1, 255);
+            }
+            for (auto &range : foreign) {
+                // one byte keys, the scan extends start with 0 and end with 255
+                Key start, end, continueKey;
+                start.set(reinterpret_cast<const char *>(&range.first), 1);
+                end.set(reinterpret_cast<const char *>(&range.second), 1);
+                std::size_t found = 0;
+                if (partitions[i]->tree->lookupRange(partitions[i]->pop, start, end, continueKey, nullptr, 0, found,
+                                                     t.infos[i])) {
+                    throw std::runtime_error("ART_LC: pool " + configs[i].poolDir +
+                                             " holds keys of another partition");
+                }
+            }
+        }
+    }
+
+    PartitionedTree::~PartitionedTree() {
+        for (auto &p : partitions) {
+            p->tree.reset();
+            p->pop.close();
+        }
+    }
+
+    void PartitionedTree::bindThread(unsigned partition) const {
+        const Partition &p = *partitions[partition];
+        if (p.bound && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &p.cpus) != 0) {
+            throw std::runtime_error("ART_LC: cannot bind thread to the node of partition " + std::to_string(partition));
+        }
+    }
+
+    PartitionedTree::ThreadInfo PartitionedTree::getThreadInfo() {
+        ThreadInfo info;
+        // copies of ART::ThreadInfo leave the epoche when destroyed, the vector must not reallocate
+        info.infos.reserve(partitions.size());
+        for (auto &p : partitions) {
+            info.infos.push_back(p->tree->getThreadInfo());
+        }
+        return info;
+    }
+
+    TID PartitionedTree::lookup(const Key &k, ThreadInfo &threadInfo) const {
+        unsigned i = getPartition(k);
+        return partitions[i]->tree->lookup(partitions[i]->pop, k, threadInfo.infos[i]);
+    }
+
+    bool PartitionedTree::lookupRange(const Key &start, const Key &end, Key &continueKey, TID result[],
+                                      std::size_t resultLen, std::size_t &resultCount, ThreadInfo &threadInfo) const {
+        resultCount = 0;
+        if (getPartition(start) > getPartition(end)) {
+            return false;
+        }
+        // all keys of a partition are between the ones of its neighbours, start and end bound every partition
+        for (unsigned i = getPartition(start); i <= getPartition(end); ++i) {
+            std::size_t found = 0;
+            // a full result still scans the next partition for the key to continue at
+            if (partitions[i]->tree->lookupRange(partitions[i]->pop, start, end, continueKey, result + resultCount,
+                                                 resultLen - resultCount, found, threadInfo.infos[i])) {
+                resultCount += found;
+                return true;
+            }
+            resultCount += found;
+        }
+        return false;
+    }
+
+    void PartitionedTree::insert(const Key &k, TID tid, ThreadInfo &threadInfo) {
+        unsigned i = getPartition(k);
+        partitions[i]->tree->insert(partitions[i]->pop, k, tid, threadInfo.infos[i]);
+    }
+
+    void PartitionedTree::remove(const Key &k, TID tid, ThreadInfo &threadInfo) {
+        unsigned i = getPartition(k);
+        partitions[i]->tree->remove(partitions[i]->pop, k, tid, threadInfo.infos[i]);
+    }
+}
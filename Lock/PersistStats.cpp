@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <chrono>
+#include <emmintrin.h>
+
+#include "Include/PersistStats.h"
+
+namespace ART_LC {
+
+    PersistCounters PersistBreakdown::total(PersistOp op) const {
+        PersistCounters sum;
+        unsigned o = static_cast<unsigned>(op);
+        for (unsigned e = 0; e < eventCount; ++e) {
+            for (unsigned t = 0; t < nodeTypeCount; ++t) {
+                sum.flushedLines += counters[o][e][t].flushedLines;
+                sum.fences += counters[o][e][t].fences;
+            }
+        }
+        return sum;
+    }
+
+    PersistCounters PersistBreakdown::total() const {
+        PersistCounters sum;
+        for (unsigned o = 0; o < opCount; ++o) {
+            PersistCounters opSum = total(static_cast<PersistOp>(o));
+            sum.flushedLines += opSum.flushedLines;
+            sum.fences += opSum.fences;
+        }
+        return sum;
+    }
+
+    std::atomic<bool> PersistStats::enabled{false};
+
+    PersistStats::Latency PersistStats::latency;
+
+    PersistObserver *PersistStats::observer = nullptr;
+
+    thread_local PersistStats::Context PersistStats::context = {static_cast<uint8_t>(PersistOp::Other),
+                                                                static_cast<uint8_t>(PersistEvent::None),
+                                                                PersistStats::noNodeType};
+
+    thread_local PersistStats::ThreadCounters PersistStats::counters;
+
+    std::mutex PersistStats::registryMutex;
+
+    std::vector<PersistStats::ThreadCounters *> PersistStats::registry;
+
+    PersistBreakdown PersistStats::exited;
+
+    PersistStats::ThreadCounters::ThreadCounters() {
+        for (unsigned o = 0; o < PersistBreakdown::opCount; ++o) {
+            operations[o].store(0);
+            nodeReads[o].store(0);
+            for (unsigned e = 0; e < PersistBreakdown::eventCount; ++e) {
+                allocations[o][e].store(0);
+                allocatedBytes[o][e].store(0);
+                for (unsigned t = 0; t < PersistBreakdown::nodeTypeCount; ++t) {
+                    flushedLines[o][e][t].store(0);
+                    fences[o][e][t].store(0);
+                }
+            }
+        }
+        std::lock_guard<std::mutex> guard(registryMutex);
+        registry.push_back(this);
+    }
+
+    PersistStats::ThreadCounters::~ThreadCounters() {
+        std::lock_guard<std::mutex> guard(registryMutex);
+        addTo(exited);
+        registry.erase(std::find(registry.begin(), registry.end(), this));
+    }
+
+    void PersistStats::ThreadCounters::addTo(PersistBreakdown &b) const {
+        for (unsigned o = 0; o < PersistBreakdown::opCount; ++o) {
+            b.operations[o] += operations[o].load(std::memory_order_relaxed);
+            b.nodeReads[o] += nodeReads[o].load(std::memory_order_relaxed);
+            for (unsigned e = 0; e < PersistBreakdown::eventCount; ++e) {
+                b.allocations[o][e] += allocations[o][e].load(std::memory_order_relaxed);
+                b.allocatedBytes[o][e] += allocatedBytes[o][e].load(std::memory_order_relaxed);
+                for (unsigned t = 0; t < PersistBreakdown::nodeTypeCount; ++t) {
+                    b.counters[o][e][t].flushedLines += flushedLines[o][e][t].load(std::memory_order_relaxed);
+                    b.counters[o][e][t].fences += fences[o][e][t].load(std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    void PersistStats::spin(uint64_t ns) {
+        auto end = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+        while (std::chrono::steady_clock::now() < end) {
+            _mm_pause();
+        }
+    }
+
+    void PersistStats::recordFlush(const void *addr, std::size_t len) {
+        if (len == 0) {
+            return;
+        }
+        uint64_t lines = ((reinterpret_cast<uintptr_t>(addr) + len - 1) >> 6) -
+                         (reinterpret_cast<uintptr_t>(addr) >> 6) + 1;
+        add(counters.flushedLines[context.op][context.event][context.nodeType], lines);
+        if (observer != nullptr) {
+            observer->onFlush(addr, len);
+        }
+        if (latency.writeNs != 0) {
+            spin(lines * latency.writeNs);
+        }
+    }
+
+    void PersistStats::recordFence() {
+        add(counters.fences[context.op][context.event][context.nodeType], 1);
+        if (observer != nullptr) {
+            observer->onFence();
+        }
+        if (latency.fenceNs != 0) {
+            spin(latency.fenceNs);
+        }
+    }
+
+    void PersistStats::recordRead() {
+        add(counters.nodeReads[context.op], 1);
+        if (latency.readNs != 0) {
+            spin(latency.readNs);
+        }
+    }
+
+    void PersistStats::recordAllocation(std::size_t size) {
+        add(counters.allocations[context.op][context.event], 1);
+        add(counters.allocatedBytes[context.op][context.event], size);
+    }
+
+    void PersistStats::recordOperation(uint64_t keys) {
+        add(counters.operations[context.op], keys);
+    }
+
+    void PersistStats::setEnabled(bool e) {
+        enabled.store(e, std::memory_order_relaxed);
+    }
+
+    void PersistStats::setLatency(const Latency &l) {
+        latency = l;
+    }
+
+    void PersistStats::setObserver(PersistObserver *o) {
+        observer = o;
+    }
+
+    PersistBreakdown PersistStats::getBreakdown() {
+        std::lock_guard<std::mutex> guard(registryMutex);
+        PersistBreakdown b = exited;
+        for (ThreadCounters *c : registry) {
+            c->addTo(b);
+        }
+        return b;
+    }
+}
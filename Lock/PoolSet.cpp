@@ -0,0 +1,45 @@
+#include <errno.h>
+#include <fstream>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Include/PoolSet.h"
+
+namespace ART_LC {
+
+    pool<TreeAnchor> openGrowingPool(const std::string &dir, std::size_t reservation, std::size_t growth) {
+        std::string setPath = dir + "/tree.set";
+        std::string partDir = dir + "/parts";
+        pool<TreeAnchor> pop;
+        if (access(setPath.c_str(), F_OK) != 0) {
+            if (mkdir(partDir.c_str(), 0700) != 0 && errno != EEXIST) {
+                throw std::runtime_error("ART_LC: cannot create " + partDir);
+            }
+            // libpmemobj only accepts absolute paths in a pool set
+            char absPartDir[PATH_MAX];
+            if (realpath(partDir.c_str(), absPartDir) == nullptr) {
+                throw std::runtime_error("ART_LC: cannot resolve the absolute path of " + partDir);
+            }
+            std::ofstream set(setPath);
+            set << "PMEMPOOLSET\nOPTION SINGLEHDR\n" << reservation << " " << absPartDir << "/\n";
+            set.close();
+            if (!set) {
+                throw std::runtime_error("ART_LC: cannot write " + setPath);
+            }
+            // the size of a pool set is given by its parts
+            pop = pool<TreeAnchor>::create(setPath, LAYOUT, 0, CREATE_MODE_RW);
+        } else {
+            pop = pool<TreeAnchor>::open(setPath, LAYOUT);
+        }
+        // not stored in the pool, it has to be set whenever the pool is opened
+        uint64_t granularity = growth;
+        if (pmemobj_ctl_set(pop.handle(), "heap.size.granularity", &granularity) != 0) {
+            pop.close();
+            throw std::runtime_error("ART_LC: cannot set the growth of " + setPath);
+        }
+        return pop;
+    }
+}
@@ -0,0 +1,41 @@
+#include <assert.h>
+#include <algorithm>
+
+#include "Include/TopCache.h"
+
+namespace ART_LC {
+
+    void TopCache::onMiss(int slot, const N *node, uint64_t version) {
+        Entry &e = entries[slot];
+        if (e.missNode.load(std::memory_order_relaxed) != node ||
+            e.missVersion.load(std::memory_order_relaxed) != version) {
+            e.missNode.store(node, std::memory_order_relaxed);
+            e.missVersion.store(version, std::memory_order_relaxed);
+            return;
+        }
+        if (e.refilling.exchange(true, std::memory_order_acquire)) {
+            return;
+        }
+        // a single optimistic attempt, N::getChildren would spin on a node which became obsolete in between
+        N *children[256];
+        bool needRestart = false;
+        uint64_t v = node->readOptimisticOrRestart(needRestart);
+        if (!needRestart && v == version) {
+            for (unsigned k = 0; k < 256; ++k) {
+                children[k] = N::getChild(static_cast<uint8_t>(k), node);
+            }
+            node->readOptimisticUnlockOrRestart(v, needRestart);
+        }
+        if (!needRestart && v == version) {
+            e.node.store(nullptr, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            e.version.store(v, std::memory_order_relaxed);
+            // prefixes are never changed in place, see N::copyWithPrefix
+            e.prefixCount = node->getPrefixLength();
+            memcpy(e.prefix, node->getPrefix(), std::min(e.prefixCount, maxStoredPrefixLength));
+            std::copy(children, children + 256, e.children);
+            e.node.store(node, std::memory_order_release);
+        }
+        e.refilling.store(false, std::memory_order_release);
+    }
+}
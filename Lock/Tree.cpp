@@ -1,27 +1,162 @@
 #include <assert.h>
 #include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include "tbb/parallel_for.h"
 
 #include "Include/Tree.h"
 #include "N.cpp"
+#include "NodeAllocator.cpp"
+#include "TopCache.cpp"
+#include "PoolSet.cpp"
 #include "../Include/Epoche.cpp"
+#include "../Include/BulkLoad.h"
 #include "../Include/Key.h"
 
 
 namespace ART_LC {
 
-    Tree::Tree(LoadKeyFunction loadKey) : root(new N256( nullptr, 0)), loadKey(loadKey) {
+    namespace {
+        struct KeyLeafArgs {
+            const Key &k;
+            TID tid;
+        };
+
+        int constructKeyLeaf(PMEMobjpool *pop, void *ptr, void *arg) {
+            auto args = static_cast<KeyLeafArgs *>(arg);
+            auto leaf = static_cast<KeyLeaf *>(ptr);
+            leaf->tid = args->tid;
+            leaf->keyLen = args->k.getKeyLen();
+            memcpy(leaf->key, &args->k[0], leaf->keyLen);
+            pool_base p(pop);
+            persist(p, leaf, sizeof(KeyLeaf) + leaf->keyLen);
+            return 0;
+        }
+    }
+
+    Tree::Tree(pool<TreeAnchor> &pop, LoadKeyFunction loadKey, LeafType leafType)
+            : pop(pop), poolBase(reinterpret_cast<uint8_t *>(pop.handle())), anchor(pop.root()), loadKey(loadKey),
+              leafType(leafType), allocator(pop, anchor->slabs), topCache(new TopCache()) {
+        if (anchor->root == nullptr) {
+            anchor->layoutVersion = layoutVersion;
+            anchor->cleanShutdown = 1;
+            anchor->leafType = static_cast<uint64_t>(leafType);
+            anchor->completedFlushRounds = 0;
+            persist(pop, anchor.get(), sizeof(TreeAnchor));
+            // allocates and links the root in one failure-atomic step
+            make_persistent_atomic<N256>(pop, anchor->root, nullptr, 0);
+        } else if (anchor->layoutVersion != layoutVersion) {
+            throw std::runtime_error("ART_LC: pool holds a tree of an incompatible layout version");
+        }
+        root = anchor->root;
+        LockTable::get(root.get()).reset();
+        this->leafType = static_cast<LeafType>(anchor->leafType);
+        if (this->leafType == LeafType::ExternalKey && loadKey == nullptr) {
+            throw std::runtime_error("ART_LC: pool holds a tree without embedded keys, loadKey is required");
+        }
+
+        if (anchor->cleanShutdown == 0) {
+            recover();
+        }
+        replayBatches();
+        anchor->cleanShutdown = 0;
+        persist(pop, &anchor->cleanShutdown, sizeof(uint64_t));
+    }
+
+    std::unique_ptr<Tree> Tree::open(pool<TreeAnchor> &pop, LoadKeyFunction loadKey) {
+        if (pop.root()->root == nullptr) {
+            throw std::runtime_error("ART_LC: pool does not hold a tree");
+        }
+        return std::unique_ptr<Tree>(new Tree(pop, loadKey));
     }
 
     Tree::~Tree() {
-        N::deleteChildren(root);
-        N::deleteNode(root);
+        // the last round of the flusher runs before the pool is marked as cleanly closed
+        flusher.reset();
+        // the nodes stay in the pool, they are reattached by the next open
+        anchor->cleanShutdown = 1;
+        persist(pop, &anchor->cleanShutdown, sizeof(uint64_t));
     }
 
     ThreadInfo Tree::getThreadInfo() {
         return ThreadInfo(this->epoche);
     }
 
-    TID Tree::lookup(pool_base &pop, const Key &k, ThreadInfo &threadEpocheInfo) const {
+    void Tree::setDurability(Durability durability, std::chrono::milliseconds flushInterval) {
+        flusher.reset();
+        if (durability == Durability::Relaxed) {
+            flusher.reset(new Flusher(pop, anchor->completedFlushRounds, flushInterval));
+        }
+    }
+
+    void Tree::sync() {
+        if (flusher != nullptr) {
+            flusher->sync();
+        }
+    }
+
+    uint64_t Tree::getCompletedFlushRounds() const {
+        return anchor->completedFlushRounds;
+    }
+
+    void Tree::recover() {
+        allocator.beginRecovery();
+        tbb::enumerable_thread_specific<std::vector<TID>> leaves;
+        recoverSubtree(root.get(), 0, leaves);
+        // slots of nodes which were allocated or retired but not published or freed before the crash
+        allocator.endRecovery();
+
+        if (leafType == LeafType::EmbeddedKey) {
+            std::vector<TID> reachable;
+            for (auto &l : leaves) {
+                reachable.insert(reachable.end(), l.begin(), l.end());
+            }
+            std::sort(reachable.begin(), reachable.end());
+            freeUnreachableLeaves(reachable);
+        }
+    }
+
+    void Tree::freeUnreachableLeaves(const std::vector<TID> &reachable) {
+        std::vector<PMEMoid> unreachable;
+        for (PMEMoid oid = pmemobj_first(pop.handle()); !OID_IS_NULL(oid); oid = pmemobj_next(oid)) {
+            if (pmemobj_type_num(oid) == keyLeafTypeNum &&
+                !std::binary_search(reachable.begin(), reachable.end(), static_cast<TID>(oid.off))) {
+                unreachable.push_back(oid);
+            }
+        }
+        for (PMEMoid &oid : unreachable) {
+            pmemobj_free(&oid);
+        }
+    }
+
+    void Tree::recoverSubtree(N *node, uint32_t depth, tbb::enumerable_thread_specific<std::vector<TID>> &leaves) {
+        N::recover(pop, node);
+        allocator.markReachable(node);
+
+        std::tuple<uint8_t, N *> children[256];
+        uint32_t childrenCount = 0;
+        N::getChildren(node, 0u, 255u, children, childrenCount);
+
+        auto recoverChild = [&](uint32_t i) {
+            N *child = std::get<1>(children[i]);
+            if (!N::isLeaf(child)) {
+                recoverSubtree(child, depth + 1, leaves);
+            } else if (leafType == LeafType::EmbeddedKey) {
+                leaves.local().push_back(N::getLeaf(child));
+            }
+        };
+        if (depth < parallelRecoveryDepth) {
+            tbb::parallel_for(0u, childrenCount, recoverChild);
+        } else {
+            for (uint32_t i = 0; i < childrenCount; ++i) {
+                recoverChild(i);
+            }
+        }
+    }
+
+    TID Tree::lookup(pool_base &, const Key &k, ThreadInfo &threadEpocheInfo) const {
+        PersistStats::OpScope opScope(PersistOp::Lookup);
         EpocheGuardReadonly epocheGuard(threadEpocheInfo);
         restart:
         bool needRestart = false;
@@ -31,14 +166,23 @@ namespace ART_LC {
         uint64_t v;
         uint32_t level = 0;
         bool optimisticPrefixMatch = false;
+        // slot of node in the top cache, -1 below the cached levels
+        int cacheSlot = 0;
 
         node = root;
-        v = node->readLockOrRestart(pop, needRestart);
+        v = node->readVersionOrRestart(needRestart);
         if (needRestart) goto restart;
         while (true) {
-            switch (checkPrefix(node, k, level)) { // increases level
+            // the upper levels are read from their DRAM copy if it is still at version v
+            const TopCache::Entry *cached = cacheSlot >= 0 ? topCache->get(cacheSlot, node, v) : nullptr;
+            if (cached == nullptr) {
+                PersistStats::onRead();
+            }
+            auto prefixResult = cached != nullptr ? checkPrefix(cached->prefixCount, cached->prefix, k, level)
+                                                  : checkPrefix(node, k, level);
+            switch (prefixResult) { // increases level
                 case CheckPrefixResult::NoMatch:
-                    node->readUnlockOrRestart(pop, v, needRestart);
+                    node->readOptimisticUnlockOrRestart(v, needRestart);
                     if (needRestart) goto restart;
                     return 0;
                 case CheckPrefixResult::OptimisticMatch:
@@ -49,40 +193,40 @@ namespace ART_LC {
                         return 0;
                     }
                     parentNode = node;
-                    node = N::getChild(k[level], parentNode);
-//                    parentNode->checkOrRestart(v,needRestart);
-//                    if (needRestart) goto restart;
+                    node = cached != nullptr ? cached->children[k[level]] : N::getChild(k[level], parentNode);
+                    parentNode->readOptimisticUnlockOrRestart(v, needRestart);
+                    if (needRestart) goto restart;
+                    if (cacheSlot >= 0) {
+                        if (cached == nullptr) {
+                            topCache->onMiss(cacheSlot, parentNode, v);
+                        }
+                        cacheSlot = TopCache::getChildSlot(cacheSlot, k[level]);
+                    }
 
                     if (node == nullptr) {
-                        parentNode->readUnlockOrRestart(pop, v, needRestart);
-                        if (needRestart) goto restart;
                         return 0;
                     }
                     if (N::isLeaf(node)) {
-                        parentNode->readUnlockOrRestart(pop, v, needRestart);
-                        if (needRestart) goto restart;
-
-                        TID tid = N::getLeaf(node);
+                        TID leaf = N::getLeaf(node);
                         if (level < k.getKeyLen() - 1 || optimisticPrefixMatch) {
-                            return checkKey(pop, tid, k);
+                            return checkKey(leaf, k);
                         }
-                        return tid;
+                        return getLeafTid(leaf);
                     }
                     level++;
             }
-            uint64_t nv = node->readLockOrRestart(pop, needRestart);
-            if (needRestart) goto restart;
-            node->readLockOrRestart(pop, needRestart);
+            uint64_t nv = node->readVersionOrRestart(needRestart);
             if (needRestart) goto restart;
 
-            parentNode->readUnlockOrRestart(pop, v, needRestart);
+            parentNode->readOptimisticUnlockOrRestart(v, needRestart);
             if (needRestart) goto restart;
             v = nv;
         }
     }
 
-    bool Tree::lookupRange(pool_base &pop, const Key &start, const Key &end, Key &continueKey, TID result[],
+    bool Tree::lookupRange(pool_base &, const Key &start, const Key &end, Key &continueKey, TID result[],
                                 std::size_t resultSize, std::size_t &resultsFound, ThreadInfo &threadEpocheInfo) const {
+        PersistStats::OpScope opScope(PersistOp::Lookup);
         for (uint32_t i = 0; i < std::min(start.getKeyLen(), end.getKeyLen()); ++i) {
             if (start[i] > end[i]) {
                 resultsFound = 0;
@@ -93,20 +237,20 @@ namespace ART_LC {
         }
         EpocheGuard epocheGuard(threadEpocheInfo);
         TID toContinue = 0;
-        std::function<void(N *)> copy = [&result, &resultSize, &resultsFound, &toContinue, &copy](N *node) {
+        std::function<void(const N *)> copy = [&result, &resultSize, &resultsFound, &toContinue, &copy, this](const N *node) {
             if (N::isLeaf(node)) {
                 if (resultsFound == resultSize) {
                     toContinue = N::getLeaf(node);
                     return;
                 }
-                result[resultsFound] = N::getLeaf(node);
+                result[resultsFound] = getLeafTid(N::getLeaf(node));
                 resultsFound++;
             } else {
                 std::tuple<uint8_t, N *> children[256];
                 uint32_t childrenCount = 0;
                 N::getChildren(node, 0u, 255u, children, childrenCount);
                 for (uint32_t i = 0; i < childrenCount; ++i) {
-                    N *n = std::get<1>(children[i]);
+                    const N *n = std::get<1>(children[i]);
                     copy(n);
                     if (toContinue != 0) {
                         break;
@@ -114,8 +258,8 @@ namespace ART_LC {
                 }
             }
         };
-        std::function<void(N *, uint8_t, uint32_t, N *, uint64_t)> findStart = [&copy, &start, &findStart, &toContinue, this](
-                N *node, uint8_t nodeK, uint32_t level, N *parentNode, uint64_t vp) {
+        std::function<void(N *, uint8_t, uint32_t, const N *, uint64_t)> findStart = [&copy, &start, &findStart, &toContinue, this](
+                N *node, uint8_t nodeK, uint32_t level, const N *parentNode, uint64_t vp) {
             if (N::isLeaf(node)) {
                 copy(node);
                 return;
@@ -126,21 +270,21 @@ namespace ART_LC {
             {
                 readAgain:
                 bool needRestart = false;
-                v = node->readLockOrRestart(pop, needRestart);
+                v = node->readOptimisticOrRestart(needRestart);
                 if (needRestart) goto readAgain;
 
-                prefixResult = checkPrefixCompare(node, start, 0, level, loadKey, needRestart);
+                prefixResult = checkPrefixCompare(node, start, 0, level, needRestart);
                 if (needRestart) goto readAgain;
 
-                parentNode->readUnlockOrRestart(pop, vp, needRestart);
+                parentNode->readOptimisticUnlockOrRestart(vp, needRestart);
                 if (needRestart) {
                     readParentAgain:
-                    vp = parentNode->readLockOrRestart(needRestart);
+                    vp = parentNode->readOptimisticOrRestart(needRestart);
                     if (needRestart) goto readParentAgain;
 
                     node = N::getChild(nodeK, parentNode);
 
-                    parentNode->readUnlockOrRestart(pop, vp, needRestart);
+                    parentNode->readOptimisticUnlockOrRestart(vp, needRestart);
                     if (needRestart) goto readParentAgain;
 
                     if (node == nullptr) {
@@ -152,7 +296,7 @@ namespace ART_LC {
                     }
                     goto readAgain;
                 }
-                node->readUnlockOrRestart(pop, v, needRestart);
+                node->readOptimisticUnlockOrRestart(v, needRestart);
                 if (needRestart) goto readAgain;
             }
 
@@ -183,8 +327,8 @@ namespace ART_LC {
                     break;
             }
         };
-        std::function<void(N *, uint8_t, uint32_t, N *, uint64_t)> findEnd = [&copy, &end, &toContinue, &findEnd, this](
-                N *node, uint8_t nodeK, uint32_t level, N *parentNode, uint64_t vp) {
+        std::function<void(N *, uint8_t, uint32_t, const N *, uint64_t)> findEnd = [&copy, &end, &toContinue, &findEnd, this](
+                N *node, uint8_t nodeK, uint32_t level, const N *parentNode, uint64_t vp) {
             if (N::isLeaf(node)) {
                 return;
             }
@@ -193,21 +337,21 @@ namespace ART_LC {
             {
                 readAgain:
                 bool needRestart = false;
-                v = node->readLockOrRestart(pop, needRestart);
+                v = node->readOptimisticOrRestart(needRestart);
                 if (needRestart) goto readAgain;
 
-                prefixResult = checkPrefixCompare(node, end, 255, level, loadKey, needRestart);
+                prefixResult = checkPrefixCompare(node, end, 255, level, needRestart);
                 if (needRestart) goto readAgain;
 
-                parentNode->readUnlockOrRestart(pop, vp, needRestart);
+                parentNode->readOptimisticUnlockOrRestart(vp, needRestart);
                 if (needRestart) {
                     readParentAgain:
-                    vp = parentNode->readLockOrRestart(needRestart);
+                    vp = parentNode->readOptimisticOrRestart(needRestart);
                     if (needRestart) goto readParentAgain;
 
                     node = N::getChild(nodeK, parentNode);
 
-                    parentNode->readUnlockOrRestart(pop, vp, needRestart);
+                    parentNode->readOptimisticUnlockOrRestart(vp, needRestart);
                     if (needRestart) goto readParentAgain;
 
                     if (node == nullptr) {
@@ -218,7 +362,7 @@ namespace ART_LC {
                     }
                     goto readAgain;
                 }
-                node->readUnlockOrRestart(pop, v, needRestart);
+                node->readOptimisticUnlockOrRestart(v, needRestart);
                 if (needRestart) goto readAgain;
             }
             switch (prefixResult) {
@@ -266,15 +410,15 @@ namespace ART_LC {
             vp = v;
             node = nextNode;
             PCEqualsResults prefixResult;
-            v = node->readLockOrRestart(pop, needRestart);
+            v = node->readOptimisticOrRestart(needRestart);
             if (needRestart) goto restart;
-            prefixResult = checkPrefixEquals(node, level, start, end, loadKey, needRestart);
+            prefixResult = checkPrefixEquals(node, level, start, end, needRestart);
             if (needRestart) goto restart;
             if (parentNode != nullptr) {
-                parentNode->readUnlockOrRestart(pop, vp, needRestart);
+                parentNode->readOptimisticUnlockOrRestart(vp, needRestart);
                 if (needRestart) goto restart;
             }
-            node->readUnlockOrRestart(pop, v, needRestart);
+            node->readOptimisticUnlockOrRestart(v, needRestart);
             if (needRestart) goto restart;
 
             switch (prefixResult) {
@@ -308,7 +452,7 @@ namespace ART_LC {
                         }
                     } else {
                         nextNode = N::getChild(startLevel, node);
-                        node->readUnlockOrRestart(pop, v, needRestart);
+                        node->readOptimisticUnlockOrRestart(v, needRestart);
                         if (needRestart) goto restart;
                         level++;
                         continue;
@@ -319,7 +463,7 @@ namespace ART_LC {
             break;
         }
         if (toContinue != 0) {
-            loadKey(toContinue, continueKey);
+            loadLeafKey(toContinue, continueKey);
             return true;
         } else {
             return false;
@@ -327,19 +471,68 @@ namespace ART_LC {
     }
 
 
-    TID Tree::checkKey(pool_base &pop, const TID tid, const Key &k) const {
+    TID Tree::checkKey(const TID leaf, const Key &k) const {
+        if (leafType == LeafType::EmbeddedKey) {
+            const KeyLeaf *l = getKeyLeaf(leaf);
+            if (l->keyLen == k.getKeyLen() && memcmp(l->key, &k[0], l->keyLen) == 0) {
+                return l->tid;
+            }
+            return 0;
+        }
         Key kt;
-	transaction::run(pop, [&]{
-	        this->loadKey(tid, kt);
-	});
+        this->loadKey(leaf, kt);
         if (k == kt) {
-            return tid;
+            return leaf;
         }
         return 0;
     }
 
+    const KeyLeaf *Tree::getKeyLeaf(TID leaf) const {
+        return reinterpret_cast<const KeyLeaf *>(poolBase + leaf);
+    }
+
+    void Tree::loadLeafKey(TID leaf, Key &key) const {
+        if (leafType == LeafType::EmbeddedKey) {
+            const KeyLeaf *l = getKeyLeaf(leaf);
+            key.set(reinterpret_cast<const char *>(l->key), l->keyLen);
+        } else {
+            loadKey(leaf, key);
+        }
+    }
+
+    TID Tree::getLeafTid(TID leaf) const {
+        return leafType == LeafType::EmbeddedKey ? getKeyLeaf(leaf)->tid : leaf;
+    }
+
+    TID Tree::makeLeaf(const Key &k, TID tid) {
+        if (leafType == LeafType::ExternalKey) {
+            return tid;
+        }
+        // a crash before the leaf is linked leaks it until the recovery pass
+        KeyLeafArgs args{k, tid};
+        PMEMoid oid;
+        if (pmemobj_alloc(pop.handle(), &oid, sizeof(KeyLeaf) + k.getKeyLen(), keyLeafTypeNum,
+                          constructKeyLeaf, &args) != 0) {
+            throw std::bad_alloc();
+        }
+        PersistStats::onAllocation(sizeof(KeyLeaf) + k.getKeyLen());
+        return oid.off;
+    }
+
     void Tree::insert(pool_base &pop, const Key &k, TID tid, ThreadInfo &epocheInfo) {
+        PersistStats::OpScope opScope(PersistOp::Insert);
+        const std::size_t order[] = {0};
+        insertGroup(pop, &k, &tid, order, 1, epocheInfo);
+    }
+
+    std::size_t Tree::insertGroup(pool_base &pop, const Key keys[], const TID tids[], const std::size_t order[],
+                                  std::size_t n, ThreadInfo &epocheInfo) {
+        // outlives the epoche guard, nodes freed when leaving the epoche need the deferred unlinks persisted
+        Flusher::Scope durabilityScope(flusher.get());
         EpocheGuard epocheGuard(epocheInfo);
+        const Key &k = keys[order[0]];
+        // allocated once, restarts link the same leaf
+        TID tid = makeLeaf(k, tids[order[0]]);
         restart:
         bool needRestart = false;
 
@@ -351,49 +544,70 @@ namespace ART_LC {
         uint32_t level = 0;
 
         while (true) {
+            // lock coupling: parentNode and node stay read locked, the grandparent is released
+            if (parentNode != nullptr) {
+                parentNode->readUnlock();
+            }
             parentNode = node;
             parentKey = nodeKey;
             node = nextNode;
-            auto v = node->readLockOrRestart(pop, needRestart);
-            if (needRestart) goto restart;
+            auto v = node->readLockOrRestart(needRestart);
+            if (needRestart) {
+                if (parentNode != nullptr) {
+                    parentNode->readUnlock();
+                }
+                goto restart;
+            }
 
             uint32_t nextLevel = level;
 
             uint8_t nonMatchingKey;
             Prefix remainingPrefix;
             auto res = checkPrefixPessimistic(node, k, nextLevel, nonMatchingKey, remainingPrefix,
-                                   this->loadKey, needRestart); // increases level
-            if (needRestart) goto restart;
+                                   needRestart); // increases level
+            if (needRestart) {
+                parentNode->readUnlock();
+                node->readUnlock();
+                goto restart;
+            }
             switch (res) {
                 case CheckPrefixPessimisticResult::NoMatch: {
-                    parentNode->upgradeToWriteLockOrRestart(pop, parentVersion, needRestart);
-                    if (needRestart) goto restart;
+                    PersistStats::EventScope eventScope(PersistEvent::PrefixSplit);
+                    parentNode->upgradeToWriteLockOrRestart(parentVersion, needRestart);
+                    if (needRestart) {
+                        parentNode->readUnlock();
+                        node->readUnlock();
+                        goto restart;
+                    }
 
-                    node->upgradeToWriteLockOrRestart(pop, v, needRestart);
+                    node->upgradeToWriteLockOrRestart(v, needRestart);
                     if (needRestart) {
-                        parentNode->writeUnlock(pop);
+                        parentNode->writeUnlock();
+                        node->readUnlock();
                         goto restart;
                     }
                     // 1) Create new node which will be parent of node, Set common prefix, level to this node
-                    p<N4> newNode; 
-		    transaction::run(pop, [&]{	
-			newNode = make_persistent<N4>(node->getPrefix(), nextLevel - level);
-		     });
-
-                    // 2)  add node and (tid, *k) as children
-                    newNode->insert(pop, k[nextLevel], N::setLeaf(tid));
-                    newNode->insert(pop, nonMatchingKey, node);
+                    N4 *newNode = allocator.allocate<N4>(node->getPrefix(), nextLevel - level);
+
+                    // 2) node is reachable, its shorter prefix is written to an unpublished copy
+                    N *nodeCopy = N::copyWithPrefix(pop, allocator, node, remainingPrefix,
+                                                    node->getPrefixLength() - ((nextLevel - level) + 1));
+
+                    // 3) add the copy of node and (tid, *k) as children
+                    newNode->insertUnpublished(k[nextLevel], N::setLeaf(tid));
+                    newNode->insertUnpublished(nonMatchingKey, nodeCopy);
+                    {
+                        PersistStats::NodeScope nodeScope(static_cast<uint8_t>(NTypes::N4));
+                        persist(pop, newNode, sizeof(N4));
+                    }
 
-                    // 3) upgradeToWriteLockOrRestart, update parentNode to point to the new node, unlock
+                    // 4) publish the new subtree with one pointer store in parentNode, unlock
                     N::change(pop, parentNode, parentKey, newNode);
-                    parentNode->writeUnlock(pop);
-
-                    // 4) update prefix of node, unlock
-                    node->setPrefix(pop, remainingPrefix,
-                                    node->getPrefixLength() - ((nextLevel - level) + 1));
+                    parentNode->writeUnlock();
 
-                    node->writeUnlock(pop);
-                    return;
+                    node->writeUnlockObsolete();
+                    this->epoche.markNodeForDeletion(node, epocheInfo);
+                    return 1;
                 }
                 case CheckPrefixPessimisticResult::Match:
                     break;
@@ -401,26 +615,62 @@ namespace ART_LC {
             level = nextLevel;
             nodeKey = k[level];
             nextNode = N::getChild(nodeKey, node);
-//            node->checkOrRestart(v,needRestart);
-//            if (needRestart) goto restart;
 
             if (nextNode == nullptr) {
-                N::insertAndUnlock(pop, node, v, parentNode, parentVersion, parentKey, nodeKey, N::setLeaf(tid), needRestart, epocheInfo);
-                if (needRestart) goto restart;
-                return;
-            }
+                // following keys of a sorted batch which end up in a free slot of the same node
+                uint8_t groupKeys[256];
+                std::size_t groupPos[256];
+                uint32_t groupSize = 1;
+                groupKeys[0] = nodeKey;
+                uint32_t freeSlots = N::getFreeSlots(node);
+                for (std::size_t j = 1; j < n && groupSize < freeSlots; ++j) {
+                    const Key &kj = keys[order[j]];
+                    if (kj.getKeyLen() <= level || memcmp(&kj[0], &k[0], level) != 0 ||
+                        kj[level] == groupKeys[groupSize - 1] || N::getChild(kj[level], node) != nullptr) {
+                        break;
+                    }
+                    groupKeys[groupSize] = kj[level];
+                    groupPos[groupSize] = j;
+                    groupSize++;
+                }
+                if (groupSize == 1) {
+                    N::insertAndUnlock(pop, allocator, node, v, parentNode, parentVersion, parentKey, nodeKey, N::setLeaf(tid), needRestart, epocheInfo);
+                    if (needRestart) goto restart;
+                    return 1;
+                }
 
-/*            if (parentNode != nullptr) {
-                parentNode->readUnlockOrRestart(parentVersion, needRestart);
-                if (needRestart) goto restart;
-            }*/
+                if (parentNode != nullptr) {
+                    parentNode->readUnlock();
+                }
+                node->upgradeToWriteLockOrRestart(v, needRestart);
+                if (needRestart) {
+                    node->readUnlock();
+                    goto restart;
+                }
+                // the leaves of the following keys are only made once the group is certain
+                N *groupVals[256];
+                groupVals[0] = N::setLeaf(tid);
+                for (uint32_t j = 1; j < groupSize; ++j) {
+                    groupVals[j] = N::setLeaf(makeLeaf(keys[order[groupPos[j]]], tids[order[groupPos[j]]]));
+                }
+                N::insertMany(pop, node, groupKeys, groupVals, groupSize);
+                node->writeUnlock();
+                return groupSize;
+            }
 
             if (N::isLeaf(nextNode)) {
-                node->upgradeToWriteLockOrRestart(pop, v, needRestart);
-                if (needRestart) goto restart;
+                if (parentNode != nullptr) {
+                    parentNode->readUnlock();
+                }
+                node->upgradeToWriteLockOrRestart(v, needRestart);
+                if (needRestart) {
+                    node->readUnlock();
+                    goto restart;
+                }
 
+                PersistStats::EventScope eventScope(PersistEvent::LeafSplit);
                 Key key;
-                loadKey(N::getLeaf(nextNode), key);
+                loadLeafKey(N::getLeaf(nextNode), key);
 
                 level++;
                 uint32_t prefixLength = 0;
@@ -428,22 +678,222 @@ namespace ART_LC {
                     prefixLength++;
                 }
 
-                p<N4> n4 ;
-		transaction::run(pop, [&]{
-			n4 = make_persistent<N4>(&k[level], prefixLength);
-		});
-                n4->insert(pop, k[level + prefixLength], N::setLeaf(tid));
-                n4->insert(pop, key[level + prefixLength], nextNode);
+                N4 *n4 = allocator.allocate<N4>(&k[level], prefixLength);
+                n4->insertUnpublished(k[level + prefixLength], N::setLeaf(tid));
+                n4->insertUnpublished(key[level + prefixLength], nextNode);
+                {
+                    PersistStats::NodeScope nodeScope(static_cast<uint8_t>(NTypes::N4));
+                    persist(pop, n4, sizeof(N4));
+                }
                 N::change(pop, node, k[level - 1], n4);
-                node->writeUnlock(pop);
-                return;
+                node->writeUnlock();
+                return 1;
             }
             level++;
             parentVersion = v;
         }
     }
 
+    namespace {
+        /**
+         * commit record of insertBatch, followed by count entries of TID, key length and key bytes
+         */
+        struct BatchLog {
+            uint64_t count;
+            uint8_t entries[];
+        };
+
+        struct BatchArgs {
+            const Key *keys;
+            const TID *tids;
+            const std::size_t *order;
+            std::size_t n;
+        };
+
+        int constructBatchLog(PMEMobjpool *pop, void *ptr, void *arg) {
+            auto args = static_cast<BatchArgs *>(arg);
+            auto log = static_cast<BatchLog *>(ptr);
+            log->count = args->n;
+            uint8_t *pos = log->entries;
+            for (std::size_t i = 0; i < args->n; ++i) {
+                const Key &k = args->keys[args->order[i]];
+                uint32_t keyLen = k.getKeyLen();
+                memcpy(pos, &args->tids[args->order[i]], sizeof(TID));
+                memcpy(pos + sizeof(TID), &keyLen, sizeof(uint32_t));
+                memcpy(pos + sizeof(TID) + sizeof(uint32_t), &k[0], keyLen);
+                pos += sizeof(TID) + sizeof(uint32_t) + keyLen;
+            }
+            pool_base p(pop);
+            persist(p, log, pos - reinterpret_cast<uint8_t *>(log));
+            return 0;
+        }
+    }
+
+    void Tree::insertBatch(pool_base &pop, const Key keys[], const TID tids[], std::size_t n, ThreadInfo &epocheInfo) {
+        if (n == 0) {
+            return;
+        }
+        PersistStats::OpScope opScope(PersistOp::Insert, n);
+        std::vector<std::size_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [keys](std::size_t a, std::size_t b) {
+            const Key &ka = keys[a], &kb = keys[b];
+            int cmp = memcmp(&ka[0], &kb[0], std::min(ka.getKeyLen(), kb.getKeyLen()));
+            return cmp < 0 || (cmp == 0 && ka.getKeyLen() < kb.getKeyLen());
+        });
+        // of a key given more than once the last one wins, the inserts below take every key once
+        std::size_t unique = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            assert(tids[order[i]] != 0);
+            if (unique > 0 && keys[order[unique - 1]] == keys[order[i]]) {
+                order[unique - 1] = order[i];
+            } else {
+                order[unique] = order[i];
+                unique++;
+            }
+        }
+        n = unique;
+
+        // the batch is durable as soon as its log is allocated
+        std::size_t size = sizeof(BatchLog);
+        for (std::size_t i = 0; i < n; ++i) {
+            size += sizeof(TID) + sizeof(uint32_t) + keys[order[i]].getKeyLen();
+        }
+        BatchArgs args{keys, tids, order.data(), n};
+        PMEMoid log;
+        if (pmemobj_alloc(pop.handle(), &log, size, batchLogTypeNum, constructBatchLog, &args) != 0) {
+            throw std::bad_alloc();
+        }
+        PersistStats::onAllocation(size);
+
+        Flusher::Scope durabilityScope(flusher.get());
+        std::size_t i = 0;
+        while (i < n) {
+            i += insertGroup(pop, keys, tids, order.data() + i, n - i, epocheInfo);
+        }
+        // the log may only go once all keys of the batch are durable
+        persistDeferred();
+        pmemobj_free(&log);
+    }
+
+    void Tree::replayBatches() {
+        std::vector<PMEMoid> logs;
+        for (PMEMoid oid = pmemobj_first(pop.handle()); !OID_IS_NULL(oid); oid = pmemobj_next(oid)) {
+            if (pmemobj_type_num(oid) == batchLogTypeNum) {
+                logs.push_back(oid);
+            }
+        }
+        auto t = getThreadInfo();
+        for (PMEMoid &oid : logs) {
+            auto log = static_cast<const BatchLog *>(pmemobj_direct(oid));
+            const uint8_t *pos = log->entries;
+            for (uint64_t i = 0; i < log->count; ++i) {
+                TID tid;
+                uint32_t keyLen;
+                memcpy(&tid, pos, sizeof(TID));
+                memcpy(&keyLen, pos + sizeof(TID), sizeof(uint32_t));
+                Key key;
+                key.set(reinterpret_cast<const char *>(pos + sizeof(TID) + sizeof(uint32_t)), keyLen);
+                pos += sizeof(TID) + sizeof(uint32_t) + keyLen;
+                // keys inserted before the crash are already there, a stored TID is never 0
+                if (lookup(pop, key, t) == 0) {
+                    insert(pop, key, tid, t);
+                }
+            }
+            pmemobj_free(&oid);
+        }
+    }
+
+    using namespace ART::BulkLoad;
+
+    template<class NODE>
+    N *Tree::buildNode(const Key keys[], const TID tids[], std::size_t begin, std::size_t end, uint32_t level,
+                       uint32_t prefixLength) {
+        uint32_t nodeLevel = level + prefixLength;
+        NODE *node = allocator.allocate<NODE>(&keys[begin][level], prefixLength);
+        for (std::size_t i = begin; i < end;) {
+            std::size_t j = groupEnd(keys, i, end, nodeLevel);
+            node->insertUnpublished(keys[i][nodeLevel], buildSubtree(keys, tids, i, j, nodeLevel + 1));
+            i = j;
+        }
+        PersistStats::NodeScope nodeScope(static_cast<uint8_t>(NODE::nodeType));
+        flush(pop, node, sizeof(NODE));
+        return node;
+    }
+
+    N *Tree::buildSubtree(const Key keys[], const TID tids[], std::size_t begin, std::size_t end, uint32_t level) {
+        if (end - begin == 1) {
+            return N::setLeaf(makeLeaf(keys[begin], tids[begin]));
+        }
+        uint32_t prefixLength = commonPrefixLength(keys, begin, end, level);
+        if (level + prefixLength == keys[begin].getKeyLen()) {
+            // all keys are the same, the first one wins
+            return N::setLeaf(makeLeaf(keys[begin], tids[begin]));
+        }
+        unsigned children = groupCount(keys, begin, end, level + prefixLength);
+        if (children <= 4) {
+            return buildNode<N4>(keys, tids, begin, end, level, prefixLength);
+        } else if (children <= 16) {
+            return buildNode<N16>(keys, tids, begin, end, level, prefixLength);
+        } else if (children <= 48) {
+            return buildNode<N48>(keys, tids, begin, end, level, prefixLength);
+        }
+        return buildNode<N256>(keys, tids, begin, end, level, prefixLength);
+    }
+
+    void Tree::discardSubtree(N *node) {
+        if (N::isLeaf(node)) {
+            if (leafType == LeafType::EmbeddedKey) {
+                // frees the KeyLeaf
+                allocator.free(node);
+            }
+            return;
+        }
+        std::tuple<uint8_t, N *> children[256];
+        uint32_t childrenCount = 0;
+        N::getChildren(node, 0u, 255u, children, childrenCount);
+        for (uint32_t i = 0; i < childrenCount; ++i) {
+            discardSubtree(std::get<1>(children[i]));
+        }
+        allocator.free(node);
+    }
+
+    void Tree::bulkLoad(pool_base &pop, const Key keys[], const TID tids[], std::size_t n, ThreadInfo &epocheInfo) {
+        PersistStats::OpScope opScope(PersistOp::Insert, n);
+        for (std::size_t i = 0; i < n;) {
+            std::size_t j = groupEnd(keys, i, n, 0);
+            uint8_t key = keys[i][0];
+            N *subtree = nullptr;
+            if (N::getChild(key, root.get()) == nullptr) {
+                // built without locks, nobody else can reach it yet
+                subtree = buildSubtree(keys, tids, i, j, 1);
+                fence(pop);
+                bool needRestart;
+                do {
+                    needRestart = false;
+                    root->writeLockOrRestart(needRestart);
+                } while (needRestart);
+                if (N::getChild(key, root.get()) == nullptr) {
+                    static_cast<N256 *>(root.get())->insert(pop, key, subtree);
+                } else {
+                    discardSubtree(subtree);
+                    subtree = nullptr;
+                }
+                root->writeUnlock();
+            }
+            if (subtree == nullptr) {
+                // the subtree exists already
+                for (std::size_t k = i; k < j; ++k) {
+                    insert(pop, keys[k], tids[k], epocheInfo);
+                }
+            }
+            i = j;
+        }
+    }
+
     void Tree::remove(pool_base &pop, const Key &k, TID tid, ThreadInfo &threadInfo) {
+        PersistStats::OpScope opScope(PersistOp::Remove);
+        Flusher::Scope durabilityScope(flusher.get());
         EpocheGuard epocheGuard(threadInfo);
         restart:
         bool needRestart = false;
@@ -456,16 +906,27 @@ namespace ART_LC {
         uint32_t level = 0;
 
         while (true) {
+            // lock coupling: parentNode and node stay read locked, the grandparent is released
+            if (parentNode != nullptr) {
+                parentNode->readUnlock();
+            }
             parentNode = node;
             parentKey = nodeKey;
             node = nextNode;
-            auto v = node->readLockOrRestart(pop, needRestart);
-            if (needRestart) goto restart;
+            auto v = node->readLockOrRestart(needRestart);
+            if (needRestart) {
+                if (parentNode != nullptr) {
+                    parentNode->readUnlock();
+                }
+                goto restart;
+            }
 
             switch (checkPrefix(node, k, level)) { // increases level
                 case CheckPrefixResult::NoMatch:
-                    node->readUnlockOrRestart(pop, v, needRestart);
-                    if (needRestart) goto restart;
+                    if (parentNode != nullptr) {
+                        parentNode->readUnlock();
+                    }
+                    node->readUnlock();
                     return;
                 case CheckPrefixResult::OptimisticMatch:
                     // fallthrough
@@ -473,29 +934,31 @@ namespace ART_LC {
                     nodeKey = k[level];
                     nextNode = N::getChild(nodeKey, node);
 
-//                    node->checkOrRestart(v, needRestart);
-//                    if (needRestart) goto restart;
-
-                    if (nextNode == nullptr) {
-                        node->readUnlockOrRestart(pop, v, needRestart);
-                        if (needRestart) goto restart;
+                    if (nextNode == nullptr || (N::isLeaf(nextNode) && getLeafTid(N::getLeaf(nextNode)) != tid)) {
+                        if (parentNode != nullptr) {
+                            parentNode->readUnlock();
+                        }
+                        node->readUnlock();
                         return;
                     }
-                    node->readUnlockOrRestart(pop, v, needRestart);
                     if (N::isLeaf(nextNode)) {
-                        if (N::getLeaf(nextNode) != tid) {
-                            return;
-                        }
                         assert(parentNode == nullptr || node->getCount() != 1);
                         if (node->getCount() == 2 && parentNode != nullptr) {
-                            parentNode->upgradeToWriteLockOrRestart(pop, parentVersion, needRestart);
-                            if (needRestart) goto restart;
+                            parentNode->upgradeToWriteLockOrRestart(parentVersion, needRestart);
+                            if (needRestart) {
+                                parentNode->readUnlock();
+                                node->readUnlock();
+                                goto restart;
+                            }
 
-                            node->upgradeToWriteLockOrRestart(pop, v, needRestart);
+                            node->upgradeToWriteLockOrRestart(v, needRestart);
                             if (needRestart) {
-                                parentNode->writeUnlock(pop);
+                                parentNode->writeUnlock();
+                                node->readUnlock();
                                 goto restart;
                             }
+                            // node is replaced by its remaining child
+                            PersistStats::EventScope eventScope(PersistEvent::Merge);
                             // 1. check remaining entries
                             N *secondNodeN;
                             uint8_t secondNodeK;
@@ -504,31 +967,41 @@ namespace ART_LC {
                                 //N::remove(node, k[level]); not necessary
                                 N::change(pop, parentNode, parentKey, secondNodeN);
 
-                                parentNode->writeUnlock(pop);
-                                node->writeUnlockObsolete(pop);
+                                parentNode->writeUnlock();
+                                node->writeUnlockObsolete();
                                 this->epoche.markNodeForDeletion(node, threadInfo);
                             } else {
-                                secondNodeN->writeLockOrRestart(pop, needRestart);
+                                secondNodeN->writeLockOrRestart(needRestart);
                                 if (needRestart) {
-                                    node->writeUnlock(pop);
-                                    parentNode->writeUnlock(pop);
+                                    node->writeUnlock();
+                                    parentNode->writeUnlock();
                                     goto restart;
                                 }
 
+                                // secondNodeN is reachable, the merged prefix is written to an unpublished copy
+                                N *secondNodeCopy = N::copyWithPrefix(pop, allocator, secondNodeN, secondNodeN->getPrefix(),
+                                                                      secondNodeN->getPrefixLength());
+                                secondNodeCopy->addPrefixBefore(node, secondNodeK);
+                                persist(pop, secondNodeCopy, sizeof(N));
+
                                 //N::remove(node, k[level]); not necessary
-                                N::change(pop, parentNode, parentKey, secondNodeN);
-                                parentNode->writeUnlock(pop);
+                                N::change(pop, parentNode, parentKey, secondNodeCopy);
+                                parentNode->writeUnlock();
 
-                                secondNodeN->addPrefixBefore(pop, node, secondNodeK);
-                                secondNodeN->writeUnlock(pop);
+                                secondNodeN->writeUnlockObsolete();
+                                this->epoche.markNodeForDeletion(secondNodeN, threadInfo);
 
-                                node->writeUnlockObsolete(pop);
+                                node->writeUnlockObsolete();
                                 this->epoche.markNodeForDeletion(node, threadInfo);
                             }
                         } else {
-                            N::removeAndUnlock(pop, node, v, k[level], parentNode, parentVersion, parentKey, needRestart, threadInfo);
+                            N::removeAndUnlock(pop, allocator, node, v, k[level], parentNode, parentVersion, parentKey, needRestart, threadInfo);
                             if (needRestart) goto restart;
                         }
+                        if (leafType == LeafType::EmbeddedKey) {
+                            // concurrent readers may still load the key from the leaf
+                            this->epoche.markNodeForDeletion(nextNode, threadInfo);
+                        }
                         return;
                     }
                     level++;
@@ -539,18 +1012,23 @@ namespace ART_LC {
     }
 
     inline typename Tree::CheckPrefixResult Tree::checkPrefix(N *n, const Key &k, uint32_t &level) {
-        if (n->hasPrefix()) {
-            if (k.getKeyLen() <= level + n->getPrefixLength()) {
+        return checkPrefix(n->getPrefixLength(), n->getPrefix(), k, level);
+    }
+
+    inline typename Tree::CheckPrefixResult Tree::checkPrefix(uint32_t prefixCount, const uint8_t *prefix, const Key &k,
+                                                             uint32_t &level) {
+        if (prefixCount > 0) {
+            if (k.getKeyLen() <= level + prefixCount) {
                 return CheckPrefixResult::NoMatch;
             }
-            for (uint32_t i = 0; i < std::min(n->getPrefixLength(), maxStoredPrefixLength); ++i) {
-                if (n->getPrefix()[i] != k[level]) {
+            for (uint32_t i = 0; i < std::min(prefixCount, maxStoredPrefixLength); ++i) {
+                if (prefix[i] != k[level]) {
                     return CheckPrefixResult::NoMatch;
                 }
                 ++level;
             }
-            if (n->getPrefixLength() > maxStoredPrefixLength) {
-                level = level + (n->getPrefixLength() - maxStoredPrefixLength);
+            if (prefixCount > maxStoredPrefixLength) {
+                level = level + (prefixCount - maxStoredPrefixLength);
                 return CheckPrefixResult::OptimisticMatch;
             }
         }
@@ -560,7 +1038,7 @@ namespace ART_LC {
     typename Tree::CheckPrefixPessimisticResult Tree::checkPrefixPessimistic(N *n, const Key &k, uint32_t &level,
                                                                         uint8_t &nonMatchingKey,
                                                                         Prefix &nonMatchingPrefix,
-                                                                        LoadKeyFunction loadKey, bool &needRestart) {
+                                                                        bool &needRestart) const {
         if (n->hasPrefix()) {
             uint32_t prevLevel = level;
             Key kt;
@@ -568,7 +1046,7 @@ namespace ART_LC {
                 if (i == maxStoredPrefixLength) {
                     auto anyTID = N::getAnyChildTid(n, needRestart);
                     if (needRestart) return CheckPrefixPessimisticResult::Match;
-                    loadKey(anyTID, kt);
+                    loadLeafKey(anyTID, kt);
                 }
                 uint8_t curKey = i >= maxStoredPrefixLength ? kt[level] : n->getPrefix()[i];
                 if (curKey != k[level]) {
@@ -577,7 +1055,7 @@ namespace ART_LC {
                         if (i < maxStoredPrefixLength) {
                             auto anyTID = N::getAnyChildTid(n, needRestart);
                             if (needRestart) return CheckPrefixPessimisticResult::Match;
-                            loadKey(anyTID, kt);
+                            loadLeafKey(anyTID, kt);
                         }
                         memcpy(nonMatchingPrefix, &kt[0] + level + 1, std::min((n->getPrefixLength() - (level - prevLevel) - 1),
                                                                            maxStoredPrefixLength));
@@ -592,15 +1070,15 @@ namespace ART_LC {
         return CheckPrefixPessimisticResult::Match;
     }
 
-    typename Tree::PCCompareResults Tree::checkPrefixCompare(N *n, const Key &k, uint8_t fillKey, uint32_t &level,
-                                                        LoadKeyFunction loadKey, bool &needRestart) {
+    typename Tree::PCCompareResults Tree::checkPrefixCompare(const N *n, const Key &k, uint8_t fillKey, uint32_t &level,
+                                                        bool &needRestart) const {
         if (n->hasPrefix()) {
             Key kt;
             for (uint32_t i = 0; i < n->getPrefixLength(); ++i) {
                 if (i == maxStoredPrefixLength) {
                     auto anyTID = N::getAnyChildTid(n, needRestart);
                     if (needRestart) return PCCompareResults::Equal;
-                    loadKey(anyTID, kt);
+                    loadLeafKey(anyTID, kt);
                 }
                 uint8_t kLevel = (k.getKeyLen() > level) ? k[level] : fillKey;
 
@@ -616,15 +1094,15 @@ namespace ART_LC {
         return PCCompareResults::Equal;
     }
 
-    typename Tree::PCEqualsResults Tree::checkPrefixEquals(N *n, uint32_t &level, const Key &start, const Key &end,
-                                                      LoadKeyFunction loadKey, bool &needRestart) {
+    typename Tree::PCEqualsResults Tree::checkPrefixEquals(const N *n, uint32_t &level, const Key &start, const Key &end,
+                                                      bool &needRestart) const {
         if (n->hasPrefix()) {
             Key kt;
             for (uint32_t i = 0; i < n->getPrefixLength(); ++i) {
                 if (i == maxStoredPrefixLength) {
                     auto anyTID = N::getAnyChildTid(n, needRestart);
                     if (needRestart) return PCEqualsResults::BothMatch;
-                    loadKey(anyTID, kt);
+                    loadLeafKey(anyTID, kt);
                 }
                 uint8_t startLevel = (start.getKeyLen() > level) ? start[level] : 0;
                 uint8_t endLevel = (end.getKeyLen() > level) ? end[level] : 255;
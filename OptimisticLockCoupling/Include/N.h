@@ -34,6 +34,27 @@ namespace ART_OLC {
 
     using Prefix = uint8_t[maxStoredPrefixLength];
 
+    /**
+     * Bytes of a prefix beyond maxStoredPrefixLength, kept out-of-line by trees which store full prefixes. A tail is
+     * never changed once it is set, a node whose prefix changes gets a new one and the old one is reclaimed by the
+     * epoche like a node.
+     */
+    struct PrefixTail {
+        // length of the whole prefix the tail belongs to
+        uint32_t prefixLength;
+
+        uint8_t *getBytes() {
+            return reinterpret_cast<uint8_t *>(this + 1);
+        }
+
+        const uint8_t *getBytes() const {
+            return reinterpret_cast<const uint8_t *>(this + 1);
+        }
+
+        // a tail for the bytes [maxStoredPrefixLength, prefixLength), allocated with operator new
+        static PrefixTail *create(uint32_t prefixLength);
+    };
+
     class N {
     protected:
         N(NTypes type, const uint8_t *prefix, uint32_t prefixLength) {
@@ -52,6 +73,7 @@ namespace ART_OLC {
 
         uint8_t count = 0;
         Prefix prefix;
+        std::atomic<PrefixTail *> prefixTail{nullptr};
 
 
         void setType(NTypes type);
@@ -104,10 +126,34 @@ namespace ART_OLC {
 
         void setPrefix(const uint8_t *prefix, uint32_t length);
 
-        void addPrefixBefore(N *node, uint8_t key);
+        /**
+         * the tail keeps growing if both nodes store their full prefixes, the replaced tail is returned to be
+         * reclaimed by the caller
+         */
+        PrefixTail *addPrefixBefore(N *node, uint8_t key);
 
         uint32_t getPrefixLength() const;
 
+        /**
+         * the tail of the prefix of the given length, nullptr if the node has none or a concurrent change left the
+         * tail of another prefix
+         */
+        const PrefixTail *getPrefixTail(uint32_t prefixLength) const;
+
+        // keeps the bytes of the prefix set by the constructor which do not fit into it in a tail
+        void storePrefixTail(const uint8_t *prefix);
+
+        // byte i of a prefix which is stored completely, the node has to be locked
+        uint8_t getPrefixByte(uint32_t i) const;
+
+        bool hasFullPrefix() const;
+
+        /**
+         * drops the first count bytes of a prefix which is stored completely, the replaced tail is returned to be
+         * reclaimed by the caller
+         */
+        PrefixTail *cutPrefix(uint32_t count);
+
         static TID getLeaf(const N *n);
 
         static bool isLeaf(const N *n);
@@ -4,12 +4,32 @@
 
 #ifndef ART_OPTIMISTICLOCK_COUPLING_N_H
 #define ART_OPTIMISTICLOCK_COUPLING_N_H
+#include <cstddef>
+#include <type_traits>
 #include "N.h"
+#include "../../Include/Index.h"
+#include "../../Include/KeyLeaf.h"
 
 using namespace ART;
 
 namespace ART_OLC {
 
+    /**
+     * how prefixes longer than maxStoredPrefixLength are stored: cut off, the remaining bytes are read from the key of
+     * any leaf below the node with loadKey, or completely with the remaining bytes in a PrefixTail
+     */
+    enum class PrefixType : uint8_t {
+        Bounded,
+        Full
+    };
+
+    using ART::LeafType;
+
+    using ART::KeyLeaf;
+
+    template<class Value>
+    class ValueTree;
+
     class Tree {
     public:
         using LoadKeyFunction = void (*)(TID tid, Key &key);
@@ -21,8 +41,64 @@ namespace ART_OLC {
 
         LoadKeyFunction loadKey;
 
+        const PrefixType prefixType;
+
+        const LeafType leafType;
+
+        // size of the values of a ValueTree, 0 if the tree stores TIDs
+        const uint32_t valueSize;
+
         Epoche epoche{256};
 
+        void retirePrefixTail(const PrefixTail *tail, ThreadInfo &threadInfo);
+
+        // key of a leaf stored in the tree, from its KeyLeaf or loaded with loadKey
+        void loadLeafKey(TID leaf, Key &key) const {
+            ART::loadLeafKey(leafType, loadKey, leaf, key);
+        }
+
+        // copies the value of a leaf of a ValueTree
+        void loadLeafValue(TID leaf, void *value) const {
+            reinterpret_cast<const KeyLeaf *>(leaf)->loadValue(value, valueSize);
+        }
+
+        // TID of a leaf stored in the tree as handed to the user
+        TID getLeafTid(TID leaf) const {
+            return ART::getLeafTid(leafType, leaf);
+        }
+
+        // reclaims the KeyLeaf of a removed leaf once no reader can reach it anymore
+        void retireLeaf(TID leaf, ThreadInfo &threadInfo);
+
+        // frees the KeyLeafs of all leaves below node, the subtree is unreachable
+        void deleteKeyLeaves(const N *node);
+
+        // the leaf of k as stored in the tree or 0, the caller is in the epoche
+        TID lookupLeaf(const Key &k) const;
+
+        // calls emit(leaf, i) for the i-th leaf in the range, see lookupRange
+        template<class Emit>
+        bool scanRange(const Key &start, const Key &end, Key &continueKey, std::size_t resultSize,
+                       std::size_t &resultsFound, ThreadInfo &threadEpocheInfo, Emit emit) const;
+
+        void insertLeaf(const Key &k, N *leaf, ThreadInfo &epocheInfo);
+
+        /**
+         * a tree for ValueTree, its leaves are KeyLeafs with values of valueSize bytes instead of TIDs
+         */
+        Tree(PrefixType prefixType, uint32_t valueSize);
+
+        bool lookupValue(const Key &k, void *value, ThreadInfo &threadEpocheInfo) const;
+
+        // values are stored to the array values with a stride of valueSize
+        bool lookupRangeValues(const Key &start, const Key &end, Key &continueKey, void *values,
+                               std::size_t resultLen, std::size_t &resultCount, ThreadInfo &threadEpocheInfo) const;
+
+        void insertValue(const Key &k, const void *value, ThreadInfo &epocheInfo);
+
+        template<class Value>
+        friend class ValueTree;
+
     public:
         enum class CheckPrefixResult : uint8_t {
             Match,
@@ -47,22 +123,27 @@ namespace ART_OLC {
         };
         static CheckPrefixResult checkPrefix(N* n, const Key &k, uint32_t &level);
 
-        static CheckPrefixPessimisticResult checkPrefixPessimistic(N *n, const Key &k, uint32_t &level,
-                                                                   uint8_t &nonMatchingKey,
-                                                                   Prefix &nonMatchingPrefix,
-                                                                   LoadKeyFunction loadKey, bool &needRestart);
+        CheckPrefixPessimisticResult checkPrefixPessimistic(N *n, const Key &k, uint32_t &level,
+                                                            uint8_t &nonMatchingKey,
+                                                            Prefix &nonMatchingPrefix,
+                                                            bool &needRestart) const;
 
-        static PCCompareResults checkPrefixCompare(const N* n, const Key &k, uint8_t fillKey, uint32_t &level, LoadKeyFunction loadKey, bool &needRestart);
+        PCCompareResults checkPrefixCompare(const N* n, const Key &k, uint8_t fillKey, uint32_t &level, bool &needRestart) const;
 
-        static PCEqualsResults checkPrefixEquals(const N* n, uint32_t &level, const Key &start, const Key &end, LoadKeyFunction loadKey, bool &needRestart);
+        PCEqualsResults checkPrefixEquals(const N* n, uint32_t &level, const Key &start, const Key &end, bool &needRestart) const;
 
     public:
 
-        Tree(LoadKeyFunction loadKey);
+        /**
+         * loadKey may be nullptr in LeafType::EmbeddedKey mode, the tree then never needs the keys of its TIDs
+         */
+        Tree(LoadKeyFunction loadKey, PrefixType prefixType = PrefixType::Bounded,
+             LeafType leafType = LeafType::ExternalKey);
 
         Tree(const Tree &) = delete;
 
-        Tree(Tree &&t) : root(t.root), loadKey(t.loadKey) { }
+        Tree(Tree &&t) : root(t.root), loadKey(t.loadKey), prefixType(t.prefixType), leafType(t.leafType),
+                         valueSize(t.valueSize) { }
 
         ~Tree();
 
@@ -75,7 +156,66 @@ namespace ART_OLC {
 
         void insert(const Key &k, TID tid, ThreadInfo &epocheInfo);
 
+        /**
+         * Inserts n keys sorted in ascending order, unique and prefix free as for insert. Subtrees below a free slot
+         * of the root are built bottom-up in one pass, every node with its final type and prefix, keys below an
+         * occupied slot are inserted one by one. Independent subtrees are built in parallel on the tbb workers and
+         * linked under a single write lock of the root, concurrent operations only wait for the root while they are
+         * linked.
+         */
+        void bulkLoad(const Key keys[], const TID tids[], std::size_t n, ThreadInfo &epocheInfo);
+
         void remove(const Key &k, TID tid, ThreadInfo &epocheInfo);
     };
+
+    /**
+     * Tree which maps keys to values of any trivially copyable type instead of TIDs. The value is stored in the
+     * KeyLeaf next to the key the lookup compares anyway, in its TID word if it is not larger than 8 bytes, behind the
+     * key otherwise, a hit needs no access to a second table. As for Tree, a key must not be inserted twice and no key
+     * may be a prefix of another one.
+     */
+    template<class Value>
+    class ValueTree {
+        static_assert(std::is_trivially_copyable<Value>::value, "values are copied bytewise");
+        static_assert(alignof(Value) <= alignof(std::max_align_t), "values are stored with fundamental alignment");
+
+        Tree tree;
+
+    public:
+        explicit ValueTree(PrefixType prefixType = PrefixType::Bounded) : tree(prefixType, sizeof(Value)) { }
+
+        ThreadInfo getThreadInfo() {
+            return tree.getThreadInfo();
+        }
+
+        bool lookup(const Key &k, Value &value, ThreadInfo &threadEpocheInfo) const {
+            return tree.lookupValue(k, &value, threadEpocheInfo);
+        }
+
+        bool lookupRange(const Key &start, const Key &end, Key &continueKey, Value result[], std::size_t resultLen,
+                         std::size_t &resultCount, ThreadInfo &threadEpocheInfo) const {
+            return tree.lookupRangeValues(start, end, continueKey, result, resultLen, resultCount, threadEpocheInfo);
+        }
+
+        void insert(const Key &k, const Value &value, ThreadInfo &epocheInfo) {
+            tree.insertValue(k, &value, epocheInfo);
+        }
+
+        void remove(const Key &k, ThreadInfo &epocheInfo) {
+            tree.remove(k, 0, epocheInfo);
+        }
+    };
+}
+
+namespace ART {
+
+    template<>
+    struct IndexTraits<OptimisticLockCoupling, DRAM> {
+        using Tree = ART_OLC::Tree;
+
+        using ThreadInfo = ART::ThreadInfo;
+
+        using Pool = NoPool;
+    };
 }
 #endif //ART_OPTIMISTICLOCK_COUPLING_N_H
@@ -113,6 +113,8 @@ namespace ART_OLC {
         }
 
         auto nBig = new biggerN(n->getPrefix(), n->getPrefixLength());
+        // the tail is handed over, the old node is reclaimed without it
+        nBig->prefixTail.store(n->prefixTail.load(std::memory_order_relaxed), std::memory_order_relaxed);
         n->copyTo(nBig);
         nBig->insert(key, val);
 
@@ -225,6 +227,7 @@ namespace ART_OLC {
         }
 
         auto nSmall = new smallerN(n->getPrefix(), n->getPrefixLength());
+        nSmall->prefixTail.store(n->prefixTail.load(std::memory_order_relaxed), std::memory_order_relaxed);
 
         n->copyTo(nSmall);
         nSmall->remove(key);
@@ -316,7 +319,71 @@ namespace ART_OLC {
         }
     }
 
-    void N::addPrefixBefore(N *node, uint8_t key) {
+    PrefixTail *PrefixTail::create(uint32_t prefixLength) {
+        auto tail = static_cast<PrefixTail *>(operator new(sizeof(PrefixTail) + prefixLength - maxStoredPrefixLength));
+        tail->prefixLength = prefixLength;
+        return tail;
+    }
+
+    const PrefixTail *N::getPrefixTail(uint32_t prefixLength) const {
+        const PrefixTail *tail = prefixTail.load(std::memory_order_acquire);
+        if (tail == nullptr || tail->prefixLength != prefixLength) {
+            return nullptr;
+        }
+        return tail;
+    }
+
+    void N::storePrefixTail(const uint8_t *prefix) {
+        if (prefixCount > maxStoredPrefixLength) {
+            PrefixTail *tail = PrefixTail::create(prefixCount);
+            memcpy(tail->getBytes(), prefix + maxStoredPrefixLength, prefixCount - maxStoredPrefixLength);
+            prefixTail.store(tail, std::memory_order_release);
+        }
+    }
+
+    uint8_t N::getPrefixByte(uint32_t i) const {
+        if (i < maxStoredPrefixLength) {
+            return prefix[i];
+        }
+        return prefixTail.load(std::memory_order_relaxed)->getBytes()[i - maxStoredPrefixLength];
+    }
+
+    bool N::hasFullPrefix() const {
+        return prefixCount <= maxStoredPrefixLength || prefixTail.load(std::memory_order_relaxed) != nullptr;
+    }
+
+    PrefixTail *N::cutPrefix(uint32_t count) {
+        PrefixTail *oldTail = prefixTail.load(std::memory_order_relaxed);
+        uint32_t length = prefixCount - count;
+        PrefixTail *tail = nullptr;
+        if (length > maxStoredPrefixLength) {
+            tail = PrefixTail::create(length);
+            for (uint32_t i = maxStoredPrefixLength; i < length; ++i) {
+                tail->getBytes()[i - maxStoredPrefixLength] = getPrefixByte(count + i);
+            }
+        }
+        // every byte is read before it is overwritten
+        for (uint32_t i = 0; i < std::min(length, maxStoredPrefixLength); ++i) {
+            prefix[i] = getPrefixByte(count + i);
+        }
+        prefixCount = length;
+        prefixTail.store(tail, std::memory_order_release);
+        return oldTail;
+    }
+
+    PrefixTail *N::addPrefixBefore(N *node, uint8_t key) {
+        PrefixTail *oldTail = prefixTail.load(std::memory_order_relaxed);
+        uint32_t nodePrefixLength = node->getPrefixLength();
+        uint32_t length = nodePrefixLength + 1 + getPrefixLength();
+        PrefixTail *tail = nullptr;
+        if (length > maxStoredPrefixLength && node->hasFullPrefix() && hasFullPrefix()) {
+            tail = PrefixTail::create(length);
+            for (uint32_t i = maxStoredPrefixLength; i < length; ++i) {
+                tail->getBytes()[i - maxStoredPrefixLength] =
+                        i < nodePrefixLength ? node->getPrefixByte(i) :
+                        i == nodePrefixLength ? key : getPrefixByte(i - nodePrefixLength - 1);
+            }
+        }
         uint32_t prefixCopyCount = std::min(maxStoredPrefixLength, node->getPrefixLength() + 1);
         memmove(this->prefix + prefixCopyCount, this->prefix,
                 std::min(this->getPrefixLength(), maxStoredPrefixLength - prefixCopyCount));
@@ -325,6 +392,8 @@ namespace ART_OLC {
             this->prefix[prefixCopyCount - 1] = key;
         }
         this->prefixCount += node->getPrefixLength() + 1;
+        prefixTail.store(tail, std::memory_order_release);
+        return oldTail;
     }
 
 
@@ -357,6 +426,7 @@ namespace ART_OLC {
         if (N::isLeaf(node)) {
             return;
         }
+        operator delete(node->prefixTail.load());
         switch (node->getType()) {
             case NTypes::N4: {
                 auto n = static_cast<N4 *>(node);
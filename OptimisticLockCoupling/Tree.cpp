@@ -1,17 +1,34 @@
 #include <assert.h>
 #include <algorithm>
+#include <stdexcept>
+#include "tbb/parallel_for.h"
 #include "Include/Tree.h"
 #include "N.cpp"
 #include "../Include/Epoche.cpp"
+#include "../Include/BulkLoad.h"
 #include "../Include/Key.h"
 
 
 namespace ART_OLC {
 
-    Tree::Tree(LoadKeyFunction loadKey) : root(new N256( nullptr, 0)), loadKey(loadKey) {
+    Tree::Tree(LoadKeyFunction loadKey, PrefixType prefixType, LeafType leafType) : root(new N256( nullptr, 0)),
+                                                                                     loadKey(loadKey),
+                                                                                     prefixType(prefixType),
+                                                                                     leafType(leafType),
+                                                                                     valueSize(0) {
+        if (leafType == LeafType::ExternalKey && loadKey == nullptr) {
+            N::deleteNode(root);
+            throw std::invalid_argument("ART_OLC: loadKey is required without embedded keys");
+        }
+    }
+
+    Tree::Tree(PrefixType prefixType, uint32_t valueSize) : root(new N256( nullptr, 0)), loadKey(nullptr),
+                                                            prefixType(prefixType), leafType(LeafType::EmbeddedKey),
+                                                            valueSize(valueSize) {
     }
 
     Tree::~Tree() {
+        deleteKeyLeaves(root);
         N::deleteChildren(root);
         N::deleteNode(root);
     }
@@ -22,6 +39,21 @@ namespace ART_OLC {
 
     TID Tree::lookup(const Key &k, ThreadInfo &threadEpocheInfo) const {
         EpocheGuardReadonly epocheGuard(threadEpocheInfo);
+        TID leaf = lookupLeaf(k);
+        return leaf == 0 ? 0 : getLeafTid(leaf);
+    }
+
+    bool Tree::lookupValue(const Key &k, void *value, ThreadInfo &threadEpocheInfo) const {
+        EpocheGuardReadonly epocheGuard(threadEpocheInfo);
+        TID leaf = lookupLeaf(k);
+        if (leaf == 0) {
+            return false;
+        }
+        loadLeafValue(leaf, value);
+        return true;
+    }
+
+    TID Tree::lookupLeaf(const Key &k) const {
         restart:
         bool needRestart = false;
 
@@ -78,6 +110,24 @@ namespace ART_OLC {
 
     bool Tree::lookupRange(const Key &start, const Key &end, Key &continueKey, TID result[],
                                 std::size_t resultSize, std::size_t &resultsFound, ThreadInfo &threadEpocheInfo) const {
+        return scanRange(start, end, continueKey, resultSize, resultsFound, threadEpocheInfo,
+                         [&result, this](TID leaf, std::size_t i) {
+                             result[i] = getLeafTid(leaf);
+                         });
+    }
+
+    bool Tree::lookupRangeValues(const Key &start, const Key &end, Key &continueKey, void *values,
+                                 std::size_t resultSize, std::size_t &resultsFound,
+                                 ThreadInfo &threadEpocheInfo) const {
+        return scanRange(start, end, continueKey, resultSize, resultsFound, threadEpocheInfo,
+                         [values, this](TID leaf, std::size_t i) {
+                             loadLeafValue(leaf, static_cast<uint8_t *>(values) + i * valueSize);
+                         });
+    }
+
+    template<class Emit>
+    bool Tree::scanRange(const Key &start, const Key &end, Key &continueKey, std::size_t resultSize,
+                         std::size_t &resultsFound, ThreadInfo &threadEpocheInfo, Emit emit) const {
         for (uint32_t i = 0; i < std::min(start.getKeyLen(), end.getKeyLen()); ++i) {
             if (start[i] > end[i]) {
                 resultsFound = 0;
@@ -88,13 +138,13 @@ namespace ART_OLC {
         }
         EpocheGuard epocheGuard(threadEpocheInfo);
         TID toContinue = 0;
-        std::function<void(const N *)> copy = [&result, &resultSize, &resultsFound, &toContinue, &copy](const N *node) {
+        std::function<void(const N *)> copy = [&emit, &resultSize, &resultsFound, &toContinue, &copy](const N *node) {
             if (N::isLeaf(node)) {
                 if (resultsFound == resultSize) {
                     toContinue = N::getLeaf(node);
                     return;
                 }
-                result[resultsFound] = N::getLeaf(node);
+                emit(N::getLeaf(node), resultsFound);
                 resultsFound++;
             } else {
                 std::tuple<uint8_t, N *> children[256];
@@ -124,7 +174,7 @@ namespace ART_OLC {
                 v = node->readLockOrRestart(needRestart);
                 if (needRestart) goto readAgain;
 
-                prefixResult = checkPrefixCompare(node, start, 0, level, loadKey, needRestart);
+                prefixResult = checkPrefixCompare(node, start, 0, level, needRestart);
                 if (needRestart) goto readAgain;
 
                 parentNode->readUnlockOrRestart(vp, needRestart);
@@ -191,7 +241,7 @@ namespace ART_OLC {
                 v = node->readLockOrRestart(needRestart);
                 if (needRestart) goto readAgain;
 
-                prefixResult = checkPrefixCompare(node, end, 255, level, loadKey, needRestart);
+                prefixResult = checkPrefixCompare(node, end, 255, level, needRestart);
                 if (needRestart) goto readAgain;
 
                 parentNode->readUnlockOrRestart(vp, needRestart);
@@ -263,7 +313,7 @@ namespace ART_OLC {
             PCEqualsResults prefixResult;
             v = node->readLockOrRestart(needRestart);
             if (needRestart) goto restart;
-            prefixResult = checkPrefixEquals(node, level, start, end, loadKey, needRestart);
+            prefixResult = checkPrefixEquals(node, level, start, end, needRestart);
             if (needRestart) goto restart;
             if (parentNode != nullptr) {
                 parentNode->readUnlockOrRestart(vp, needRestart);
@@ -314,7 +364,7 @@ namespace ART_OLC {
             break;
         }
         if (toContinue != 0) {
-            loadKey(toContinue, continueKey);
+            loadLeafKey(toContinue, continueKey);
             return true;
         } else {
             return false;
@@ -322,16 +372,60 @@ namespace ART_OLC {
     }
 
 
-    TID Tree::checkKey(const TID tid, const Key &k) const {
+    TID Tree::checkKey(const TID leaf, const Key &k) const {
+        if (leafType == LeafType::EmbeddedKey) {
+            auto l = reinterpret_cast<const KeyLeaf *>(leaf);
+            if (l->hasKey(k)) {
+                return leaf;
+            }
+            return 0;
+        }
         Key kt;
-        this->loadKey(tid, kt);
+        this->loadKey(leaf, kt);
         if (k == kt) {
-            return tid;
+            return leaf;
         }
         return 0;
     }
 
+    void Tree::retireLeaf(TID leaf, ThreadInfo &threadInfo) {
+        if (leafType == LeafType::EmbeddedKey) {
+            epoche.markNodeForDeletion(reinterpret_cast<KeyLeaf *>(leaf), threadInfo);
+        }
+    }
+
+    void Tree::deleteKeyLeaves(const N *node) {
+        if (leafType == LeafType::ExternalKey) {
+            return;
+        }
+        if (N::isLeaf(node)) {
+            operator delete(reinterpret_cast<KeyLeaf *>(N::getLeaf(node)));
+            return;
+        }
+        std::tuple<uint8_t, N *> children[256];
+        uint32_t childrenCount = 0;
+        N::getChildren(node, 0u, 255u, children, childrenCount);
+        for (uint32_t i = 0; i < childrenCount; ++i) {
+            deleteKeyLeaves(std::get<1>(children[i]));
+        }
+    }
+
+    void Tree::retirePrefixTail(const PrefixTail *tail, ThreadInfo &threadInfo) {
+        if (tail != nullptr) {
+            // readers which entered the epoche before the change may still compare against it
+            epoche.markNodeForDeletion(const_cast<PrefixTail *>(tail), threadInfo);
+        }
+    }
+
     void Tree::insert(const Key &k, TID tid, ThreadInfo &epocheInfo) {
+        insertLeaf(k, N::setLeaf(makeLeaf(leafType, k, tid)), epocheInfo);
+    }
+
+    void Tree::insertValue(const Key &k, const void *value, ThreadInfo &epocheInfo) {
+        insertLeaf(k, N::setLeaf(reinterpret_cast<TID>(KeyLeaf::create(k, value, valueSize))), epocheInfo);
+    }
+
+    void Tree::insertLeaf(const Key &k, N *leaf, ThreadInfo &epocheInfo) {
         EpocheGuard epocheGuard(epocheInfo);
         restart:
         bool needRestart = false;
@@ -355,7 +449,7 @@ namespace ART_OLC {
             uint8_t nonMatchingKey;
             Prefix remainingPrefix;
             auto res = checkPrefixPessimistic(node, k, nextLevel, nonMatchingKey, remainingPrefix,
-                                   this->loadKey, needRestart); // increases level
+                                              needRestart); // increases level
             if (needRestart) goto restart;
             switch (res) {
                 case CheckPrefixPessimisticResult::NoMatch: {
@@ -369,9 +463,12 @@ namespace ART_OLC {
                     }
                     // 1) Create new node which will be parent of node, Set common prefix, level to this node
                     auto newNode = new N4(node->getPrefix(), nextLevel - level);
+                    if (prefixType == PrefixType::Full) {
+                        newNode->storePrefixTail(&k[level]);
+                    }
 
                     // 2)  add node and (tid, *k) as children
-                    newNode->insert(k[nextLevel], N::setLeaf(tid));
+                    newNode->insert(k[nextLevel], leaf);
                     newNode->insert(nonMatchingKey, node);
 
                     // 3) upgradeToWriteLockOrRestart, update parentNode to point to the new node, unlock
@@ -379,8 +476,12 @@ namespace ART_OLC {
                     parentNode->writeUnlock();
 
                     // 4) update prefix of node, unlock
-                    node->setPrefix(remainingPrefix,
-                                    node->getPrefixLength() - ((nextLevel - level) + 1));
+                    if (prefixType == PrefixType::Full) {
+                        retirePrefixTail(node->cutPrefix((nextLevel - level) + 1), epocheInfo);
+                    } else {
+                        node->setPrefix(remainingPrefix,
+                                        node->getPrefixLength() - ((nextLevel - level) + 1));
+                    }
 
                     node->writeUnlock();
                     return;
@@ -395,7 +496,7 @@ namespace ART_OLC {
             if (needRestart) goto restart;
 
             if (nextNode == nullptr) {
-                N::insertAndUnlock(node, v, parentNode, parentVersion, parentKey, nodeKey, N::setLeaf(tid), needRestart, epocheInfo);
+                N::insertAndUnlock(node, v, parentNode, parentVersion, parentKey, nodeKey, leaf, needRestart, epocheInfo);
                 if (needRestart) goto restart;
                 return;
             }
@@ -410,7 +511,7 @@ namespace ART_OLC {
                 if (needRestart) goto restart;
 
                 Key key;
-                loadKey(N::getLeaf(nextNode), key);
+                loadLeafKey(N::getLeaf(nextNode), key);
 
                 level++;
                 uint32_t prefixLength = 0;
@@ -419,7 +520,10 @@ namespace ART_OLC {
                 }
 
                 auto n4 = new N4(&k[level], prefixLength);
-                n4->insert(k[level + prefixLength], N::setLeaf(tid));
+                if (prefixType == PrefixType::Full) {
+                    n4->storePrefixTail(&k[level]);
+                }
+                n4->insert(k[level + prefixLength], leaf);
                 n4->insert(key[level + prefixLength], nextNode);
                 N::change(node, k[level - 1], n4);
                 node->writeUnlock();
@@ -430,6 +534,116 @@ namespace ART_OLC {
         }
     }
 
+    namespace {
+        using namespace ART::BulkLoad;
+
+        N *buildSubtree(const Key keys[], const TID tids[], std::size_t begin, std::size_t end, uint32_t level,
+                        PrefixType prefixType, LeafType leafType);
+
+        template<class NODE>
+        N *buildNode(const Key keys[], const TID tids[], std::size_t begin, std::size_t end, uint32_t level,
+                     uint32_t prefixLength, PrefixType prefixType, LeafType leafType) {
+            uint32_t nodeLevel = level + prefixLength;
+            auto node = new NODE(&keys[begin][level], prefixLength);
+            if (prefixType == PrefixType::Full) {
+                node->storePrefixTail(&keys[begin][level]);
+            }
+            if (end - begin < parallelBuildThreshold) {
+                for (std::size_t i = begin; i < end;) {
+                    std::size_t j = groupEnd(keys, i, end, nodeLevel);
+                    node->insert(keys[i][nodeLevel], buildSubtree(keys, tids, i, j, nodeLevel + 1, prefixType, leafType));
+                    i = j;
+                }
+                return node;
+            }
+            // the subtrees of the children are independent, they are built in parallel and inserted in key order
+            std::size_t bounds[257];
+            unsigned count = groupBounds(keys, begin, end, nodeLevel, bounds);
+            N *children[256];
+            tbb::parallel_for(0u, count, [&](unsigned g) {
+                children[g] = buildSubtree(keys, tids, bounds[g], bounds[g + 1], nodeLevel + 1, prefixType, leafType);
+            });
+            for (unsigned g = 0; g < count; ++g) {
+                node->insert(keys[bounds[g]][nodeLevel], children[g]);
+            }
+            return node;
+        }
+
+        /**
+         * builds the subtree of the sorted range [begin, end) whose keys share the bytes before level, every node is
+         * allocated with the type fitting its final number of children
+         */
+        N *buildSubtree(const Key keys[], const TID tids[], std::size_t begin, std::size_t end, uint32_t level,
+                        PrefixType prefixType, LeafType leafType) {
+            if (end - begin == 1) {
+                return N::setLeaf(makeLeaf(leafType, keys[begin], tids[begin]));
+            }
+            uint32_t prefixLength = commonPrefixLength(keys, begin, end, level);
+            if (level + prefixLength == keys[begin].getKeyLen()) {
+                // all keys are the same, the first one wins
+                return N::setLeaf(makeLeaf(leafType, keys[begin], tids[begin]));
+            }
+            unsigned children = groupCount(keys, begin, end, level + prefixLength);
+            if (children <= 4) {
+                return buildNode<N4>(keys, tids, begin, end, level, prefixLength, prefixType, leafType);
+            } else if (children <= 16) {
+                return buildNode<N16>(keys, tids, begin, end, level, prefixLength, prefixType, leafType);
+            } else if (children <= 48) {
+                return buildNode<N48>(keys, tids, begin, end, level, prefixLength, prefixType, leafType);
+            }
+            return buildNode<N256>(keys, tids, begin, end, level, prefixLength, prefixType, leafType);
+        }
+    }
+
+    void Tree::bulkLoad(const Key keys[], const TID tids[], std::size_t n, ThreadInfo &epocheInfo) {
+        if (n == 0) {
+            return;
+        }
+        std::size_t bounds[257];
+        unsigned count = groupBounds(keys, 0, n, 0, bounds);
+        // built without locks, nobody else can reach them yet
+        N *subtrees[256];
+        tbb::parallel_for(0u, count, [&](unsigned g) {
+            subtrees[g] = nullptr;
+            if (N::getChild(keys[bounds[g]][0], root) == nullptr) {
+                subtrees[g] = buildSubtree(keys, tids, bounds[g], bounds[g + 1], 1, prefixType, leafType);
+            }
+        });
+
+        // all subtrees are linked under a single write lock of the root
+        bool linked[256];
+        bool needRestart;
+        do {
+            needRestart = false;
+            root->writeLockOrRestart(needRestart);
+        } while (needRestart);
+        for (unsigned g = 0; g < count; ++g) {
+            uint8_t key = keys[bounds[g]][0];
+            linked[g] = subtrees[g] != nullptr && N::getChild(key, root) == nullptr;
+            if (linked[g]) {
+                static_cast<N256 *>(root)->insert(key, subtrees[g]);
+            }
+        }
+        root->writeUnlock();
+
+        for (unsigned g = 0; g < count; ++g) {
+            if (linked[g]) {
+                continue;
+            }
+            if (subtrees[g] != nullptr) {
+                deleteKeyLeaves(subtrees[g]);
+                N::deleteChildren(subtrees[g]);
+                if (!N::isLeaf(subtrees[g])) {
+                    N::deleteNode(subtrees[g]);
+                }
+            }
+            // the subtree exists already
+            for (std::size_t k = bounds[g]; k < bounds[g + 1]; ++k) {
+                insert(keys[k], tids[k], epocheInfo);
+            }
+        }
+    }
+
     void Tree::remove(const Key &k, TID tid, ThreadInfo &threadInfo) {
         EpocheGuard epocheGuard(threadInfo);
         restart:
@@ -469,7 +683,9 @@ namespace ART_OLC {
                         return;
                     }
                     if (N::isLeaf(nextNode)) {
-                        if (N::getLeaf(nextNode) != tid) {
+                        // the leaves of a ValueTree are removed by key alone
+                        if (valueSize == 0 ? getLeafTid(N::getLeaf(nextNode)) != tid
+                                           : checkKey(N::getLeaf(nextNode), k) == 0) {
                             return;
                         }
                         assert(parentNode == nullptr || node->getCount() != 1);
@@ -493,6 +709,8 @@ namespace ART_OLC {
                                 parentNode->writeUnlock();
                                 node->writeUnlockObsolete();
                                 this->epoche.markNodeForDeletion(node, threadInfo);
+                                retirePrefixTail(node->getPrefixTail(node->getPrefixLength()), threadInfo);
+                                retireLeaf(N::getLeaf(nextNode), threadInfo);
                             } else {
                                 secondNodeN->writeLockOrRestart(needRestart);
                                 if (needRestart) {
@@ -505,15 +723,18 @@ namespace ART_OLC {
                                 N::change(parentNode, parentKey, secondNodeN);
                                 parentNode->writeUnlock();
 
-                                secondNodeN->addPrefixBefore(node, secondNodeK);
+                                retirePrefixTail(secondNodeN->addPrefixBefore(node, secondNodeK), threadInfo);
                                 secondNodeN->writeUnlock();
 
                                 node->writeUnlockObsolete();
                                 this->epoche.markNodeForDeletion(node, threadInfo);
+                                retirePrefixTail(node->getPrefixTail(node->getPrefixLength()), threadInfo);
+                                retireLeaf(N::getLeaf(nextNode), threadInfo);
                             }
                         } else {
                             N::removeAndUnlock(node, v, k[level], parentNode, parentVersion, parentKey, needRestart, threadInfo);
                             if (needRestart) goto restart;
+                            retireLeaf(N::getLeaf(nextNode), threadInfo);
                         }
                         return;
                     }
@@ -546,29 +767,36 @@ namespace ART_OLC {
     typename Tree::CheckPrefixPessimisticResult Tree::checkPrefixPessimistic(N *n, const Key &k, uint32_t &level,
                                                                         uint8_t &nonMatchingKey,
                                                                         Prefix &nonMatchingPrefix,
-                                                                        LoadKeyFunction loadKey, bool &needRestart) {
+                                                                        bool &needRestart) const {
         if (n->hasPrefix()) {
-            uint32_t prevLevel = level;
+            uint32_t prefixLength = n->getPrefixLength();
+            // bytes beyond the stored prefix come from the tail, or from the key of a leaf if there is none
+            const PrefixTail *tail = n->getPrefixTail(prefixLength);
             Key kt;
-            for (uint32_t i = 0; i < n->getPrefixLength(); ++i) {
-                if (i == maxStoredPrefixLength) {
+            for (uint32_t i = 0; i < prefixLength; ++i) {
+                if (i == maxStoredPrefixLength && tail == nullptr) {
                     auto anyTID = N::getAnyChildTid(n, needRestart);
                     if (needRestart) return CheckPrefixPessimisticResult::Match;
-                    loadKey(anyTID, kt);
+                    loadLeafKey(anyTID, kt);
                 }
-                uint8_t curKey = i >= maxStoredPrefixLength ? kt[level] : n->getPrefix()[i];
+                uint8_t curKey = i < maxStoredPrefixLength ? n->getPrefix()[i] :
+                                 tail != nullptr ? tail->getBytes()[i - maxStoredPrefixLength] : kt[level];
                 if (curKey != k[level]) {
                     nonMatchingKey = curKey;
-                    if (n->getPrefixLength() > maxStoredPrefixLength) {
+                    uint32_t remaining = std::min(prefixLength - i - 1, maxStoredPrefixLength);
+                    if (prefixLength > maxStoredPrefixLength && tail == nullptr) {
                         if (i < maxStoredPrefixLength) {
                             auto anyTID = N::getAnyChildTid(n, needRestart);
                             if (needRestart) return CheckPrefixPessimisticResult::Match;
-                            loadKey(anyTID, kt);
+                            loadLeafKey(anyTID, kt);
                         }
-                        memcpy(nonMatchingPrefix, &kt[0] + level + 1, std::min((n->getPrefixLength() - (level - prevLevel) - 1),
-                                                                           maxStoredPrefixLength));
+                        memcpy(nonMatchingPrefix, &kt[0] + level + 1, remaining);
                     } else {
-                        memcpy(nonMatchingPrefix, n->getPrefix() + i + 1, n->getPrefixLength() - i - 1);
+                        for (uint32_t j = 0; j < remaining; ++j) {
+                            uint32_t pos = i + 1 + j;
+                            nonMatchingPrefix[j] = pos < maxStoredPrefixLength ? n->getPrefix()[pos] :
+                                                   tail->getBytes()[pos - maxStoredPrefixLength];
+                        }
                     }
                     return CheckPrefixPessimisticResult::NoMatch;
                 }
@@ -579,18 +807,21 @@ namespace ART_OLC {
     }
 
     typename Tree::PCCompareResults Tree::checkPrefixCompare(const N *n, const Key &k, uint8_t fillKey, uint32_t &level,
-                                                        LoadKeyFunction loadKey, bool &needRestart) {
+                                                        bool &needRestart) const {
         if (n->hasPrefix()) {
+            uint32_t prefixLength = n->getPrefixLength();
+            const PrefixTail *tail = n->getPrefixTail(prefixLength);
             Key kt;
-            for (uint32_t i = 0; i < n->getPrefixLength(); ++i) {
-                if (i == maxStoredPrefixLength) {
+            for (uint32_t i = 0; i < prefixLength; ++i) {
+                if (i == maxStoredPrefixLength && tail == nullptr) {
                     auto anyTID = N::getAnyChildTid(n, needRestart);
                     if (needRestart) return PCCompareResults::Equal;
-                    loadKey(anyTID, kt);
+                    loadLeafKey(anyTID, kt);
                 }
                 uint8_t kLevel = (k.getKeyLen() > level) ? k[level] : fillKey;
 
-                uint8_t curKey = i >= maxStoredPrefixLength ? kt[level] : n->getPrefix()[i];
+                uint8_t curKey = i < maxStoredPrefixLength ? n->getPrefix()[i] :
+                                 tail != nullptr ? tail->getBytes()[i - maxStoredPrefixLength] : kt[level];
                 if (curKey < kLevel) {
                     return PCCompareResults::Smaller;
                 } else if (curKey > kLevel) {
@@ -603,19 +834,22 @@ namespace ART_OLC {
     }
 
     typename Tree::PCEqualsResults Tree::checkPrefixEquals(const N *n, uint32_t &level, const Key &start, const Key &end,
-                                                      LoadKeyFunction loadKey, bool &needRestart) {
+                                                      bool &needRestart) const {
         if (n->hasPrefix()) {
+            uint32_t prefixLength = n->getPrefixLength();
+            const PrefixTail *tail = n->getPrefixTail(prefixLength);
             Key kt;
-            for (uint32_t i = 0; i < n->getPrefixLength(); ++i) {
-                if (i == maxStoredPrefixLength) {
+            for (uint32_t i = 0; i < prefixLength; ++i) {
+                if (i == maxStoredPrefixLength && tail == nullptr) {
                     auto anyTID = N::getAnyChildTid(n, needRestart);
                     if (needRestart) return PCEqualsResults::BothMatch;
-                    loadKey(anyTID, kt);
+                    loadLeafKey(anyTID, kt);
                 }
                 uint8_t startLevel = (start.getKeyLen() > level) ? start[level] : 0;
                 uint8_t endLevel = (end.getKeyLen() > level) ? end[level] : 255;
 
-                uint8_t curKey = i >= maxStoredPrefixLength ? kt[level] : n->getPrefix()[i];
+                uint8_t curKey = i < maxStoredPrefixLength ? n->getPrefix()[i] :
+                                 tail != nullptr ? tail->getBytes()[i - maxStoredPrefixLength] : kt[level];
                 if (curKey > startLevel && curKey < endLevel) {
                     return PCEqualsResults::Contained;
                 } else if (curKey < startLevel || curKey > endLevel) {
@@ -37,6 +37,28 @@ namespace ART_ROWEX {
     };
     static_assert(sizeof(Prefix) == 8, "Prefix should be 64 bit long");
 
+    /**
+     * Bytes of a prefix beyond maxStoredPrefixLength, kept out-of-line by trees which store full prefixes. A tail is
+     * never changed once it is set, a node whose prefix changes gets a new one and the old one is reclaimed by the
+     * epoche like a node. Readers load the tail and the prefix separately and only use the tail if its length
+     * matches the prefix they read.
+     */
+    struct PrefixTail {
+        // length of the whole prefix the tail belongs to
+        uint32_t prefixLength;
+
+        uint8_t *getBytes() {
+            return reinterpret_cast<uint8_t *>(this + 1);
+        }
+
+        const uint8_t *getBytes() const {
+            return reinterpret_cast<const uint8_t *>(this + 1);
+        }
+
+        // a tail for the bytes [maxStoredPrefixLength, prefixLength), allocated with operator new
+        static PrefixTail *create(uint32_t prefixLength);
+    };
+
     class N {
     protected:
         N(NTypes type, uint32_t level, const uint8_t *prefix, uint32_t prefixLength) : level(level) {
@@ -56,6 +78,7 @@ namespace ART_ROWEX {
         std::atomic<uint64_t> typeVersionLockObsolete{0b100};
         // version 1, unlocked, not obsolete
         std::atomic<Prefix> prefix;
+        std::atomic<PrefixTail *> prefixTail{nullptr};
         const uint32_t level;
         uint16_t count = 0;
         uint16_t compactCount = 0;
@@ -112,7 +135,31 @@ namespace ART_ROWEX {
 
         void setPrefix(const uint8_t *prefix, uint32_t length);
 
-        void addPrefixBefore(N *node, uint8_t key);
+        /**
+         * the tail keeps growing if both nodes store their full prefixes, the replaced tail is returned to be
+         * reclaimed by the caller
+         */
+        PrefixTail *addPrefixBefore(N *node, uint8_t key);
+
+        /**
+         * the tail of the prefix of the given length, nullptr if the node has none or a concurrent change left the
+         * tail of another prefix
+         */
+        const PrefixTail *getPrefixTail(uint32_t prefixLength) const;
+
+        // keeps the bytes of the prefix set by the constructor which do not fit into it in a tail
+        void storePrefixTail(const uint8_t *prefix);
+
+        // byte i of a prefix which is stored completely, the node has to be locked
+        uint8_t getPrefixByte(uint32_t i) const;
+
+        bool hasFullPrefix() const;
+
+        /**
+         * drops the first count bytes of a prefix which is stored completely, the replaced tail is returned to be
+         * reclaimed by the caller
+         */
+        PrefixTail *cutPrefix(uint32_t count);
 
         static TID getLeaf(const N *n);
 
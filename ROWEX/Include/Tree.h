@@ -5,11 +5,26 @@
 #ifndef ART_ROWEX_TREE_H
 #define ART_ROWEX_TREE_H
 #include "N.h"
+#include "../../Include/Index.h"
+#include "../../Include/KeyLeaf.h"
 
 using namespace ART;
 
 namespace ART_ROWEX {
 
+    /**
+     * how prefixes longer than maxStoredPrefixLength are stored: cut off, the remaining bytes are read from the key of
+     * any leaf below the node with loadKey, or completely with the remaining bytes in a PrefixTail
+     */
+    enum class PrefixType : uint8_t {
+        Bounded,
+        Full
+    };
+
+    using ART::LeafType;
+
+    using ART::KeyLeaf;
+
     class Tree {
     public:
         using LoadKeyFunction = void (*)(TID tid, Key &key);
@@ -21,8 +36,30 @@ namespace ART_ROWEX {
 
         LoadKeyFunction loadKey;
 
+        const PrefixType prefixType;
+
+        const LeafType leafType;
+
         Epoche epoche{256};
 
+        void retirePrefixTail(const PrefixTail *tail, ThreadInfo &threadInfo);
+
+        // key of a leaf stored in the tree, from its KeyLeaf or loaded with loadKey
+        void loadLeafKey(TID leaf, Key &key) const {
+            ART::loadLeafKey(leafType, loadKey, leaf, key);
+        }
+
+        // TID of a leaf stored in the tree as handed to the user
+        TID getLeafTid(TID leaf) const {
+            return ART::getLeafTid(leafType, leaf);
+        }
+
+        // reclaims the KeyLeaf of a removed leaf once no reader can reach it anymore
+        void retireLeaf(TID leaf, ThreadInfo &threadInfo);
+
+        // frees the KeyLeafs of all leaves below node, the subtree is unreachable
+        void deleteKeyLeaves(const N *node);
+
     public:
         enum class CheckPrefixResult : uint8_t {
             Match,
@@ -50,22 +87,25 @@ namespace ART_ROWEX {
         };
         static CheckPrefixResult checkPrefix(N* n, const Key &k, uint32_t &level);
 
-        static CheckPrefixPessimisticResult checkPrefixPessimistic(N *n, const Key &k, uint32_t &level,
-                                                                   uint8_t &nonMatchingKey,
-                                                                   Prefix &nonMatchingPrefix,
-                                                                   LoadKeyFunction loadKey);
+        CheckPrefixPessimisticResult checkPrefixPessimistic(N *n, const Key &k, uint32_t &level,
+                                                            uint8_t &nonMatchingKey,
+                                                            Prefix &nonMatchingPrefix) const;
 
-        static PCCompareResults checkPrefixCompare(const N* n, const Key &k, uint32_t &level, LoadKeyFunction loadKey);
+        PCCompareResults checkPrefixCompare(const N* n, const Key &k, uint32_t &level) const;
 
-        static PCEqualsResults checkPrefixEquals(const N* n, uint32_t &level, const Key &start, const Key &end, LoadKeyFunction loadKey);
+        PCEqualsResults checkPrefixEquals(const N* n, uint32_t &level, const Key &start, const Key &end) const;
 
     public:
 
-        Tree(LoadKeyFunction loadKey);
+        /**
+         * loadKey may be nullptr in LeafType::EmbeddedKey mode, the tree then never needs the keys of its TIDs
+         */
+        Tree(LoadKeyFunction loadKey, PrefixType prefixType = PrefixType::Bounded,
+             LeafType leafType = LeafType::ExternalKey);
 
         Tree(const Tree &) = delete;
 
-        Tree(Tree &&t) : root(t.root), loadKey(t.loadKey) { }
+        Tree(Tree &&t) : root(t.root), loadKey(t.loadKey), prefixType(t.prefixType), leafType(t.leafType) { }
 
         ~Tree();
 
@@ -78,7 +118,28 @@ namespace ART_ROWEX {
 
         void insert(const Key &k, TID tid, ThreadInfo &epocheInfo);
 
+        /**
+         * Inserts n keys sorted in ascending order, unique and prefix free as for insert. Subtrees below a free slot
+         * of the root are built bottom-up in one pass, every node with its final type and prefix, keys below an
+         * occupied slot are inserted one by one. Independent subtrees are built in parallel on the tbb workers and
+         * linked under a single write lock of the root, concurrent operations only wait for the root while they are
+         * linked.
+         */
+        void bulkLoad(const Key keys[], const TID tids[], std::size_t n, ThreadInfo &epocheInfo);
+
         void remove(const Key &k, TID tid, ThreadInfo &epocheInfo);
     };
 }
+
+namespace ART {
+
+    template<>
+    struct IndexTraits<ROWEX, DRAM> {
+        using Tree = ART_ROWEX::Tree;
+
+        using ThreadInfo = ART::ThreadInfo;
+
+        using Pool = NoPool;
+    };
+}
 #endif //ART_ROWEX_TREE_H
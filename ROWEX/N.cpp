@@ -112,6 +112,8 @@ namespace ART_ROWEX {
             return;
         }
         auto nBig = new biggerN(n->getLevel(), n->getPrefi());
+        // the tail is handed over, the old node is reclaimed without it
+        nBig->prefixTail.store(n->prefixTail.load(std::memory_order_relaxed), std::memory_order_relaxed);
         n->copyTo(nBig);
         nBig->insert(key, val);
 
@@ -132,6 +134,7 @@ namespace ART_ROWEX {
     template<typename curN>
     void N::insertCompact(curN *n, N *parentNode, uint8_t keyParent, uint8_t key, N *val, ThreadInfo &threadInfo, bool &needRestart) {
         auto nNew = new curN(n->getLevel(), n->getPrefi());
+        nNew->prefixTail.store(n->prefixTail.load(std::memory_order_relaxed), std::memory_order_relaxed);
         n->copyTo(nNew);
         nNew->insert(key, val);
 
@@ -248,6 +251,7 @@ namespace ART_ROWEX {
         }
 
         auto nSmall = new smallerN(n->getLevel(), n->getPrefi());
+        nSmall->prefixTail.store(n->prefixTail.load(std::memory_order_relaxed), std::memory_order_relaxed);
 
         parentNode->writeLockOrRestart(needRestart);
         if (needRestart) {
@@ -332,9 +336,73 @@ namespace ART_ROWEX {
         }
     }
 
-    void N::addPrefixBefore(N* node, uint8_t key) {
+    PrefixTail *PrefixTail::create(uint32_t prefixLength) {
+        auto tail = static_cast<PrefixTail *>(operator new(sizeof(PrefixTail) + prefixLength - maxStoredPrefixLength));
+        tail->prefixLength = prefixLength;
+        return tail;
+    }
+
+    const PrefixTail *N::getPrefixTail(uint32_t prefixLength) const {
+        const PrefixTail *tail = prefixTail.load(std::memory_order_acquire);
+        if (tail == nullptr || tail->prefixLength != prefixLength) {
+            return nullptr;
+        }
+        return tail;
+    }
+
+    void N::storePrefixTail(const uint8_t *prefix) {
+        uint32_t prefixCount = getPrefi().prefixCount;
+        if (prefixCount > maxStoredPrefixLength) {
+            PrefixTail *tail = PrefixTail::create(prefixCount);
+            memcpy(tail->getBytes(), prefix + maxStoredPrefixLength, prefixCount - maxStoredPrefixLength);
+            prefixTail.store(tail, std::memory_order_release);
+        }
+    }
+
+    uint8_t N::getPrefixByte(uint32_t i) const {
+        if (i < maxStoredPrefixLength) {
+            return getPrefi().prefix[i];
+        }
+        return prefixTail.load(std::memory_order_relaxed)->getBytes()[i - maxStoredPrefixLength];
+    }
+
+    bool N::hasFullPrefix() const {
+        return getPrefi().prefixCount <= maxStoredPrefixLength || prefixTail.load(std::memory_order_relaxed) != nullptr;
+    }
+
+    PrefixTail *N::cutPrefix(uint32_t count) {
+        PrefixTail *oldTail = prefixTail.load(std::memory_order_relaxed);
+        Prefix p;
+        p.prefixCount = getPrefi().prefixCount - count;
+        PrefixTail *tail = nullptr;
+        if (p.prefixCount > maxStoredPrefixLength) {
+            tail = PrefixTail::create(p.prefixCount);
+            for (uint32_t i = maxStoredPrefixLength; i < p.prefixCount; ++i) {
+                tail->getBytes()[i - maxStoredPrefixLength] = getPrefixByte(count + i);
+            }
+        }
+        for (uint32_t i = 0; i < std::min(p.prefixCount, maxStoredPrefixLength); ++i) {
+            p.prefix[i] = getPrefixByte(count + i);
+        }
+        prefixTail.store(tail, std::memory_order_release);
+        this->prefix.store(p, std::memory_order_release);
+        return oldTail;
+    }
+
+    PrefixTail *N::addPrefixBefore(N* node, uint8_t key) {
         Prefix p = this->getPrefi();
         Prefix nodeP = node->getPrefi();
+        PrefixTail *oldTail = prefixTail.load(std::memory_order_relaxed);
+        uint32_t length = nodeP.prefixCount + 1 + p.prefixCount;
+        PrefixTail *tail = nullptr;
+        if (length > maxStoredPrefixLength && node->hasFullPrefix() && hasFullPrefix()) {
+            tail = PrefixTail::create(length);
+            for (uint32_t i = maxStoredPrefixLength; i < length; ++i) {
+                tail->getBytes()[i - maxStoredPrefixLength] =
+                        i < nodeP.prefixCount ? node->getPrefixByte(i) :
+                        i == nodeP.prefixCount ? key : getPrefixByte(i - nodeP.prefixCount - 1);
+            }
+        }
         uint32_t prefixCopyCount = std::min(maxStoredPrefixLength, nodeP.prefixCount + 1);
         memmove(p.prefix + prefixCopyCount, p.prefix, std::min(p.prefixCount, maxStoredPrefixLength - prefixCopyCount));
         memcpy(p.prefix, nodeP.prefix, std::min(prefixCopyCount, nodeP.prefixCount));
@@ -342,7 +410,9 @@ namespace ART_ROWEX {
             p.prefix[prefixCopyCount - 1] = key;
         }
         p.prefixCount += nodeP.prefixCount + 1;
+        prefixTail.store(tail, std::memory_order_release);
         this->prefix.store(p, std::memory_order_release);
+        return oldTail;
     }
 
     bool N::isLeaf(const N *n) {
@@ -374,6 +444,7 @@ namespace ART_ROWEX {
         if (N::isLeaf(node)) {
             return;
         }
+        operator delete(node->prefixTail.load());
         switch (node->getType()) {
             case NTypes::N4: {
                 auto n = static_cast<N4 *>(node);
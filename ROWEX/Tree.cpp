@@ -1,15 +1,26 @@
 #include <assert.h>
 #include <algorithm>
+#include <stdexcept>
+#include "tbb/parallel_for.h"
 #include "Include/Tree.h"
 #include "N.cpp"
 #include "../Include/Epoche.cpp"
+#include "../Include/BulkLoad.h"
 
 namespace ART_ROWEX {
 
-    Tree::Tree(LoadKeyFunction loadKey) : root(new N256(0, {})), loadKey(loadKey) {
+    Tree::Tree(LoadKeyFunction loadKey, PrefixType prefixType, LeafType leafType) : root(new N256(0, {})),
+                                                                                     loadKey(loadKey),
+                                                                                     prefixType(prefixType),
+                                                                                     leafType(leafType) {
+        if (leafType == LeafType::ExternalKey && loadKey == nullptr) {
+            N::deleteNode(root);
+            throw std::invalid_argument("ART_ROWEX: loadKey is required without embedded keys");
+        }
     }
 
     Tree::~Tree() {
+        deleteKeyLeaves(root);
         N::deleteChildren(root);
         N::deleteNode(root);
     }
@@ -45,7 +56,7 @@ namespace ART_ROWEX {
                         if (level < k.getKeyLen() - 1 || optimisticPrefixMatch) {
                             return checkKey(tid, k);
                         } else {
-                            return tid;
+                            return getLeafTid(tid);
                         }
                     }
                 }
@@ -67,13 +78,13 @@ namespace ART_ROWEX {
         EpocheGuard epocheGuard(threadEpocheInfo);
         TID toContinue = 0;
         bool restart;
-        std::function<void(const N *)> copy = [&result, &resultSize, &resultsFound, &toContinue, &copy](const N *node) {
+        std::function<void(const N *)> copy = [&result, &resultSize, &resultsFound, &toContinue, &copy, this](const N *node) {
             if (N::isLeaf(node)) {
                 if (resultsFound == resultSize) {
                     toContinue = N::getLeaf(node);
                     return;
                 }
-                result[resultsFound] = N::getLeaf(node);
+                result[resultsFound] = getLeafTid(N::getLeaf(node));
                 resultsFound++;
             } else {
                 std::tuple<uint8_t, N *> children[256];
@@ -96,7 +107,7 @@ namespace ART_ROWEX {
             }
 
             PCCompareResults prefixResult;
-            prefixResult = checkPrefixCompare(node, start, level, loadKey);
+            prefixResult = checkPrefixCompare(node, start, level);
             switch (prefixResult) {
                 case PCCompareResults::Bigger:
                     copy(node);
@@ -133,7 +144,7 @@ namespace ART_ROWEX {
                 return;
             }
             PCCompareResults prefixResult;
-            prefixResult = checkPrefixCompare(node, end, level, loadKey);
+            prefixResult = checkPrefixCompare(node, end, level);
 
             switch (prefixResult) {
                 case PCCompareResults::Smaller:
@@ -177,7 +188,7 @@ namespace ART_ROWEX {
         while (true) {
             node = nextNode;
             PCEqualsResults prefixResult;
-            prefixResult = checkPrefixEquals(node, level, start, end, loadKey);
+            prefixResult = checkPrefixEquals(node, level, start, end);
             switch (prefixResult) {
                 case PCEqualsResults::SkippedLevel:
                     goto restart;
@@ -223,7 +234,7 @@ namespace ART_ROWEX {
             break;
         }
         if (toContinue != 0) {
-            loadKey(toContinue, continueKey);
+            loadLeafKey(toContinue, continueKey);
             return true;
         } else {
             return false;
@@ -231,17 +242,55 @@ namespace ART_ROWEX {
     }
 
 
-    TID Tree::checkKey(const TID tid, const Key &k) const {
+    TID Tree::checkKey(const TID leaf, const Key &k) const {
+        if (leafType == LeafType::EmbeddedKey) {
+            auto l = reinterpret_cast<const KeyLeaf *>(leaf);
+            if (l->hasKey(k)) {
+                return l->tid;
+            }
+            return 0;
+        }
         Key kt;
-        this->loadKey(tid, kt);
+        this->loadKey(leaf, kt);
         if (k == kt) {
-            return tid;
+            return leaf;
         }
         return 0;
     }
 
+    void Tree::retireLeaf(TID leaf, ThreadInfo &threadInfo) {
+        if (leafType == LeafType::EmbeddedKey) {
+            epoche.markNodeForDeletion(reinterpret_cast<KeyLeaf *>(leaf), threadInfo);
+        }
+    }
+
+    void Tree::deleteKeyLeaves(const N *node) {
+        if (leafType == LeafType::ExternalKey) {
+            return;
+        }
+        if (N::isLeaf(node)) {
+            operator delete(reinterpret_cast<KeyLeaf *>(N::getLeaf(node)));
+            return;
+        }
+        std::tuple<uint8_t, N *> children[256];
+        uint32_t childrenCount = 0;
+        N::getChildren(node, 0u, 255u, children, childrenCount);
+        for (uint32_t i = 0; i < childrenCount; ++i) {
+            deleteKeyLeaves(std::get<1>(children[i]));
+        }
+    }
+
+    void Tree::retirePrefixTail(const PrefixTail *tail, ThreadInfo &threadInfo) {
+        if (tail != nullptr) {
+            // readers which entered the epoche before the change may still compare against it
+            epoche.markNodeForDeletion(const_cast<PrefixTail *>(tail), threadInfo);
+        }
+    }
+
     void Tree::insert(const Key &k, TID tid, ThreadInfo &epocheInfo) {
         EpocheGuard epocheGuard(epocheInfo);
+        // created once, restarts link the same leaf
+        N *leaf = N::setLeaf(makeLeaf(leafType, k, tid));
         restart:
         bool needRestart = false;
 
@@ -261,8 +310,7 @@ namespace ART_ROWEX {
 
             uint8_t nonMatchingKey;
             Prefix remainingPrefix;
-            switch (checkPrefixPessimistic(node, k, nextLevel, nonMatchingKey, remainingPrefix,
-                                                           this->loadKey)) { // increases level
+            switch (checkPrefixPessimistic(node, k, nextLevel, nonMatchingKey, remainingPrefix)) { // increases level
                 case CheckPrefixPessimisticResult::SkippedLevel:
                     goto restart;
                 case CheckPrefixPessimisticResult::NoMatch: {
@@ -274,15 +322,18 @@ namespace ART_ROWEX {
                     Prefix prefi = node->getPrefi();
                     prefi.prefixCount = nextLevel - level;
                     auto newNode = new N4(nextLevel, prefi);
+                    if (prefixType == PrefixType::Full) {
+                        newNode->storePrefixTail(&k[level]);
+                    }
 
                     // 2)  add node and (tid, *k) as children
-                    newNode->insert(k[nextLevel], N::setLeaf(tid));
+                    newNode->insert(k[nextLevel], leaf);
                     newNode->insert(nonMatchingKey, node);
 
                     // 3) lockVersionOrRestart, update parentNode to point to the new node, unlock
                     parentNode->writeLockOrRestart(needRestart);
                     if (needRestart) {
-                        delete newNode;
+                        N::deleteNode(newNode);
                         node->writeUnlock();
                         goto restart;
                     }
@@ -290,8 +341,12 @@ namespace ART_ROWEX {
                     parentNode->writeUnlock();
 
                     // 4) update prefix of node, unlock
-                    node->setPrefix(remainingPrefix.prefix,
-                                    node->getPrefi().prefixCount - ((nextLevel - level) + 1));
+                    if (prefixType == PrefixType::Full) {
+                        retirePrefixTail(node->cutPrefix((nextLevel - level) + 1), epocheInfo);
+                    } else {
+                        node->setPrefix(remainingPrefix.prefix,
+                                        node->getPrefi().prefixCount - ((nextLevel - level) + 1));
+                    }
 
                     node->writeUnlock();
                     return;
@@ -308,7 +363,7 @@ namespace ART_ROWEX {
                 node->lockVersionOrRestart(v, needRestart);
                 if (needRestart) goto restart;
 
-                N::insertAndUnlock(node, parentNode, parentKey, nodeKey, N::setLeaf(tid), epocheInfo, needRestart);
+                N::insertAndUnlock(node, parentNode, parentKey, nodeKey, leaf, epocheInfo, needRestart);
                 if (needRestart) goto restart;
                 return;
             }
@@ -317,7 +372,7 @@ namespace ART_ROWEX {
                 if (needRestart) goto restart;
 
                 Key key;
-                loadKey(N::getLeaf(nextNode), key);
+                loadLeafKey(N::getLeaf(nextNode), key);
 
                 level++;
                 assert(level < key.getKeyLen()); //prevent inserting when prefix of key exists already
@@ -327,7 +382,10 @@ namespace ART_ROWEX {
                 }
 
                 auto n4 = new N4(level + prefixLength, &k[level], prefixLength);
-                n4->insert(k[level + prefixLength], N::setLeaf(tid));
+                if (prefixType == PrefixType::Full) {
+                    n4->storePrefixTail(&k[level]);
+                }
+                n4->insert(k[level + prefixLength], leaf);
                 n4->insert(key[level + prefixLength], nextNode);
                 N::change(node, k[level - 1], n4);
                 node->writeUnlock();
@@ -337,6 +395,116 @@ namespace ART_ROWEX {
         }
     }
 
+    namespace {
+        using namespace ART::BulkLoad;
+
+        N *buildSubtree(const Key keys[], const TID tids[], std::size_t begin, std::size_t end, uint32_t level,
+                        PrefixType prefixType, LeafType leafType);
+
+        template<class NODE>
+        N *buildNode(const Key keys[], const TID tids[], std::size_t begin, std::size_t end, uint32_t level,
+                     uint32_t prefixLength, PrefixType prefixType, LeafType leafType) {
+            uint32_t nodeLevel = level + prefixLength;
+            auto node = new NODE(nodeLevel, &keys[begin][level], prefixLength);
+            if (prefixType == PrefixType::Full) {
+                node->storePrefixTail(&keys[begin][level]);
+            }
+            if (end - begin < parallelBuildThreshold) {
+                for (std::size_t i = begin; i < end;) {
+                    std::size_t j = groupEnd(keys, i, end, nodeLevel);
+                    node->insert(keys[i][nodeLevel], buildSubtree(keys, tids, i, j, nodeLevel + 1, prefixType, leafType));
+                    i = j;
+                }
+                return node;
+            }
+            // the subtrees of the children are independent, they are built in parallel and inserted in key order
+            std::size_t bounds[257];
+            unsigned count = groupBounds(keys, begin, end, nodeLevel, bounds);
+            N *children[256];
+            tbb::parallel_for(0u, count, [&](unsigned g) {
+                children[g] = buildSubtree(keys, tids, bounds[g], bounds[g + 1], nodeLevel + 1, prefixType, leafType);
+            });
+            for (unsigned g = 0; g < count; ++g) {
+                node->insert(keys[bounds[g]][nodeLevel], children[g]);
+            }
+            return node;
+        }
+
+        /**
+         * builds the subtree of the sorted range [begin, end) whose keys share the bytes before level, every node is
+         * allocated with the type fitting its final number of children
+         */
+        N *buildSubtree(const Key keys[], const TID tids[], std::size_t begin, std::size_t end, uint32_t level,
+                        PrefixType prefixType, LeafType leafType) {
+            if (end - begin == 1) {
+                return N::setLeaf(makeLeaf(leafType, keys[begin], tids[begin]));
+            }
+            uint32_t prefixLength = commonPrefixLength(keys, begin, end, level);
+            if (level + prefixLength == keys[begin].getKeyLen()) {
+                // all keys are the same, the first one wins
+                return N::setLeaf(makeLeaf(leafType, keys[begin], tids[begin]));
+            }
+            unsigned children = groupCount(keys, begin, end, level + prefixLength);
+            if (children <= 4) {
+                return buildNode<N4>(keys, tids, begin, end, level, prefixLength, prefixType, leafType);
+            } else if (children <= 16) {
+                return buildNode<N16>(keys, tids, begin, end, level, prefixLength, prefixType, leafType);
+            } else if (children <= 48) {
+                return buildNode<N48>(keys, tids, begin, end, level, prefixLength, prefixType, leafType);
+            }
+            return buildNode<N256>(keys, tids, begin, end, level, prefixLength, prefixType, leafType);
+        }
+    }
+
+    void Tree::bulkLoad(const Key keys[], const TID tids[], std::size_t n, ThreadInfo &epocheInfo) {
+        if (n == 0) {
+            return;
+        }
+        std::size_t bounds[257];
+        unsigned count = groupBounds(keys, 0, n, 0, bounds);
+        // built without locks, nobody else can reach them yet
+        N *subtrees[256];
+        tbb::parallel_for(0u, count, [&](unsigned g) {
+            subtrees[g] = nullptr;
+            if (N::getChild(keys[bounds[g]][0], root) == nullptr) {
+                subtrees[g] = buildSubtree(keys, tids, bounds[g], bounds[g + 1], 1, prefixType, leafType);
+            }
+        });
+
+        // all subtrees are linked under a single write lock of the root
+        bool linked[256];
+        bool needRestart;
+        do {
+            needRestart = false;
+            root->writeLockOrRestart(needRestart);
+        } while (needRestart);
+        for (unsigned g = 0; g < count; ++g) {
+            uint8_t key = keys[bounds[g]][0];
+            linked[g] = subtrees[g] != nullptr && N::getChild(key, root) == nullptr;
+            if (linked[g]) {
+                static_cast<N256 *>(root)->insert(key, subtrees[g]);
+            }
+        }
+        root->writeUnlock();
+
+        for (unsigned g = 0; g < count; ++g) {
+            if (linked[g]) {
+                continue;
+            }
+            if (subtrees[g] != nullptr) {
+                deleteKeyLeaves(subtrees[g]);
+                N::deleteChildren(subtrees[g]);
+                if (!N::isLeaf(subtrees[g])) {
+                    N::deleteNode(subtrees[g]);
+                }
+            }
+            // the subtree exists already
+            for (std::size_t k = bounds[g]; k < bounds[g + 1]; ++k) {
+                insert(keys[k], tids[k], epocheInfo);
+            }
+        }
+    }
+
     void Tree::remove(const Key &k, TID tid, ThreadInfo &threadInfo) {
         EpocheGuard epocheGuard(threadInfo);
         restart:
@@ -377,7 +545,7 @@ namespace ART_ROWEX {
                         node->lockVersionOrRestart(v, needRestart);
                         if (needRestart) goto restart;
 
-                        if (N::getLeaf(nextNode) != tid) {
+                        if (getLeafTid(N::getLeaf(nextNode)) != tid) {
                             node->writeUnlock();
                             return;
                         }
@@ -400,6 +568,8 @@ namespace ART_ROWEX {
                                 parentNode->writeUnlock();
                                 node->writeUnlockObsolete();
                                 this->epoche.markNodeForDeletion(node, threadInfo);
+                                retirePrefixTail(node->getPrefixTail(node->getPrefi().prefixCount), threadInfo);
+                                retireLeaf(N::getLeaf(nextNode), threadInfo);
                             } else {
                                 uint64_t vChild = secondNodeN->getVersion();
                                 secondNodeN->lockVersionOrRestart(vChild, needRestart);
@@ -416,16 +586,19 @@ namespace ART_ROWEX {
 
                                 //N::remove(node, k[level]); not necessary
                                 N::change(parentNode, parentKey, secondNodeN);
-                                secondNodeN->addPrefixBefore(node, secondNodeK);
+                                retirePrefixTail(secondNodeN->addPrefixBefore(node, secondNodeK), threadInfo);
 
                                 parentNode->writeUnlock();
                                 node->writeUnlockObsolete();
                                 this->epoche.markNodeForDeletion(node, threadInfo);
+                                retirePrefixTail(node->getPrefixTail(node->getPrefi().prefixCount), threadInfo);
                                 secondNodeN->writeUnlock();
+                                retireLeaf(N::getLeaf(nextNode), threadInfo);
                             }
                         } else {
                             N::removeAndUnlock(node, k[level], parentNode, parentKey, threadInfo, needRestart);
                             if (needRestart) goto restart;
+                            retireLeaf(N::getLeaf(nextNode), threadInfo);
                         }
                         return;
                     }
@@ -463,25 +636,33 @@ namespace ART_ROWEX {
 
     typename Tree::CheckPrefixPessimisticResult Tree::checkPrefixPessimistic(N *n, const Key &k, uint32_t &level,
                                                                         uint8_t &nonMatchingKey,
-                                                                        Prefix &nonMatchingPrefix,
-                                                                        LoadKeyFunction loadKey) {
+                                                                        Prefix &nonMatchingPrefix) const {
         Prefix p = n->getPrefi();
         if (p.prefixCount + level < n->getLevel()) {
             return CheckPrefixPessimisticResult::SkippedLevel;
         }
         if (p.prefixCount > 0) {
             uint32_t prevLevel = level;
+            // bytes beyond the stored prefix come from the tail, or from the key of a leaf if there is none
+            const PrefixTail *tail = n->getPrefixTail(p.prefixCount);
             Key kt;
             for (uint32_t i = ((level + p.prefixCount) - n->getLevel()); i < p.prefixCount; ++i) {
-                if (i == maxStoredPrefixLength) {
-                    loadKey(N::getAnyChildTid(n), kt);
+                if (i == maxStoredPrefixLength && tail == nullptr) {
+                    loadLeafKey(N::getAnyChildTid(n), kt);
                 }
-                uint8_t curKey = i >= maxStoredPrefixLength ? kt[level] : p.prefix[i];
+                uint8_t curKey = i < maxStoredPrefixLength ? p.prefix[i] :
+                                 tail != nullptr ? tail->getBytes()[i - maxStoredPrefixLength] : kt[level];
                 if (curKey != k[level]) {
                     nonMatchingKey = curKey;
-                    if (p.prefixCount > maxStoredPrefixLength) {
+                    if (tail != nullptr) {
+                        for (uint32_t j = 0; j < std::min(p.prefixCount - i - 1, maxStoredPrefixLength); ++j) {
+                            uint32_t pos = i + j + 1;
+                            nonMatchingPrefix.prefix[j] = pos < maxStoredPrefixLength ? p.prefix[pos] :
+                                                          tail->getBytes()[pos - maxStoredPrefixLength];
+                        }
+                    } else if (p.prefixCount > maxStoredPrefixLength) {
                         if (i < maxStoredPrefixLength) {
-                            loadKey(N::getAnyChildTid(n), kt);
+                            loadLeafKey(N::getAnyChildTid(n), kt);
                         }
                         for (uint32_t j = 0; j < std::min((p.prefixCount - (level - prevLevel) - 1),
                                                           maxStoredPrefixLength); ++j) {
@@ -500,21 +681,22 @@ namespace ART_ROWEX {
         return CheckPrefixPessimisticResult::Match;
     }
 
-    typename Tree::PCCompareResults Tree::checkPrefixCompare(const N *n, const Key &k, uint32_t &level,
-                                                        LoadKeyFunction loadKey) {
+    typename Tree::PCCompareResults Tree::checkPrefixCompare(const N *n, const Key &k, uint32_t &level) const {
         Prefix p = n->getPrefi();
         if (p.prefixCount + level < n->getLevel()) {
             return PCCompareResults::SkippedLevel;
         }
         if (p.prefixCount > 0) {
+            const PrefixTail *tail = n->getPrefixTail(p.prefixCount);
             Key kt;
             for (uint32_t i = ((level + p.prefixCount) - n->getLevel()); i < p.prefixCount; ++i) {
-                if (i == maxStoredPrefixLength) {
-                    loadKey(N::getAnyChildTid(n), kt);
+                if (i == maxStoredPrefixLength && tail == nullptr) {
+                    loadLeafKey(N::getAnyChildTid(n), kt);
                 }
                 uint8_t kLevel = (k.getKeyLen() > level) ? k[level] : 0;
 
-                uint8_t curKey = i >= maxStoredPrefixLength ? kt[level] : p.prefix[i];
+                uint8_t curKey = i < maxStoredPrefixLength ? p.prefix[i] :
+                                 tail != nullptr ? tail->getBytes()[i - maxStoredPrefixLength] : kt[level];
                 if (curKey < kLevel) {
                     return PCCompareResults::Smaller;
                 } else if (curKey > kLevel) {
@@ -526,22 +708,24 @@ namespace ART_ROWEX {
         return PCCompareResults::Equal;
     }
 
-    typename Tree::PCEqualsResults Tree::checkPrefixEquals(const N *n, uint32_t &level, const Key &start, const Key &end,
-                                                      LoadKeyFunction loadKey) {
+    typename Tree::PCEqualsResults Tree::checkPrefixEquals(const N *n, uint32_t &level, const Key &start,
+                                                           const Key &end) const {
         Prefix p = n->getPrefi();
         if (p.prefixCount + level < n->getLevel()) {
             return PCEqualsResults::SkippedLevel;
         }
         if (p.prefixCount > 0) {
+            const PrefixTail *tail = n->getPrefixTail(p.prefixCount);
             Key kt;
             for (uint32_t i = ((level + p.prefixCount) - n->getLevel()); i < p.prefixCount; ++i) {
-                if (i == maxStoredPrefixLength) {
-                    loadKey(N::getAnyChildTid(n), kt);
+                if (i == maxStoredPrefixLength && tail == nullptr) {
+                    loadLeafKey(N::getAnyChildTid(n), kt);
                 }
                 uint8_t startLevel = (start.getKeyLen() > level) ? start[level] : 0;
                 uint8_t endLevel = (end.getKeyLen() > level) ? end[level] : 0;
 
-                uint8_t curKey = i >= maxStoredPrefixLength ? kt[level] : p.prefix[i];
+                uint8_t curKey = i < maxStoredPrefixLength ? p.prefix[i] :
+                                 tail != nullptr ? tail->getBytes()[i - maxStoredPrefixLength] : kt[level];
                 if (curKey > startLevel && curKey < endLevel) {
                     return PCEqualsResults::Contained;
                 } else if (curKey < startLevel || curKey > endLevel) {
@@ -0,0 +1,542 @@
+//
+// Crash consistency test of ART_LC: records the persist order of a workload and recovers a copy of the pool from a
+// simulated crash at every flush and fence, with the lines flushed since the last fence durable in any order and
+// lines which were stored but not flushed yet evicted early
+//
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Lock/Include/Tree.h"
+
+namespace {
+
+    constexpr std::size_t lineSize = 64;
+
+    void loadKey(TID tid, Key &key) {
+        key.setKeyLen(sizeof(tid));
+        reinterpret_cast<uint64_t *>(&key[0])[0] = __builtin_bswap64(tid);
+    }
+
+    enum class OpType : uint8_t {
+        Insert,
+        Remove,
+        InsertBatch,
+        BulkLoad,
+        // switches to Durability::Relaxed, the flusher only runs a round on Sync
+        Relaxed,
+        Sync,
+        // back to Durability::Strict, runs a last round
+        Strict
+    };
+
+    struct Op {
+        OpType type;
+        // sorted for BulkLoad, every key is stored with itself as TID
+        std::vector<uint64_t> keys;
+    };
+
+    /**
+     * A cache line of the pool as it reached persistent memory. Lines of the tree (anchor, root and slabs) only
+     * reach it when they are flushed, with their content at the flush. All other lines are written by libpmemobj,
+     * which persists them itself, they are taken as they are at every flush and fence.
+     */
+    struct Line {
+        uint64_t offset;
+        // flushed by the tree, false for lines written by libpmemobj
+        bool flushed;
+        // operations which returned when the line was recorded
+        std::size_t opsDone;
+        uint8_t data[lineSize];
+    };
+
+    struct CrashPoint {
+        // lines which are durable at the crash
+        std::size_t lineCount;
+        // operations which returned before the crash
+        std::size_t opsDone;
+        // operations which are durable for sure, all of them in strict mode, the ones before the last Sync otherwise
+        std::size_t opsDurable;
+        // lines of the tree which were stored but not flushed yet, in evictions, they may be durable too
+        std::size_t evictionBegin, evictionEnd;
+        // a fence, the lines since the last fence starting at fencedLines may be durable in any order
+        bool fence;
+        std::size_t fencedLines;
+    };
+
+    class Recorder : public ART_LC::PersistObserver {
+        pool<ART_LC::TreeAnchor> &pop;
+        uint8_t *base;
+        std::size_t size;
+
+        // last recorded content of every line, lines of the tree are only updated on flush
+        std::vector<uint8_t> seen;
+        std::vector<bool> treeLines;
+        std::size_t slabCount = ~static_cast<std::size_t>(0);
+
+        // lines flushed since the last fence start here
+        std::size_t fencedLines = 0;
+        // evictions of the current event start here
+        std::size_t evictionBegin = 0;
+
+        void markTree(const void *addr, std::size_t len) {
+            std::size_t begin = (static_cast<const uint8_t *>(addr) - base) / lineSize;
+            std::size_t end = (static_cast<const uint8_t *>(addr) - base + len + lineSize - 1) / lineSize;
+            for (std::size_t i = begin; i < end && i < treeLines.size(); ++i) {
+                treeLines[i] = true;
+            }
+        }
+
+        // slabs are only ever added, the lines of the tree are collected again whenever the list grew
+        void updateTreeLines() {
+            std::size_t count = 0;
+            for (ART_LC::NodeSlab *slab = pop.root()->slabs.get(); slab != nullptr; slab = slab->next.get()) {
+                count++;
+            }
+            if (count == slabCount) {
+                return;
+            }
+            slabCount = count;
+            std::fill(treeLines.begin(), treeLines.end(), false);
+            markTree(pop.root().get(), sizeof(ART_LC::TreeAnchor));
+            markTree(pop.root()->root.get(), sizeof(ART_LC::N256));
+            for (ART_LC::NodeSlab *slab = pop.root()->slabs.get(); slab != nullptr; slab = slab->next.get()) {
+                markTree(slab, ART_LC::NodeSlab::getSize(static_cast<ART_LC::NTypes>(slab->type)));
+            }
+        }
+
+        void record(std::size_t line, bool flushed) {
+            Line l;
+            l.offset = line * lineSize;
+            l.flushed = flushed;
+            l.opsDone = opsDone;
+            memcpy(l.data, base + l.offset, lineSize);
+            memcpy(&seen[l.offset], l.data, lineSize);
+            lines.push_back(l);
+        }
+
+        /**
+         * everything libpmemobj stored since the last event, the lines of the tree which differ from their last
+         * flushed content go to evictions instead
+         */
+        void recordLibraryLines() {
+            updateTreeLines();
+            for (std::size_t page = 0; page < size; page += 4096) {
+                std::size_t pageLen = std::min<std::size_t>(4096, size - page);
+                if (memcmp(base + page, &seen[page], pageLen) == 0) {
+                    continue;
+                }
+                for (std::size_t offset = page; offset < page + pageLen; offset += lineSize) {
+                    if (memcmp(base + offset, &seen[offset], lineSize) == 0) {
+                        continue;
+                    }
+                    if (!treeLines[offset / lineSize]) {
+                        record(offset / lineSize, false);
+                    } else {
+                        Line l;
+                        l.offset = offset;
+                        l.flushed = false;
+                        l.opsDone = opsDone;
+                        memcpy(l.data, base + offset, lineSize);
+                        evictions.push_back(l);
+                    }
+                }
+            }
+        }
+
+        void addCrashPoint(bool fence) {
+            crashPoints.push_back(CrashPoint{lines.size(), opsDone, opsDurable, evictionBegin, evictions.size(), fence,
+                                             fencedLines});
+            if (fence) {
+                fencedLines = lines.size();
+            }
+        }
+
+    public:
+        std::vector<uint8_t> image;
+        std::vector<Line> lines;
+        std::vector<Line> evictions;
+        std::vector<CrashPoint> crashPoints;
+        std::size_t opsDone = 0;
+        std::size_t opsDurable = 0;
+
+        Recorder(pool<ART_LC::TreeAnchor> &pop, std::size_t size)
+                : pop(pop), base(reinterpret_cast<uint8_t *>(pop.handle())), size(size),
+                  seen(base, base + size), treeLines(size / lineSize), image(seen) {
+        }
+
+        void onFlush(const void *addr, std::size_t len) override {
+            auto a = static_cast<const uint8_t *>(addr);
+            if (len == 0 || a < base || a >= base + size) {
+                return;
+            }
+            evictionBegin = evictions.size();
+            recordLibraryLines();
+            for (std::size_t line = (a - base) / lineSize; line <= (a - base + len - 1) / lineSize; ++line) {
+                record(line, true);
+            }
+            addCrashPoint(false);
+        }
+
+        void onFence() override {
+            evictionBegin = evictions.size();
+            recordLibraryLines();
+            addCrashPoint(true);
+        }
+    };
+
+    std::vector<Op> makeWorkload() {
+        std::vector<Op> ops;
+        // leaf split, then N4 -> N16 -> N48 -> N256 in the last byte and a second subtree in the byte before
+        for (uint64_t k = 1; k <= 300; ++k) {
+            ops.push_back(Op{OpType::Insert, {k}});
+        }
+        // prefix splits at different depths of the compressed path
+        const uint64_t splits[] = {0x0000000100000007ull, 0x0000010000000009ull, 0x01000000000000aaull,
+                                   0x0000000100000107ull};
+        for (uint64_t k : splits) {
+            ops.push_back(Op{OpType::Insert, {k}});
+        }
+        // N256 -> N48 -> N16 -> N4 and merges of nodes with a single child left
+        for (uint64_t k = 1; k <= 300; ++k) {
+            ops.push_back(Op{OpType::Remove, {k}});
+        }
+        for (uint64_t k : splits) {
+            ops.push_back(Op{OpType::Remove, {k}});
+        }
+
+        // a batch, its log is replayed by replayBatches, into an empty root slot and next to the keys of another one
+        Op batch{OpType::InsertBatch, {}};
+        for (uint64_t k = 0; k < 40; ++k) {
+            batch.keys.push_back(1000 + 3 * k);
+            batch.keys.push_back(0x0200000000000000ull | k << 8);
+        }
+        ops.push_back(batch);
+        // a bulk load, below an occupied root slot key by key, below free ones as built subtrees
+        Op bulk{OpType::BulkLoad, {}};
+        for (uint64_t k = 0; k < 20; ++k) {
+            bulk.keys.push_back(5000 + k);
+        }
+        for (uint64_t k = 0; k < 60; ++k) {
+            bulk.keys.push_back(0x0300000000000001ull | k << 8);
+        }
+        for (uint64_t k = 0; k < 30; ++k) {
+            bulk.keys.push_back(0x0400000000000000ull | 7 * k);
+        }
+        ops.push_back(bulk);
+
+        // relaxed durability, the updates between two rounds reach persistent memory in any order
+        ops.push_back(Op{OpType::Relaxed, {}});
+        for (uint64_t k = 2000; k < 2100; ++k) {
+            ops.push_back(Op{OpType::Insert, {k}});
+            if (k % 25 == 24) {
+                ops.push_back(Op{OpType::Sync, {}});
+            }
+        }
+        for (uint64_t k = 2000; k < 2050; ++k) {
+            ops.push_back(Op{OpType::Remove, {k}});
+            if (k == 2024) {
+                ops.push_back(Op{OpType::Sync, {}});
+            }
+        }
+        Op relaxedBatch{OpType::InsertBatch, {}};
+        for (uint64_t k = 0; k < 20; ++k) {
+            relaxedBatch.keys.push_back(0x0500000000000000ull | k);
+        }
+        ops.push_back(relaxedBatch);
+        ops.push_back(Op{OpType::Strict, {}});
+        return ops;
+    }
+
+    /**
+     * opens the image, which recovers the tree, and compares it with the operations done before the crash: the
+     * durable ones have to be visible, the later ones up to the one which was running may or may not be, except that
+     * a batch is visible as a whole or not at all
+     */
+    std::string verify(const std::string &path, const std::vector<Op> &ops, std::size_t opsDurable,
+                       std::size_t opsDone) {
+        std::map<uint64_t, bool> expected;
+        for (std::size_t i = 0; i < opsDurable; ++i) {
+            for (uint64_t k : ops[i].keys) {
+                expected[k] = ops[i].type != OpType::Remove;
+            }
+        }
+        for (const Op &op : ops) {
+            for (uint64_t k : op.keys) {
+                expected.insert(std::make_pair(k, false));
+            }
+        }
+        std::map<uint64_t, bool> undecided;
+        for (std::size_t i = opsDurable; i <= opsDone && i < ops.size(); ++i) {
+            for (uint64_t k : ops[i].keys) {
+                undecided[k] = true;
+            }
+        }
+
+        pool<ART_LC::TreeAnchor> pop = pool<ART_LC::TreeAnchor>::open(path, LAYOUT);
+        std::string error;
+        {
+            ART_LC::Tree tree(pop, loadKey);
+            auto t = tree.getThreadInfo();
+            std::size_t present = 0;
+            for (const auto &e : expected) {
+                Key key;
+                loadKey(e.first, key);
+                TID found = tree.lookup(pop, key, t);
+                if (found != 0) {
+                    present++;
+                }
+                if (undecided.count(e.first) == 0 && (found != 0) != e.second) {
+                    error = "key " + std::to_string(e.first) + (e.second ? " lost" : " still present");
+                    break;
+                }
+                if (found != 0 && found != e.first) {
+                    error = "key " + std::to_string(e.first) + " has TID " + std::to_string(found);
+                    break;
+                }
+            }
+
+            // the keys of a batch are only inserted by it
+            for (std::size_t i = opsDurable; i <= opsDone && i < ops.size() && error.empty(); ++i) {
+                if (ops[i].type != OpType::InsertBatch) {
+                    continue;
+                }
+                std::size_t batchPresent = 0;
+                for (uint64_t k : ops[i].keys) {
+                    Key key;
+                    loadKey(k, key);
+                    if (tree.lookup(pop, key, t) != 0) {
+                        batchPresent++;
+                    }
+                }
+                if (batchPresent != 0 && batchPresent != ops[i].keys.size()) {
+                    error = "batch " + std::to_string(i) + " partially inserted, " + std::to_string(batchPresent) +
+                            " of " + std::to_string(ops[i].keys.size()) + " keys";
+                }
+            }
+
+            if (error.empty()) {
+                // a full scan has to return every key found by lookup, in key order
+                Key start, end, continueKey;
+                loadKey(0, start);
+                loadKey(~static_cast<uint64_t>(0), end);
+                std::vector<TID> result(expected.size() + 1);
+                std::size_t resultCount = 0;
+                tree.lookupRange(pop, start, end, continueKey, result.data(), result.size(), resultCount, t);
+                if (resultCount != present) {
+                    error = "scan returned " + std::to_string(resultCount) + " keys, lookup found " +
+                            std::to_string(present);
+                }
+                for (std::size_t i = 1; i < resultCount && error.empty(); ++i) {
+                    if (result[i - 1] >= result[i]) {
+                        error = "scan out of order at " + std::to_string(result[i]);
+                    }
+                }
+            }
+
+            if (error.empty()) {
+                // the recovered tree has to take new keys
+                Key key;
+                loadKey(0xfffffffffffffff0ull, key);
+                tree.insert(pop, key, 0xfffffffffffffff0ull, t);
+                if (tree.lookup(pop, key, t) != 0xfffffffffffffff0ull) {
+                    error = "insert after recovery failed";
+                }
+                tree.remove(pop, key, 0xfffffffffffffff0ull, t);
+            }
+        }
+        pop.close();
+        return error;
+    }
+
+    void run(ART_LC::Tree &tree, pool_base &pop, const Op &op, ART::ThreadInfo &t) {
+        std::vector<Key> keys(op.keys.size());
+        for (std::size_t i = 0; i < op.keys.size(); ++i) {
+            loadKey(op.keys[i], keys[i]);
+        }
+        switch (op.type) {
+            case OpType::Insert:
+                tree.insert(pop, keys[0], op.keys[0], t);
+                break;
+            case OpType::Remove:
+                tree.remove(pop, keys[0], op.keys[0], t);
+                break;
+            case OpType::InsertBatch:
+                tree.insertBatch(pop, keys.data(), op.keys.data(), keys.size(), t);
+                break;
+            case OpType::BulkLoad:
+                tree.bulkLoad(pop, keys.data(), op.keys.data(), keys.size(), t);
+                break;
+            case OpType::Relaxed:
+                // rounds only run on Sync, the recorder sees every persist on this thread
+                tree.setDurability(ART_LC::Durability::Relaxed, std::chrono::hours(24));
+                break;
+            case OpType::Sync:
+                tree.sync();
+                break;
+            case OpType::Strict:
+                tree.setDurability(ART_LC::Durability::Strict);
+                break;
+        }
+    }
+
+    class Image {
+        std::vector<uint8_t> data;
+        std::size_t applied = 0;
+
+    public:
+        explicit Image(const std::vector<uint8_t> &initial) : data(initial) { }
+
+        // the image with the first count lines applied, count only grows
+        const std::vector<uint8_t> &at(const std::vector<Line> &lines, std::size_t count) {
+            for (; applied < count; ++applied) {
+                memcpy(&data[lines[applied].offset], lines[applied].data, lineSize);
+            }
+            return data;
+        }
+    };
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 4) {
+        printf("usage: %s <pool_path> [stride] [embedded]\nstride: test every stride-th crash point\n"
+               "embedded: tree with LeafType::EmbeddedKey\n", argv[0]);
+        return 1;
+    }
+    std::string path = argv[1];
+    std::string imagePath = path + ".crash";
+    std::size_t stride = argc >= 3 ? std::max(1, std::atoi(argv[2])) : 1;
+    ART_LC::LeafType leafType = argc == 4 && strcmp(argv[3], "embedded") == 0 ? ART_LC::LeafType::EmbeddedKey
+                                                                                : ART_LC::LeafType::ExternalKey;
+    // the pools are in DRAM, flushes have to be cache line write backs for the recorder to see the order
+    setenv("PMEM_IS_PMEM_FORCE", "1", 1);
+    unlink(path.c_str());
+
+    std::vector<Op> ops = makeWorkload();
+    std::vector<uint8_t> initial;
+    std::vector<Line> lines;
+    std::vector<Line> evictions;
+    std::vector<CrashPoint> crashPoints;
+    {
+        pool<ART_LC::TreeAnchor> pop = pool<ART_LC::TreeAnchor>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+                                                                          CREATE_MODE_RW);
+        {
+            ART_LC::Tree tree(pop, loadKey, leafType);
+            auto t = tree.getThreadInfo();
+
+            Recorder recorder(pop, PMEMOBJ_MIN_POOL);
+            ART_LC::PersistStats::setObserver(&recorder);
+            ART_LC::PersistStats::setEnabled(true);
+            bool relaxed = false;
+            for (const Op &op : ops) {
+                run(tree, pop, op, t);
+                recorder.opsDone++;
+                if (op.type == OpType::Relaxed) {
+                    relaxed = true;
+                } else if (op.type == OpType::Strict) {
+                    relaxed = false;
+                }
+                // a finished round makes everything before it durable
+                if (!relaxed || op.type == OpType::Sync) {
+                    recorder.opsDurable = recorder.opsDone;
+                }
+            }
+            ART_LC::PersistStats::setEnabled(false);
+            ART_LC::PersistStats::setObserver(nullptr);
+
+            initial.swap(recorder.image);
+            lines.swap(recorder.lines);
+            evictions.swap(recorder.evictions);
+            crashPoints.swap(recorder.crashPoints);
+        }
+        pop.close();
+    }
+    printf("%zu operations, %zu crash points, %zu lines, %zu evictable lines\n", ops.size(), crashPoints.size(),
+           lines.size(), evictions.size());
+
+    std::size_t tested = 0, failures = 0;
+    auto test = [&](const std::vector<uint8_t> &image, std::size_t point, const std::string &name) {
+        FILE *f = fopen(imagePath.c_str(), "wb");
+        if (f == nullptr || fwrite(image.data(), 1, image.size(), f) != image.size()) {
+            throw std::runtime_error("cannot write " + imagePath);
+        }
+        fclose(f);
+
+        std::string error;
+        try {
+            error = verify(imagePath, ops, crashPoints[point].opsDurable, crashPoints[point].opsDone);
+        } catch (std::exception &e) {
+            error = e.what();
+        }
+        tested++;
+        if (!error.empty()) {
+            failures++;
+            printf("crash point %zu (after %zu operations, %zu durable), %s: %s\n", point,
+                   crashPoints[point].opsDone, crashPoints[point].opsDurable, name.c_str(), error.c_str());
+        }
+    };
+
+    // durable lines up to the crash point, and up to the fence before it
+    Image image(initial), fenced(initial);
+    std::vector<uint8_t> scratch;
+    for (std::size_t i = 0; i < crashPoints.size(); i += stride) {
+        const CrashPoint &point = crashPoints[i];
+        const std::vector<uint8_t> &prefix = image.at(lines, point.lineCount);
+        test(prefix, i, "prefix");
+
+        // the lines stored since their last flush reach persistent memory early
+        if (point.evictionBegin != point.evictionEnd) {
+            scratch = prefix;
+            for (std::size_t e = point.evictionBegin; e < point.evictionEnd; ++e) {
+                memcpy(&scratch[evictions[e].offset], evictions[e].data, lineSize);
+            }
+            test(scratch, i, "evicted");
+        }
+
+        // the lines flushed since the last fence are durable in any order, each of them alone and all but one, as
+        // long as they belong to the running operation, a finished one may already rely on its lines
+        std::vector<std::size_t> flushed;
+        bool running = true;
+        for (std::size_t l = point.fencedLines; l < point.lineCount; ++l) {
+            if (lines[l].flushed) {
+                flushed.push_back(l);
+                running = running && lines[l].opsDone == point.opsDone;
+            }
+        }
+        if (!point.fence || !running || flushed.size() < 2) {
+            continue;
+        }
+        const std::vector<uint8_t> &base = fenced.at(lines, point.fencedLines);
+        for (std::size_t only : flushed) {
+            scratch = base;
+            for (std::size_t l = point.fencedLines; l <= only; ++l) {
+                if (l == only || !lines[l].flushed) {
+                    memcpy(&scratch[lines[l].offset], lines[l].data, lineSize);
+                }
+            }
+            test(scratch, i, "only line " + std::to_string(only));
+        }
+        for (std::size_t without : flushed) {
+            if (flushed.size() < 3) {
+                break;
+            }
+            scratch = base;
+            for (std::size_t l = point.fencedLines; l < point.lineCount; ++l) {
+                if (l != without) {
+                    memcpy(&scratch[lines[l].offset], lines[l].data, lineSize);
+                }
+            }
+            test(scratch, i, "without line " + std::to_string(without));
+        }
+    }
+    unlink(imagePath.c_str());
+    unlink(path.c_str());
+    printf("%zu crash states tested, %zu failed\n", tested, failures);
+    return failures == 0 ? 0 : 1;
+}
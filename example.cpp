@@ -1,5 +1,13 @@
 #include <iostream>
 #include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "tbb/tbb.h"
 
 using namespace std;
@@ -8,6 +16,9 @@ using namespace std;
 #include "ROWEX/Include/Tree.h"
 #include "ART/Include/Tree.h"
 #include "Lock/Include/Tree.h"
+#include "Lock/Include/HybridTree.h"
+#include "Lock/Include/PoolSet.h"
+#include "Lock/Include/PartitionedTree.h"
 
 void loadKey(TID tid, Key &key) {
     // Store the key of the tuple into the key vector
@@ -84,7 +95,50 @@ void singlethreaded(char **argv) {
     std::cout << std::endl;
 }
 
-void multithreaded(pool_base &pop, char **argv) {
+// flushed cache lines and fences per operation since before
+void printPersistCounters(const ART_LC::PersistCounters &before, uint64_t n) {
+    ART_LC::PersistCounters after = ART_LC::PersistStats::getTotals();
+    printf(",%f,%f\n", (after.flushedLines - before.flushedLines) * 1.0 / n, (after.fences - before.fences) * 1.0 / n);
+}
+
+// flushed cache lines and fences per operation by structural event and node type, zero rows are left out
+void printPersistBreakdown() {
+    static const char *ops[] = {"other", "insert", "remove", "lookup"};
+    static const char *events[] = {"none", "grow", "shrink", "prefix split", "leaf split", "merge"};
+    static const char *nodeTypes[] = {"N4", "N16", "N48", "N256", "metadata"};
+
+    ART_LC::PersistBreakdown b = ART_LC::PersistStats::getBreakdown();
+    printf("operation,event,node,flushed lines/op,fences/op\n");
+    for (unsigned o = 1; o < ART_LC::PersistBreakdown::opCount; ++o) {
+        if (b.operations[o] == 0) {
+            continue;
+        }
+        for (unsigned e = 0; e < ART_LC::PersistBreakdown::eventCount; ++e) {
+            for (unsigned t = 0; t < ART_LC::PersistBreakdown::nodeTypeCount; ++t) {
+                const ART_LC::PersistCounters &c = b.counters[o][e][t];
+                if (c.flushedLines != 0 || c.fences != 0) {
+                    printf("%s,%s,%s,%f,%f\n", ops[o], events[e], nodeTypes[t], c.flushedLines * 1.0 / b.operations[o],
+                           c.fences * 1.0 / b.operations[o]);
+                }
+            }
+        }
+    }
+    printf("operation,allocations/op,allocated bytes/op,node reads/op\n");
+    for (unsigned o = 1; o < ART_LC::PersistBreakdown::opCount; ++o) {
+        if (b.operations[o] == 0) {
+            continue;
+        }
+        uint64_t allocations = 0, bytes = 0;
+        for (unsigned e = 0; e < ART_LC::PersistBreakdown::eventCount; ++e) {
+            allocations += b.allocations[o][e];
+            bytes += b.allocatedBytes[o][e];
+        }
+        printf("%s,%f,%f,%f\n", ops[o], allocations * 1.0 / b.operations[o], bytes * 1.0 / b.operations[o],
+               b.nodeReads[o] * 1.0 / b.operations[o]);
+    }
+}
+
+void multithreaded(pool<ART_LC::TreeAnchor> &pop, char **argv) {
     std::cout << "multi threaded:" << std::endl;
 
     uint64_t n = std::atoll(argv[1]);
@@ -102,13 +156,14 @@ void multithreaded(pool_base &pop, char **argv) {
         for (uint64_t i = 0; i < n; i++)
             keys[i] = (static_cast<uint64_t>(rand()) << 32) | static_cast<uint64_t>(rand());
 
-    printf("operation,n,ops/s\n");
+    printf("operation,n,ops/s,flushed lines/op,fences/op\n");
     //ART_OLC::Tree tree(loadKey);
     //ART_ROWEX::Tree tree(loadKey);
-    ART_LC::Tree tree(loadKey);
+    ART_LC::Tree tree(pop, loadKey);
 
     // Build tree
     {
+        auto persistBefore = ART_LC::PersistStats::getTotals();
         auto starttime = std::chrono::system_clock::now();
         tbb::parallel_for(tbb::blocked_range<uint64_t>(0, n), [&](const tbb::blocked_range<uint64_t> &range) {
             auto t = tree.getThreadInfo();
@@ -120,11 +175,13 @@ void multithreaded(pool_base &pop, char **argv) {
         });
         auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
                 std::chrono::system_clock::now() - starttime);
-        printf("insert,%ld,%f\n", n, (n * 1.0) / duration.count());
+        printf("insert,%ld,%f", n, (n * 1.0) / duration.count());
+        printPersistCounters(persistBefore, n);
     }
 
     {
         // Lookup
+        auto persistBefore = ART_LC::PersistStats::getTotals();
         auto starttime = std::chrono::system_clock::now();
         tbb::parallel_for(tbb::blocked_range<uint64_t>(0, n), [&](const tbb::blocked_range<uint64_t> &range) {
             auto t = tree.getThreadInfo();
@@ -138,6 +195,264 @@ void multithreaded(pool_base &pop, char **argv) {
                 }
             }
         });
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+        printf("lookup,%ld,%f", n, (n * 1.0) / duration.count());
+        printPersistCounters(persistBefore, n);
+    }
+
+    {
+        // Remove operation
+        auto persistBefore = ART_LC::PersistStats::getTotals();
+        auto starttime = std::chrono::system_clock::now();
+
+        tbb::parallel_for(tbb::blocked_range<uint64_t>(0, n), [&](const tbb::blocked_range<uint64_t> &range) {
+            auto t = tree.getThreadInfo();
+            for (uint64_t i = range.begin(); i != range.end(); i++) {
+                Key key;
+                loadKey(keys[i], key);
+                tree.remove(pop, key, keys[i], t);
+            }
+        });
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+        printf("remove,%ld,%f", n, (n * 1.0) / duration.count());
+        printPersistCounters(persistBefore, n);
+    }
+    printPersistBreakdown();
+    delete[] keys;
+}
+
+// builds TREE with the parallel insert loop and with the bulk loader from the same keys
+template<class TREE>
+void bulkload(const char *name, const uint64_t *keys, uint64_t n) {
+    // the bulk loader takes sorted keys, sorting is not part of the measured time
+    std::vector<uint64_t> sorted(keys, keys + n);
+    tbb::parallel_sort(sorted.begin(), sorted.end());
+    std::unique_ptr<Key[]> sortedKeys(new Key[n]);
+    tbb::parallel_for(tbb::blocked_range<uint64_t>(0, n), [&](const tbb::blocked_range<uint64_t> &range) {
+        for (uint64_t i = range.begin(); i != range.end(); i++) {
+            loadKey(sorted[i], sortedKeys[i]);
+        }
+    });
+
+    {
+        TREE tree(loadKey);
+        auto starttime = std::chrono::system_clock::now();
+        tbb::parallel_for(tbb::blocked_range<uint64_t>(0, n), [&](const tbb::blocked_range<uint64_t> &range) {
+            auto t = tree.getThreadInfo();
+            for (uint64_t i = range.begin(); i != range.end(); i++) {
+                Key key;
+                loadKey(keys[i], key);
+                tree.insert(key, keys[i], t);
+            }
+        });
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+        printf("%s,insert,%ld,%f\n", name, n, (n * 1.0) / duration.count());
+    }
+
+    {
+        TREE tree(loadKey);
+        auto t = tree.getThreadInfo();
+        auto starttime = std::chrono::system_clock::now();
+        tree.bulkLoad(sortedKeys.get(), sorted.data(), n, t);
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+        printf("%s,bulkload,%ld,%f\n", name, n, (n * 1.0) / duration.count());
+
+        tbb::parallel_for(tbb::blocked_range<uint64_t>(0, n), [&](const tbb::blocked_range<uint64_t> &range) {
+            auto t = tree.getThreadInfo();
+            for (uint64_t i = range.begin(); i != range.end(); i++) {
+                Key key;
+                loadKey(keys[i], key);
+                auto val = tree.lookup(key, t);
+                if (val != keys[i]) {
+                    std::cout << "wrong key read: " << val << " expected:" << keys[i] << std::endl;
+                    throw;
+                }
+            }
+        });
+    }
+}
+
+void bulkload(char **argv) {
+    std::cout << "bulk load:" << std::endl;
+
+    uint64_t n = std::atoll(argv[1]);
+    uint64_t *keys = new uint64_t[n];
+
+    // Generate keys
+    for (uint64_t i = 0; i < n; i++)
+        // dense, sorted
+        keys[i] = i + 1;
+    if (atoi(argv[2]) == 1)
+        // dense, random
+        std::random_shuffle(keys, keys + n);
+    if (atoi(argv[2]) == 2)
+        // "pseudo-sparse" (the most-significant leaf bit gets lost)
+        for (uint64_t i = 0; i < n; i++)
+            keys[i] = (static_cast<uint64_t>(rand()) << 32) | static_cast<uint64_t>(rand());
+
+    printf("tree,operation,n,ops/s\n");
+    bulkload<ART_OLC::Tree>("OLC", keys, n);
+    bulkload<ART_ROWEX::Tree>("ROWEX", keys, n);
+    delete[] keys;
+
+    std::cout << std::endl;
+}
+
+// the single threaded workload through the common front end
+template<class INDEX>
+void policies(const char *name, const uint64_t *keys, uint64_t n) {
+    INDEX index(loadKey);
+    auto t = index.getThreadInfo();
+
+    {
+        auto starttime = std::chrono::system_clock::now();
+        for (uint64_t i = 0; i != n; i++) {
+            Key key;
+            loadKey(keys[i], key);
+            index.insert(key, keys[i], t);
+        }
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+        printf("%s,insert,%ld,%f\n", name, n, (n * 1.0) / duration.count());
+    }
+
+    {
+        auto starttime = std::chrono::system_clock::now();
+        for (uint64_t i = 0; i != n; i++) {
+            Key key;
+            loadKey(keys[i], key);
+            auto val = index.lookup(key, t);
+            if (val != keys[i]) {
+                std::cout << "wrong key read: " << val << " expected:" << keys[i] << std::endl;
+                throw;
+            }
+        }
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+        printf("%s,lookup,%ld,%f\n", name, n, (n * 1.0) / duration.count());
+    }
+
+    {
+        // all keys in pages of 1000
+        Key start, end, continueKey;
+        loadKey(0, start);
+        loadKey(~static_cast<uint64_t>(0), end);
+        TID result[1000];
+        std::size_t resultCount, found = 0;
+        auto starttime = std::chrono::system_clock::now();
+        while (index.lookupRange(start, end, continueKey, result, 1000, resultCount, t)) {
+            found += resultCount;
+            start.set(reinterpret_cast<const char *>(&continueKey[0]), continueKey.getKeyLen());
+        }
+        found += resultCount;
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+        if (found != n) {
+            std::cout << "scan found " << found << " keys, expected:" << n << std::endl;
+            throw;
+        }
+        printf("%s,scan,%ld,%f\n", name, n, (n * 1.0) / duration.count());
+    }
+
+    {
+        auto starttime = std::chrono::system_clock::now();
+        for (uint64_t i = 0; i != n; i++) {
+            Key key;
+            loadKey(keys[i], key);
+            index.remove(key, keys[i], t);
+        }
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+        printf("%s,remove,%ld,%f\n", name, n, (n * 1.0) / duration.count());
+    }
+}
+
+void policies(char **argv) {
+    std::cout << "policies:" << std::endl;
+
+    uint64_t n = std::atoll(argv[1]);
+    uint64_t *keys = new uint64_t[n];
+
+    // Generate keys
+    for (uint64_t i = 0; i < n; i++)
+        // dense, sorted
+        keys[i] = i + 1;
+    if (atoi(argv[2]) == 1)
+        // dense, random
+        std::random_shuffle(keys, keys + n);
+    if (atoi(argv[2]) == 2)
+        // "pseudo-sparse" (the most-significant leaf bit gets lost)
+        for (uint64_t i = 0; i < n; i++)
+            keys[i] = (static_cast<uint64_t>(rand()) << 32) | static_cast<uint64_t>(rand());
+
+    printf("tree,operation,n,ops/s\n");
+    policies<ART::Index<ART::Unsynchronized>>("unsynchronized", keys, n);
+    policies<ART::Index<ART::OptimisticLockCoupling>>("OLC", keys, n);
+    policies<ART::Index<ART::ROWEX>>("ROWEX", keys, n);
+    delete[] keys;
+
+    std::cout << std::endl;
+}
+
+void hybrid(pool_base &pop, char **argv) {
+    std::cout << "hybrid (DRAM inner nodes, persistent leaves):" << std::endl;
+
+    uint64_t n = std::atoll(argv[1]);
+    uint64_t *keys = new uint64_t[n];
+
+    // Generate keys
+    for (uint64_t i = 0; i < n; i++)
+        // dense, sorted
+        keys[i] = i + 1;
+    if (atoi(argv[2]) == 1)
+        // dense, random
+        std::random_shuffle(keys, keys + n);
+    if (atoi(argv[2]) == 2)
+        // "pseudo-sparse" (the most-significant leaf bit gets lost)
+        for (uint64_t i = 0; i < n; i++)
+            keys[i] = (static_cast<uint64_t>(rand()) << 32) | static_cast<uint64_t>(rand());
+
+    printf("operation,n,ops/s\n");
+    // inner nodes are rebuilt from the leaves left in the pool by a previous run
+    ART_LC::HybridTree tree(pop);
+    printf("rebuild,%ld,%f\n", tree.getRebuildLeafCount(),
+           (tree.getRebuildLeafCount() * 1.0) / std::max<int64_t>(tree.getRebuildTime().count(), 1));
+
+    // Build tree
+    {
+        auto starttime = std::chrono::system_clock::now();
+        tbb::parallel_for(tbb::blocked_range<uint64_t>(0, n), [&](const tbb::blocked_range<uint64_t> &range) {
+            auto t = tree.getThreadInfo();
+            for (uint64_t i = range.begin(); i != range.end(); i++) {
+                Key key;
+                loadKey(keys[i], key);
+                tree.insert(key, keys[i], t);
+            }
+        });
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+        printf("insert,%ld,%f\n", n, (n * 1.0) / duration.count());
+    }
+
+    {
+        // Lookup
+        auto starttime = std::chrono::system_clock::now();
+        tbb::parallel_for(tbb::blocked_range<uint64_t>(0, n), [&](const tbb::blocked_range<uint64_t> &range) {
+            auto t = tree.getThreadInfo();
+            for (uint64_t i = range.begin(); i != range.end(); i++) {
+                Key key;
+                loadKey(keys[i], key);
+                auto val = tree.lookup(key, t);
+                if (val != keys[i]) {
+                    std::cout << "wrong key read: " << val << " expected:" << keys[i] << std::endl;
+                    throw;
+                }
+            }
+        });
         auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
                 std::chrono::system_clock::now() - starttime);
         printf("lookup,%ld,%f\n", n, (n * 1.0) / duration.count());
@@ -162,28 +477,195 @@ void multithreaded(pool_base &pop, char **argv) {
     delete[] keys;
 }
 
+void partitioned(const std::string &path, char **argv) {
+    std::cout << "partitioned (2 partitions):" << std::endl;
+
+    uint64_t n = std::atoll(argv[1]);
+    uint64_t *keys = new uint64_t[n];
+
+    // Generate keys
+    // partitions are routed by the first key byte, the keys are spread over all of them
+    uint64_t step = ~static_cast<uint64_t>(0) / (n + 1);
+    for (uint64_t i = 0; i < n; i++)
+        // sparse, sorted
+        keys[i] = (i + 1) * step;
+    if (atoi(argv[2]) != 0)
+        // sparse, random
+        std::random_shuffle(keys, keys + n);
+
+    // one growing pool per partition next to pool_path, on a NUMA machine each on the node given instead of -1
+    std::vector<ART_LC::PartitionedTree::PartitionConfig> configs;
+    for (int i = 0; i < 2; i++) {
+        std::string dir = path + ".partition" + std::to_string(i);
+        if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+            std::cout << "cannot create " << dir << std::endl;
+            throw;
+        }
+        configs.push_back({dir, -1});
+    }
+    ART_LC::PartitionedTree tree(configs, loadKey);
+
+    printf("operation,n,ops/s\n");
+    // Build tree
+    {
+        // one thread per partition, bound to its node, inserts the keys routed there
+        std::vector<std::vector<uint64_t>> routed(tree.getPartitionCount());
+        for (uint64_t i = 0; i < n; i++) {
+            Key key;
+            loadKey(keys[i], key);
+            routed[tree.getPartition(key)].push_back(keys[i]);
+        }
+        for (unsigned p = 0; p < routed.size(); p++) {
+            if (n > 1 && routed[p].empty()) {
+                std::cout << "no keys in partition " << p << std::endl;
+                throw;
+            }
+        }
+        auto starttime = std::chrono::system_clock::now();
+        std::vector<std::thread> threads;
+        for (unsigned p = 0; p < routed.size(); p++) {
+            threads.emplace_back([&, p]() {
+                tree.bindThread(p);
+                auto t = tree.getThreadInfo();
+                for (uint64_t k : routed[p]) {
+                    Key key;
+                    loadKey(k, key);
+                    tree.insert(key, k, t);
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+        printf("insert,%ld,%f\n", n, (n * 1.0) / duration.count());
+    }
+
+    {
+        // Lookup
+        auto starttime = std::chrono::system_clock::now();
+        tbb::parallel_for(tbb::blocked_range<uint64_t>(0, n), [&](const tbb::blocked_range<uint64_t> &range) {
+            auto t = tree.getThreadInfo();
+            for (uint64_t i = range.begin(); i != range.end(); i++) {
+                Key key;
+                loadKey(keys[i], key);
+                auto val = tree.lookup(key, t);
+                if (val != keys[i]) {
+                    std::cout << "wrong key read: " << val << " expected:" << keys[i] << std::endl;
+                    throw;
+                }
+            }
+        });
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+        printf("lookup,%ld,%f\n", n, (n * 1.0) / duration.count());
+    }
+
+    {
+        // all keys in pages of 100, in key order across the partition boundary
+        auto t = tree.getThreadInfo();
+        Key start, end, continueKey;
+        loadKey(0, start);
+        loadKey(~static_cast<uint64_t>(0), end);
+        TID result[100];
+        std::size_t resultCount;
+        uint64_t found = 0;
+        bool more;
+        auto starttime = std::chrono::system_clock::now();
+        do {
+            more = tree.lookupRange(start, end, continueKey, result, 100, resultCount, t);
+            for (std::size_t i = 0; i < resultCount; i++, found++) {
+                // the i-th smallest key is (i + 1) * step
+                if (found >= n || result[i] != (found + 1) * step) {
+                    std::cout << "wrong key scanned: " << result[i] << " expected:" << (found + 1) * step
+                              << std::endl;
+                    throw;
+                }
+            }
+            if (more) {
+                start.set(reinterpret_cast<const char *>(&continueKey[0]), continueKey.getKeyLen());
+            }
+        } while (more);
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+        if (found != n) {
+            std::cout << "scan found " << found << " keys, expected:" << n << std::endl;
+            throw;
+        }
+        printf("scan,%ld,%f\n", n, (n * 1.0) / duration.count());
+    }
+
+    {
+        // Remove operation, leaves the partitions empty for the next run
+        auto starttime = std::chrono::system_clock::now();
+        tbb::parallel_for(tbb::blocked_range<uint64_t>(0, n), [&](const tbb::blocked_range<uint64_t> &range) {
+            auto t = tree.getThreadInfo();
+            for (uint64_t i = range.begin(); i != range.end(); i++) {
+                Key key;
+                loadKey(keys[i], key);
+                tree.remove(key, keys[i], t);
+            }
+        });
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now() - starttime);
+        printf("remove,%ld,%f\n", n, (n * 1.0) / duration.count());
+    }
+    delete[] keys;
+}
+
 int main(int argc, char **argv) {
-    if (argc != 4) {
-        printf("usage: %s n 0|1|2 <pool_path>\nn: number of keys\n0: sorted keys\n1: dense keys\n2: sparse keys\n", argv[0]);
+    if (argc != 4 && !((argc == 5 || argc == 8) && strcmp(argv[4], "emulate") == 0)) {
+        printf("usage: %s n 0|1|2 <pool_path> [emulate [read_ns write_ns fence_ns]]\nn: number of keys\n0: sorted keys\n1: dense keys\n2: sparse keys\n"
+               "pool_path: pool file, or a directory for a pool which grows with the tree\n"
+               "emulate: the pool is in DRAM (e.g. on /dev/shm), optionally with the given latency per node read, flushed line and fence\n", argv[0]);
         return 1;
     }
 
-    auto path = argv[3];
-    pool<N> pop;
+    std::string path = argv[3];
+    std::size_t poolSize = PMEMOBJ_MIN_POOL;
+    // flushed lines and fences are reported per operation in either mode
+    ART_LC::PersistStats::setEnabled(true);
+    if (argc >= 5) {
+        // flush with cache line write backs instead of msync, as on real persistent memory
+        setenv("PMEM_IS_PMEM_FORCE", "1", 1);
+        poolSize = std::max<std::size_t>(poolSize, std::atoll(argv[1]) * 1024);
+        if (argc == 8) {
+            ART_LC::PersistStats::Latency latency;
+            latency.readNs = std::atoi(argv[5]);
+            latency.writeNs = std::atoi(argv[6]);
+            latency.fenceNs = std::atoi(argv[7]);
+            ART_LC::PersistStats::setLatency(latency);
+        }
+    }
+    pool<ART_LC::TreeAnchor> pop;
+    struct stat pathStat;
     try {
-	if (access(path.c_str(), F_OK) != 0){
-		pop = pool<N>::create(path, LAYOUT, PMEMOBJ_MIN_POOL, CREATE_MODE_RW);
+	if (stat(path.c_str(), &pathStat) == 0 && S_ISDIR(pathStat.st_mode)) {
+		// grows with the tree instead of being created with a fixed size
+		pop = ART_LC::openGrowingPool(path);
+	} else if (access(path.c_str(), F_OK) != 0){
+		pop = pool<ART_LC::TreeAnchor>::create(path, LAYOUT, poolSize, CREATE_MODE_RW);
 	} else {
-		pop = pool<N>::open(path, LAYOUT);
+		// the tree found in the pool is attached by the ART_LC::Tree constructor
+		pop = pool<ART_LC::TreeAnchor>::open(path, LAYOUT);
 	}
-    } catch(pool_error &e) {
+    } catch(std::runtime_error &e) {
 	std::cerr << e.what() << std::endl;
+	return 1;
     }
-    auto q = pop.root();
 
     singlethreaded(argv);
 
+    policies(argv);
+
+    bulkload(argv);
+
     multithreaded(pop, argv);
 
+    hybrid(pop, argv);
+
+    partitioned(path, argv);
+
     return 0;
 }